@@ -19,73 +19,142 @@ Remark:      All the part including the bonus has been done.
 #include <unistd.h>
 
 #include "buffer.h"
+#include "cache.h"
+#include "cgroup.h"
 #include "constant.h"
+#include "coproc.h"
+#include "history.h"
+#include "joblog.h"
+#include "jobtop.h"
 #include "linklist.h"
+#include "record.h"
+#include "server.h"
 #include "signals.h"
 #include "task.h"
+#include "variable.h"
 
-// a global variable that store the message from sigchld
-extern Buffer* sigBuffer;
 // a global variable that store the PIDs and corresponding CMD.
 Node** taskRecords;
+// a global variable that store the source of command line input
+InputSource* inputSource = NULL;
+// the exit status of the last foreground pipeline
+extern int lastStatus;
 
 /*
 Main loop of 3230shell.
-It allows user to input arguments into the buffer.
-Then, preprocess the buffer for ease of further parsing.
-Last, it start the task with arguments in the buffer(further parsing will be done in startTask()).
-The above loop will always execute until user enter "exit".
+It allows user to input arguments into the buffer (or read them from a script, see openInputSource()).
+Then, it start the task with arguments in the buffer(pre-processing and parsing will be done in startTask()).
+The above loop will always execute until user enter "exit" or the input ends.
 
 @param argc Argument Count
 @param argv Argument Vector
 
-@return 0/1 status code of process
+@return status The exit status of the last foreground pipeline
 */
 int main(int argc, char* argv[]) {
+	// import the inherited environment as the exported variables (see variable.c)
+	initVariables();
+	// open the source of input (terminal, "-c" string or script)
+	inputSource = openInputSource(argc, argv);
+	if (inputSource == NULL) {
+		return 1;
+	}
+	// log the command lines of session (see record.c)
+	if (inputSource->record != NULL && openRecord(inputSource->record) == -1) {
+		return 1;
+	}
 	// Input Buffer for receiving user input
 	Buffer* buffer = NULL;
-	// Initialize the background process output buffer
-	sigBuffer = initBuffer(-1);
+	// Initialize the ring of background process completions
+	initCompletionRing();
 	// Initialize the task record to record the PIDs and corresponding CMD
 	taskRecords = (Node**) malloc(sizeof(Node*));
 	(*taskRecords) = NULL;
 	// exit status ( 0 -> not exit, 1-> exit)
 	int exit = 0;
 	
-	// Flush standard output immediately.
-	setbuf(stdout, NULL);
+	if (inputSource->interactive == 1) {
+		// Flush standard output immediately.
+		setbuf(stdout, NULL);
+		// load the command history
+		openHistory();
+	}
+	else {
+		// Fully buffer the standard output in script mode (it is flushed before every fork).
+		setvbuf(stdout, NULL, _IOFBF, script_block_size);
+	}
+	
+	// serve the clients of the unix socket instead of reading command lines (see server.c)
+	if (inputSource->listen != NULL) {
+		lastStatus = runServer(inputSource->listen);
+		exit = 1;
+	}
 	
 	while(exit == 0) {
 		// register the signal handler of main process
 		regMainSighandler();
 		// display the input notification
-		printf("$$ 3230shell ## ");
+		if (inputSource->interactive == 1) {
+			printf("$$ 3230shell ## ");
+		}
 		// declare and initialize buffer
 		buffer = initBuffer(-1);
-		// allow user input to the buffer through command line
-		getCommandLineInput(buffer);
+		// allow user input to the buffer through command line, quit when there is no more input
+		if (getCommandLineInput(buffer, inputSource) == -1) {
+			if (inputSource->interactive == 1) {
+				printf("\n");
+			}
+			exit = 1;
+		}
 		// avoid the empty input
-		if (strlen(buffer->string) != 0) {
-			// preprocess the input for ease of parsing.
-			buffer = preprocessBuffer(buffer);
-			// start all the tasks specify in the input string
-			exit = startTasks(buffer->string);
+		else if (strlen(buffer->string) != 0) {
+			// replace "!!", "!N" and "!prefix" by the command line in history, and record the command line
+			if (inputSource->interactive == 1 && buffer->string[0] == '!') {
+				buffer = expandHistory(buffer);
+				if (buffer != NULL) {
+					printf("%s\n", buffer->string);
+				}
+			}
+			// an event that is not found is not run (the message is printed), the background jobs are still checked below
+			if (buffer != NULL) {
+				if (inputSource->interactive == 1) {
+					addHistory(buffer->string);
+				}
+				// start all the tasks specify in the input string (it is pre-processed and parsed in startTasks())
+				beginRecord(buffer->string);
+				exit = startTasks(buffer->string);
+				endRecord(buffer->string, lastStatus);
+			}
 		}
-		// free the buffer
-		buffer = freeBuffer(buffer);
-		// print the exit message of background processes
-		if (sigBuffer != NULL) {
-			// output the message store in buffer
-			printf("%s", sigBuffer->string);
-			// empty the buffer
-			memset(sigBuffer->string, 0, sigBuffer->capacity * sizeof(char));
+		// free the buffer (it is freed by expandHistory() if the event is not found)
+		if (buffer != NULL) {
+			buffer = freeBuffer(buffer);
 		}
+		// print the output of background jobs and their exit message
+		drainJobLogs();
+		printCompletions();
+		// remove the cgroups of finished jobs, and print the usage of background jobs
+		reapJobCgroups();
 	}
 	// release all child process
 	killAll(taskRecords);
-	// free the buffer
-	freeBuffer(sigBuffer);
 	// free the link list
 	freeList(taskRecords);
-	return 0;
+	// close the files of job monitor
+	freeJobSamples();
+	// free the output of background jobs
+	freeJobLogs();
+	// free the parsed command cache
+	clearCommandCache();
+	// close the command history
+	closeHistory();
+	// close the log of session
+	closeRecord();
+	// close the pipes of coprocesses, and free the shell variables and the environment
+	freeCoprocs();
+	freeVariables();
+	// close the input source
+	inputSource = closeInputSource(inputSource);
+	fflush(stdout);
+	return lastStatus;
 }
\ No newline at end of file
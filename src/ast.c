@@ -0,0 +1,603 @@
+/*
+FileName:    ast.c
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: It parse the argument vector into a command list (pipelines connected by ';', '&', '&&' and '||'), and detect the syntax errors.
+Remark:      function implemented in this file:
+             1. Process creation and execution – use of ‘;’, ‘&&’ and ‘||’: parsing (execution is in task.c)
+             2. Prefix "limit" of command: parsing (the settings are parsed and applied in launch.c)
+             3. Prefix "timeout" of pipeline: parsing (the deadline is armed in watchdog.c)
+             4. Prefix "every" of pipeline: parsing (the runs are scheduled in every.c)
+             5. Variable assignments before command (e.g. "LANG=C sort"): parsing (the variables are in variable.c)
+             6. Prefix "coproc NAME" of pipeline: parsing (the coprocess is started in coproc.c)
+             7. Prefix "memo" of pipeline: parsing (the output is cached in memo.c)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ast.h"
+#include "cgroup.h"
+#include "constant.h"
+#include "coproc.h"
+#include "every.h"
+#include "expand.h"
+#include "history.h"
+#include "joblog.h"
+#include "jobtop.h"
+#include "launch.h"
+#include "variable.h"
+#include "watchdog.h"
+
+/*
+Check whether the token is an operator that separate pipelines (i.e. ';', '&', '&&' and '||').
+
+@param token The token
+
+@return 1 if it is a list operator, 0 otherwise
+*/
+int isListOperator(char* token) {
+	return token != NULL && (strcmp(token, ";") == 0 || strcmp(token, "&") == 0 || strcmp(token, "&&") == 0 || strcmp(token, "||") == 0);
+}
+
+/*
+Parse a redirection operator, i.e. "<<", "<<<", "<", ">", ">>", "<&" and ">&".
+The operators except "<<" and "<<<" may start with the fd to be redirected (e.g. "2>", "2>&").
+
+@param token The token
+@param redirect The redirection to be filled with the type and fd (NULL if the token is only checked)
+
+@return 1 if it is a redirection operator, 0 otherwise
+*/
+int parseRedirectOperator(char* token, Redirect* redirect) {
+	if (token == NULL) {
+		return 0;
+	}
+	int digits = strspn(token, "0123456789");
+	char* operator = &token[digits];
+	RedirectType type = REDIRECT_INPUT;
+	int fd = 0;
+	if (digits == 0 && strcmp(operator, "<<") == 0) {
+		type = REDIRECT_HEREDOC;
+	}
+	else if (digits == 0 && strcmp(operator, "<<<") == 0) {
+		type = REDIRECT_HERESTRING;
+	}
+	else if (strcmp(operator, "<") == 0) {
+		type = REDIRECT_INPUT;
+	}
+	else if (strcmp(operator, ">") == 0) {
+		type = REDIRECT_OUTPUT;
+		fd = 1;
+	}
+	else if (strcmp(operator, ">>") == 0) {
+		type = REDIRECT_APPEND;
+		fd = 1;
+	}
+	else if (strcmp(operator, "<&") == 0 || strcmp(operator, ">&") == 0) {
+		type = REDIRECT_DUPLICATE;
+		fd = operator[0] == '>';
+	}
+	else {
+		return 0;
+	}
+	if (redirect != NULL) {
+		redirect->type = type;
+		redirect->fd = digits > 0 ? atoi(token) : fd;
+	}
+	return 1;
+}
+
+/*
+Check whether the token is a redirection operator (e.g. '<<', '<<<', '>', '2>&').
+
+@param token The token
+
+@return 1 if it is a redirection operator, 0 otherwise
+*/
+int isRedirectOperator(char* token) {
+	return parseRedirectOperator(token, NULL);
+}
+
+/*
+Check whether the token is any operator (i.e. '|', ';', '&', '&&' and '||').
+
+@param token The token
+
+@return 1 if it is an operator, 0 otherwise
+*/
+int isOperator(char* token) {
+	return token != NULL && (strcmp(token, "|") == 0 || isListOperator(token));
+}
+
+/*
+Detect the syntax error of the operators.
+
+@param tokens The argument vector (e.g. {"ls", "|", "wc", "&&", "echo", "ok", NULL})
+
+@return 1 if there is error (the message is printed), 0 otherwise
+*/
+int checkOperators(char** tokens) {
+	for (int i = 0; tokens[i] != NULL; i++) {
+		char* prev = i > 0 ? tokens[i-1] : NULL;
+		char* next = tokens[i+1];
+		// handle pipe command
+		if (strcmp(tokens[i], "|") == 0) {
+			// the pipeline start with "timeX"
+			int afterTimeX = prev != NULL && strcmp(prev, "timeX") == 0 && (i == 1 || isListOperator(tokens[i-2]));
+			if (prev == NULL || isListOperator(prev) || afterTimeX) {
+				printf("3230shell: syntax error near unexpected token `|'\n");
+				return 1;
+			}
+			else if (next == NULL) {
+				printf("3230shell: '|' should not appear in the last of the command line\n");
+				return 1;
+			}
+			else if (strcmp(next, "|") == 0) {
+				printf("3230shell: should not have two consecutive | without in-between command\n");
+				return 1;
+			}
+			else if (isListOperator(next)) {
+				printf("3230shell: syntax error near unexpected token `|'\n");
+				return 1;
+			}
+		}
+		// handle & command
+		else if (strcmp(tokens[i], "&") == 0) {
+			if (i == 0 && next == NULL) {
+				printf("3230shell: '&' cannot be a standalone command\n");
+				return 1;
+			}
+			else if (i == 0) {
+				printf("3230shell: '&' should not appear in the begin of the command line\n");
+				return 1;
+			}
+			else if (isListOperator(prev)) {
+				printf("3230shell: syntax error near unexpected token `&'\n");
+				return 1;
+			}
+		}
+		// handle redirection, it must be followed by a word
+		else if (isRedirectOperator(tokens[i])) {
+			if (next == NULL) {
+				printf("3230shell: syntax error near unexpected token `newline'\n");
+				return 1;
+			}
+			else if (isOperator(next) || isRedirectOperator(next)) {
+				printf("3230shell: syntax error near unexpected token `%s'\n", next);
+				return 1;
+			}
+			i++;
+		}
+		// handle ;, && and || command
+		else if (isListOperator(tokens[i])) {
+			if (prev == NULL || isListOperator(prev)) {
+				printf("3230shell: syntax error near unexpected token `%s'\n", tokens[i]);
+				return 1;
+			}
+			else if (next == NULL && strcmp(tokens[i], ";") != 0) {
+				printf("3230shell: '%s' should not appear in the last of the command line\n", tokens[i]);
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+/*
+Detect the errors of a built-in command (e.g. "exit" with other arguments, wrong arguments of "history", "ulimit" and "cgroup").
+
+@param argv The argument vector of command
+@param stageNum The number of commands in its pipeline
+
+@return 1 if there is error (the message is printed), 0 otherwise
+*/
+int checkBuiltin(char** argv, int stageNum) {
+	// handle exit and shellstat command
+	if (strcmp(argv[0], "exit") == 0 && stageNum > 1) {
+		printf("3230shell: \"exit\" cannot be used in a pipeline\n");
+		return 1;
+	}
+	else if (strcmp(argv[0], "exit") == 0 && argv[1] != NULL) {
+		printf("3230shell: \"exit\" with other arguments!!!\n");
+		return 1;
+	}
+	else if (strcmp(argv[0], "shellstat") == 0 && argv[1] != NULL) {
+		printf("3230shell: \"shellstat\" with other arguments!!!\n");
+		return 1;
+	}
+	// the prefixes of pipeline are only taken at the beginning (e.g. "ls | every 1s wc")
+	else if (stageNum > 1 && (strcmp(argv[0], "timeX") == 0 || strcmp(argv[0], "every") == 0 || strcmp(argv[0], "memo") == 0)) {
+		printf("3230shell: \"%s\" must be at the beginning of a pipeline\n", argv[0]);
+		return 1;
+	}
+	// handle history command
+	else if (strcmp(argv[0], "history") == 0) {
+		return checkHistoryArgs(argv);
+	}
+	// handle ulimit command
+	else if (strcmp(argv[0], "ulimit") == 0) {
+		return checkUlimitArgs(argv);
+	}
+	// handle cgroup command
+	else if (strcmp(argv[0], "cgroup") == 0) {
+		return checkCgroupArgs(argv);
+	}
+	// handle coproc command (without command, e.g. "coproc -c BC")
+	else if (strcmp(argv[0], "coproc") == 0) {
+		return checkCoprocArgs(argv);
+	}
+	// handle jobtop command
+	else if (strcmp(argv[0], "jobtop") == 0) {
+		return checkJobtopArgs(argv);
+	}
+	// handle joblog command
+	else if (strcmp(argv[0], "joblog") == 0) {
+		return checkJoblogArgs(argv);
+	}
+	return 0;
+}
+
+/*
+Detect the errors of built-in commands in a pipeline (e.g. "exit" with other arguments, standalone "timeX", wrong arguments of "history", "ulimit" and "cgroup").
+
+@param pipeline The pipeline
+
+@return 1 if there is error (the message is printed), 0 otherwise
+*/
+int checkPipeline(Pipeline* pipeline) {
+	// handle timeX command
+	if (pipeline->timeX == 1 && pipeline->stageNum == 1 && pipeline->stages[0].argv[0] == NULL && pipeline->stages[0].redirectNum == 0) {
+		printf("3230shell: \"timeX\" cannot be a standalone command\n");
+		return 1;
+	}
+	else if (pipeline->timeX == 1 && pipeline->background == 1) {
+		printf("3230shell: \"timeX\" cannot be run in background mode\n");
+		return 1;
+	}
+	// handle every command
+	if (pipeline->every > 0 && pipeline->stages[0].argv[0] == NULL && pipeline->stages[0].limits == NULL && pipeline->stages[0].redirectNum == 0) {
+		printf("3230shell: \"every\" cannot be a standalone command\n");
+		return 1;
+	}
+	else if (pipeline->every > 0 && pipeline->background == 1) {
+		printf("3230shell: \"every\" cannot be run in background mode\n");
+		return 1;
+	}
+	// handle coproc prefix
+	if (pipeline->coproc != NULL && (pipeline->timeX == 1 || pipeline->every > 0)) {
+		printf("3230shell: \"coproc\" cannot be used with \"%s\"\n", pipeline->timeX == 1 ? "timeX" : "every");
+		return 1;
+	}
+	// handle memo command
+	if (pipeline->memo == 1 && pipeline->stages[0].argv[0] == NULL && pipeline->stages[0].limits == NULL && pipeline->stages[0].redirectNum == 0) {
+		printf("3230shell: \"memo\" cannot be a standalone command\n");
+		return 1;
+	}
+	else if (pipeline->memo == 1 && (pipeline->background == 1 || pipeline->coproc != NULL)) {
+		printf("3230shell: \"memo\" cannot be run in background mode\n");
+		return 1;
+	}
+	// handle timeout command
+	if (pipeline->timeout > 0 && pipeline->stages[0].argv[0] == NULL && pipeline->stages[0].limits == NULL && pipeline->stages[0].redirectNum == 0) {
+		printf("3230shell: \"timeout\" cannot be a standalone command\n");
+		return 1;
+	}
+	// a command line with assignments only (e.g. "A=1 B=$A") set the shell variables
+	if (pipeline->stageNum == 1 && pipeline->stages[0].argv[0] == NULL && pipeline->stages[0].assignmentNum > 0
+		&& pipeline->stages[0].limits == NULL && pipeline->stages[0].redirectNum == 0) {
+		return 0;
+	}
+	// a command with redirection, "limit" or assignments only (e.g. "<<< word", "limit nice=5")
+	for (int i = 0; i < pipeline->stageNum; i++) {
+		if (pipeline->stages[i].argv[0] == NULL && pipeline->stages[i].limits != NULL && pipeline->stages[i].redirectNum == 0) {
+			printf("3230shell: \"limit\" cannot be a standalone command\n");
+			return 1;
+		}
+		if (pipeline->stages[i].argv[0] == NULL && pipeline->stages[i].assignmentNum > 0 && pipeline->stages[i].redirectNum == 0) {
+			printf("3230shell: missing command after assignment\n");
+			return 1;
+		}
+		if (pipeline->stages[i].argv[0] == NULL) {
+			printf("3230shell: missing command for redirection\n");
+			return 1;
+		}
+	}
+	// handle the built-in commands of each command, a piped built-in command run in the child process (e.g. "history | tail")
+	for (int i = 0; i < pipeline->stageNum; i++) {
+		if (checkBuiltin(pipeline->stages[i].argv, pipeline->stageNum) == 1) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+Take the body of a here-document from $(*bodies), i.e. the lines until the delimiter.
+The delimiter is removed from the body, and the quotes of delimiter are removed.
+
+@param bodies The lines following the command line (it is moved to the line after delimiter)
+@param word The delimiter (e.g. "EOF" or "'EOF'")
+@param body The space to copy the body (each line end with '\10')
+
+@return quoted 1 if the delimiter is quoted (i.e. the body is not expanded)
+*/
+int takeHereDocument(char** bodies, char* word, char* body) {
+	// remove the quotes of delimiter
+	char delimiter[strlen(word) + 1];
+	int length = 0;
+	int quoted = 0;
+	for (int i = 0; word[i] != '\0'; i++) {
+		if (word[i] == '\'' || word[i] == '"') {
+			quoted = 1;
+			continue;
+		}
+		delimiter[length++] = word[i];
+	}
+	delimiter[length] = '\0';
+	// copy the lines before delimiter
+	body[0] = '\0';
+	char* line = *bodies;
+	int pos = 0;
+	while (line != NULL) {
+		char* end = strchr(line, '\n');
+		int lineLength = end != NULL ? (int) (end - line) : (int) strlen(line);
+		char* next = end != NULL ? end + 1 : NULL;
+		if (lineLength == length && strncmp(line, delimiter, length) == 0) {
+			line = next;
+			break;
+		}
+		memcpy(&body[pos], line, lineLength);
+		pos += lineLength;
+		body[pos++] = '\n';
+		body[pos] = '\0';
+		line = next;
+	}
+	*bodies = line;
+	return quoted;
+}
+
+/*
+Parse the argument vector into a command list, and detect the syntax errors.
+i.e. {"timeX", "ls", "|", "wc", "&&", "sleep", "1", "&"} ->
+     [(timeX, [("ls"), ("wc")], &&), (background, [("sleep", "1")], end)]
+All the strings are copied into the list, so $(tokens) could be freed after parsing.
+
+@param tokens The argument vector (split by space, "|", "&", ";", "&&", "||", and the redirections are standalone tokens)
+@param bodies The lines following the command line that hold the bodies of here-documents (NULL if none)
+
+@return list The command list (NULL if there is syntax error)
+*/
+CommandList* parseCommandList(char** tokens, char* bodies) {
+	if (checkOperators(tokens) == 1) {
+		return NULL;
+	}
+	// count the tokens and the size of strings
+	int tokenNum = 0;
+	int textSize = 0;
+	for (int i = 0; tokens[i] != NULL; i++) {
+		tokenNum++;
+		textSize += strlen(tokens[i]) + 1;
+	}
+	// the bodies of here-documents are copied too
+	if (bodies != NULL) {
+		textSize += strlen(bodies) + 2 * tokenNum + 1;
+	}
+	// allocate the storage, the number of tokens is the upper bound of pipelines and stages
+	CommandList* list = (CommandList*) malloc(sizeof(CommandList));
+	memset(list, 0, sizeof(CommandList));
+	list->pipelines = (Pipeline*) malloc((tokenNum + 1) * sizeof(Pipeline));
+	memset(list->pipelines, 0, (tokenNum + 1) * sizeof(Pipeline));
+	list->stages = (Stage*) malloc((tokenNum + 1) * sizeof(Stage));
+	memset(list->stages, 0, (tokenNum + 1) * sizeof(Stage));
+	list->redirects = (Redirect*) malloc((tokenNum + 1) * sizeof(Redirect));
+	memset(list->redirects, 0, (tokenNum + 1) * sizeof(Redirect));
+	list->slots = (char**) malloc((2 * tokenNum + 2) * sizeof(char*));
+	list->text = (char*) malloc((textSize + 1) * sizeof(char));
+	list->refs = 1;
+
+	// the pipeline and stage that is being built
+	Pipeline* pipeline = &list->pipelines[0];
+	Stage* stage = &list->stages[0];
+	int stageNum = 1;
+	int slotPos = 0;
+	int textPos = 0;
+	int redirectNum = 0;
+	int limitNum = 0;
+	int error = 0;
+	pipeline->stages = stage;
+	stage->argv = &list->slots[slotPos];
+	// a blank line has no pipeline
+	list->pipelineNum = tokens[0] != NULL ? 1 : 0;
+
+	for (int i = 0; tokens[i] != NULL; i++) {
+		// split the commands by "|"
+		if (strcmp(tokens[i], "|") == 0) {
+			list->slots[slotPos++] = NULL;
+			pipeline->stageNum += 1;
+			stage = &list->stages[stageNum++];
+			stage->argv = &list->slots[slotPos];
+			continue;
+		}
+		// split the pipelines by ";", "&", "&&" and "||"
+		if (isListOperator(tokens[i])) {
+			list->slots[slotPos++] = NULL;
+			pipeline->stageNum += 1;
+			if (strcmp(tokens[i], "&") == 0) {
+				pipeline->background = 1;
+				pipeline->connector = CONNECT_SEQ;
+			}
+			else if (strcmp(tokens[i], "&&") == 0) {
+				pipeline->connector = CONNECT_AND;
+			}
+			else if (strcmp(tokens[i], "||") == 0) {
+				pipeline->connector = CONNECT_OR;
+			}
+			else {
+				pipeline->connector = CONNECT_SEQ;
+			}
+			// the list may end with ';' or '&'
+			if (tokens[i+1] == NULL) {
+				pipeline->connector = CONNECT_END;
+				break;
+			}
+			pipeline = &list->pipelines[list->pipelineNum++];
+			stage = &list->stages[stageNum++];
+			pipeline->stages = stage;
+			stage->argv = &list->slots[slotPos];
+			continue;
+		}
+		// take the redirection and its word
+		if (isRedirectOperator(tokens[i])) {
+			Redirect* redirect = &list->redirects[redirectNum++];
+			if (stage->redirectNum == 0) {
+				stage->redirects = redirect;
+			}
+			stage->redirectNum += 1;
+			parseRedirectOperator(tokens[i], redirect);
+			redirect->word = &list->text[textPos];
+			if (redirect->type == REDIRECT_HEREDOC) {
+				redirect->expand = takeHereDocument(&bodies, tokens[i+1], redirect->word) == 0 && needsSubstitution(redirect->word);
+			}
+			else {
+				strcpy(redirect->word, tokens[i+1]);
+				redirect->expand = needsExpansion(redirect->word);
+			}
+			textPos += strlen(redirect->word) + 1;
+			i++;
+			continue;
+		}
+		// take the NAME of "coproc" at beginning of pipeline (e.g. "coproc BC bc -l"), "coproc" without command is the built-in command
+		if (strcmp(tokens[i], "coproc") == 0 && stage == pipeline->stages && stage->argv == &list->slots[slotPos] && stage->limits == NULL
+			&& pipeline->coproc == NULL && tokens[i+1] != NULL && isVariableName(tokens[i+1])
+			&& tokens[i+2] != NULL && strcmp(tokens[i+2], "|") != 0 && !isListOperator(tokens[i+2])) {
+			pipeline->coproc = &list->text[textPos];
+			strcpy(pipeline->coproc, tokens[i+1]);
+			textPos += strlen(tokens[i+1]) + 1;
+			i++;
+			continue;
+		}
+		// ignore the timeX at beginning of pipeline
+		if (strcmp(tokens[i], "timeX") == 0 && stage == pipeline->stages && stage->argv == &list->slots[slotPos]) {
+			pipeline->timeX = 1;
+			continue;
+		}
+		// the output of pipeline with "memo" at beginning is cached (e.g. "memo ./report.sh | sort")
+		if (strcmp(tokens[i], "memo") == 0 && stage == pipeline->stages && stage->argv == &list->slots[slotPos]
+			&& stage->limits == NULL && pipeline->memo == 0) {
+			pipeline->memo = 1;
+			continue;
+		}
+		// take the interval of "every" at beginning of pipeline (e.g. "every 500ms -c ls | wc -l")
+		if (strcmp(tokens[i], "every") == 0 && stage == pipeline->stages && stage->argv == &list->slots[slotPos]
+			&& stage->limits == NULL && pipeline->every == 0) {
+			int consumed = parseEvery(&tokens[i], pipeline);
+			if (consumed == -1) {
+				error = 1;
+				break;
+			}
+			i += consumed;
+			continue;
+		}
+		// take the duration of "timeout" at beginning of pipeline (e.g. "timeout -k 1 5s make | tee log")
+		if (strcmp(tokens[i], "timeout") == 0 && stage == pipeline->stages && stage->argv == &list->slots[slotPos]
+			&& stage->limits == NULL && pipeline->timeout == 0) {
+			int consumed = parseTimeout(&tokens[i], &pipeline->timeout, &pipeline->killAfter);
+			if (consumed == -1) {
+				error = 1;
+				break;
+			}
+			i += consumed;
+			continue;
+		}
+		// take the settings of "limit" at beginning of command (e.g. "limit nice=10 cpus=0-1 make")
+		if (strcmp(tokens[i], "limit") == 0 && stage->argv == &list->slots[slotPos] && stage->limits == NULL) {
+			if (list->limits == NULL) {
+				list->limits = (LaunchLimits*) malloc((tokenNum + 1) * sizeof(LaunchLimits));
+			}
+			stage->limits = &list->limits[limitNum++];
+			memset(stage->limits, 0, sizeof(LaunchLimits));
+			int result = 0;
+			while (tokens[i+1] != NULL && (result = parseLimit(tokens[i+1], stage->limits)) == 1) {
+				i++;
+			}
+			if (result == -1) {
+				error = 1;
+				break;
+			}
+			continue;
+		}
+		// take the variable assignments at beginning of command (e.g. "LANG=C TZ=UTC date")
+		if (stage->argv == &list->slots[slotPos] && isAssignment(tokens[i]) > 0) {
+			char* assignment = &list->text[textPos];
+			strcpy(assignment, tokens[i]);
+			textPos += strlen(tokens[i]) + 1;
+			if (stage->assignmentNum == 0) {
+				stage->assignments = &list->slots[slotPos];
+			}
+			stage->assignmentNum += 1;
+			list->slots[slotPos++] = assignment;
+			stage->argv = &list->slots[slotPos];
+			continue;
+		}
+		// copy the argument, and separate the path from the command
+		char* arg = &list->text[textPos];
+		strcpy(arg, tokens[i]);
+		textPos += strlen(tokens[i]) + 1;
+		int expand = needsExpansion(arg);
+		if (expand == 1) {
+			stage->expand = 1;
+		}
+		if (stage->argv == &list->slots[slotPos]) {
+			stage->path = arg;
+			// the path of an argument to be expanded is separated after expansion
+			char* slash = strrchr(arg, '/');
+			if (expand == 0 && slash != NULL && slash[1] != '\0') {
+				arg = slash + 1;
+			}
+		}
+		list->slots[slotPos++] = arg;
+	}
+	// an invalid setting of "limit", or duration of "timeout" and "every" (the message is printed)
+	if (error == 1) {
+		return freeCommandList(list);
+	}
+	// label the end of the last stage
+	if (tokens[0] != NULL && !isListOperator(tokens[tokenNum-1])) {
+		list->slots[slotPos++] = NULL;
+		pipeline->stageNum += 1;
+		pipeline->connector = CONNECT_END;
+	}
+	// detect the errors of built-in commands
+	for (int i = 0; i < list->pipelineNum; i++) {
+		if (checkPipeline(&list->pipelines[i]) == 1) {
+			return freeCommandList(list);
+		}
+	}
+	return list;
+}
+
+/*
+Release a reference to the command list, and free it when there is no more reference.
+
+@param list The command list
+
+@return NULL to NULL the list
+*/
+CommandList* freeCommandList(CommandList* list) {
+	list->refs -= 1;
+	if (list->refs > 0) {
+		return NULL;
+	}
+	free(list->paths);
+	free(list->pipelines);
+	free(list->stages);
+	free(list->redirects);
+	free(list->limits);
+	free(list->slots);
+	free(list->text);
+	free(list);
+	return NULL;
+}
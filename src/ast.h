@@ -0,0 +1,96 @@
+/*
+FileName:    ast.h
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: Hold the function header of ast.c, provide self defined structure.
+Remark:      None of function is implemented in this file.
+*/
+
+#include "launch.h"
+
+#ifndef AST_H
+#define AST_H
+
+// the operator that decide whether the next pipeline is run
+typedef enum Connector {
+	CONNECT_END,    // the last pipeline of the list
+	CONNECT_SEQ,    // ';' or '&', always run the next pipeline
+	CONNECT_AND,    // '&&', run the next pipeline if this one succeed
+	CONNECT_OR      // '||', run the next pipeline if this one fail
+} Connector;
+
+// the type of redirection
+typedef enum RedirectType {
+	REDIRECT_HEREDOC,       // "<<WORD", the body is given in the following lines until WORD
+	REDIRECT_HERESTRING,    // "<<< word"
+	REDIRECT_INPUT,         // "< file"
+	REDIRECT_OUTPUT,        // "> file"
+	REDIRECT_APPEND,        // ">> file"
+	REDIRECT_DUPLICATE      // "<&N" and ">&N", a copy of fd N (e.g. "2>&1", ">&${NAME[1]}")
+} RedirectType;
+
+// a redirection of a command (e.g. "<<< 'hello world'", "2>&1")
+typedef struct Redirect {
+	RedirectType type;
+	int fd;             // the fd of command to be redirected (e.g. 0 for stdin, it may be given before the operator, e.g. "2>")
+	char* word;         // the body of here-document, the word of here-string, the file, or the fd to be copied
+	int expand;         // 1 if $(word) need expansion before execution
+} Redirect;
+
+// a command in the pipeline (e.g. "/bin/grep c$")
+typedef struct Stage {
+	char** argv;        // NULL terminated argument vector without path (e.g. {"grep", "c$", NULL})
+	char* path;         // the command with path that is passed to exec() (e.g. "/bin/grep")
+	int expand;         // 1 if the arguments need expansion before execution (e.g. quotes, "$(...)")
+	Redirect* redirects;
+	int redirectNum;
+	LaunchLimits* limits;   // the settings of "limit" prefix (NULL if none)
+	char** assignments;     // the variable assignments before the command (e.g. {"LANG=C"}), they are exported to the command only
+	int assignmentNum;
+} Stage;
+
+// commands connected by '|' (e.g. "timeX ls -l | grep c$")
+typedef struct Pipeline {
+	Stage* stages;
+	int stageNum;
+	int background;     // 1 if the pipeline end with '&'
+	int timeX;          // 1 if the pipeline start with "timeX"
+	double timeout;     // the seconds of prefix "timeout" before the job is terminated (0 if none)
+	double killAfter;   // the seconds between SIGTERM and SIGKILL of "timeout"
+	double every;       // the seconds between the runs of prefix "every" (0 if none)
+	long everyCount;    // the number of runs of "every" (0 means until Ctrl-C)
+	int everyChanges;   // 1 if "every -c" only print the output when it changes
+	int capture;        // the fd that the output of last command is written to (0 means the standard output)
+	int input;          // the fd that the first command read from (0 means the standard input)
+	char* coproc;       // the NAME of prefix "coproc NAME" (NULL if none)
+	int memo;           // 1 if the pipeline start with "memo" (its output is cached on disk)
+	Connector connector;
+} Pipeline;
+
+// pipelines connected by ';', '&', '&&' and '||' (e.g. "make && ./a.out ; ls &")
+// all the strings and vectors are stored in a few flat arrays owned by the list.
+// the list may be shared by the command cache, it is freed when $(refs) drop to 0.
+typedef struct CommandList {
+	Pipeline* pipelines;
+	int pipelineNum;
+	Stage* stages;      // storage of all stages
+	Redirect* redirects;    // storage of all redirections
+	LaunchLimits* limits;   // storage of the settings of all "limit" prefixes (NULL if none)
+	char** slots;       // storage of all argument vectors
+	char* text;         // storage of all argument strings
+	char* paths;        // storage of the full paths of commands (NULL if not resolved)
+	int refs;           // number of references to the list
+} CommandList;
+
+int isListOperator(char* token);
+
+int parseRedirectOperator(char* token, Redirect* redirect);
+
+int isRedirectOperator(char* token);
+
+CommandList* parseCommandList(char** tokens, char* bodies);
+
+CommandList* freeCommandList(CommandList* list);
+
+#endif
@@ -0,0 +1,360 @@
+/*
+FileName:    bench.c
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: The microbenchmarks of 3230shell (see the "bench" targets in makefile).
+             It is linked with the code of shell (except the main loop), so the shell is measured from inside,
+             and the results are printed as CSV: version,build,benchmark,metric,iterations,value,unit
+             The rows of different builds and versions can be appended into one file and compared.
+Remark:      function implemented in this file:
+             1. Line parse cost of preprocessBuffer() and constructArgv() (and parseCommandList())
+             2. Fork-to-exec latency of a foreground command
+             3. Throughput of a N-stage pipeline in MB/s
+             4. Reaping of background processes under a storm of "&" jobs
+             5. Memory per command
+*/
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <malloc.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ast.h"
+#include "buffer.h"
+#include "cache.h"
+#include "linklist.h"
+#include "shellstat.h"
+#include "signals.h"
+#include "task.h"
+
+// a global variable that store the PIDs and corresponding CMD.
+Node** taskRecords;
+// a global variable that store the source of command line input (there is none, the commands are run by startTasks())
+InputSource* inputSource = NULL;
+// a global variable that store the counters of the shell since startup
+extern ShellStat shellStat;
+// the completions of background processes that wait to be printed
+extern CompletionRing completions;
+// the number of background processes that are not reaped yet
+extern atomic_long runningBackground;
+
+// the columns that are the same in every row
+char* benchVersion = "unknown";
+char* benchBuild = "default";
+
+// the iterations are divided by it (e.g. "--quick" for the training run of PGO)
+long benchScale = 1;
+
+// the stdout of bench, it is saved while the output of commands is discarded
+int savedStdout = -1;
+
+/*
+Print a row of result.
+
+@param benchmark The name of benchmark
+@param metric The name of value
+@param iterations The number of iterations measured
+@param value The value
+@param unit The unit of value
+
+@return void
+*/
+void printRow(char* benchmark, char* metric, long iterations, double value, char* unit) {
+	printf("%s,%s,%s,%s,%ld,%.3f,%s\n", benchVersion, benchBuild, benchmark, metric, iterations, value, unit);
+	fflush(stdout);
+}
+
+/*
+Get the nanoseconds between 2 points on the monotonic clock.
+
+@param start The start
+@param end The end
+
+@return nanos The nanoseconds
+*/
+double nanosBetween(struct timespec* start, struct timespec* end) {
+	return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+/*
+Discard the output of commands (the CSV is printed to stdout), or restore stdout.
+
+@param discard 1 to discard, 0 to restore
+
+@return void
+*/
+void discardOutput(int discard) {
+	fflush(stdout);
+	if (discard == 1) {
+		savedStdout = dup(STDOUT_FILENO);
+		int null = open("/dev/null", O_WRONLY);
+		dup2(null, STDOUT_FILENO);
+		close(null);
+	}
+	else {
+		dup2(savedStdout, STDOUT_FILENO);
+		close(savedStdout);
+		savedStdout = -1;
+	}
+}
+
+/*
+Run a command line by the shell with its output discarded.
+
+@param line The command line
+
+@return void
+*/
+void runLine(char* line) {
+	discardOutput(1);
+	startTasks(line);
+	printCompletions();
+	discardOutput(0);
+}
+
+/*
+Clear the histograms and counters, so a benchmark only see its own samples.
+
+@param void
+
+@return void
+*/
+void resetShellStat(void) {
+	memset(&shellStat, 0, sizeof(ShellStat));
+}
+
+/*
+Print the percentiles of a histogram as rows (in microsecond).
+
+@param benchmark The name of benchmark
+@param hist The histogram
+
+@return void
+*/
+void printPercentiles(char* benchmark, Histogram* hist) {
+	if (hist->total == 0) {
+		return;
+	}
+	printRow(benchmark, "p50", hist->total, valueAtPercentile(hist, 50.0) / 1000.0, "us");
+	printRow(benchmark, "p99", hist->total, valueAtPercentile(hist, 99.0) / 1000.0, "us");
+	printRow(benchmark, "max", hist->total, hist->max / 1000.0, "us");
+	printRow(benchmark, "mean", hist->total, (double) hist->sum / hist->total / 1000.0, "us");
+}
+
+/*
+Measure the cost of splitting a command line into arguments (preprocessBuffer() and constructArgv()),
+and the cost with parseCommandList() too.
+
+@param name The name of line
+@param line The command line
+@param iterations The number of times it is parsed
+
+@return void
+*/
+void benchParse(char* name, char* line, long iterations) {
+	int length = strlen(line);
+	struct timespec start, end;
+	// preprocessBuffer() and constructArgv() only
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (long i = 0; i < iterations; i++) {
+		Buffer* buffer = initBuffer(length + 2);
+		memcpy(buffer->string, line, length + 1);
+		buffer = preprocessBuffer(buffer);
+		char** argv = constructArgv(buffer->string);
+		free(argv);
+		freeBuffer(buffer);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printRow("parse_split", name, iterations, nanosBetween(&start, &end) / iterations, "ns/line");
+	// the whole parser (the command cache is not used)
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (long i = 0; i < iterations; i++) {
+		Buffer* buffer = initBuffer(length + 2);
+		memcpy(buffer->string, line, length + 1);
+		buffer = preprocessBuffer(buffer);
+		char** argv = constructArgv(buffer->string);
+		CommandList* list = parseCommandList(argv, NULL);
+		freeCommandList(list);
+		free(argv);
+		freeBuffer(buffer);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printRow("parse_full", name, iterations, nanosBetween(&start, &end) / iterations, "ns/line");
+}
+
+/*
+Measure the latency from fork() to exec() of a foreground command, and the time of the whole command.
+
+@param iterations The number of commands
+
+@return void
+*/
+void benchForkExec(long iterations) {
+	resetShellStat();
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (long i = 0; i < iterations; i++) {
+		runLine("true");
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printPercentiles("fork_to_exec", &shellStat.forkToExec);
+	printRow("command", "true", iterations, nanosBetween(&start, &end) / iterations / 1000.0, "us/command");
+}
+
+/*
+Measure the throughput of a pipeline of $(stages) processes: "head -c SIZE /dev/zero | cat | ... | cat".
+
+@param stages The number of processes
+@param megabytes The size of data
+
+@return void
+*/
+void benchPipeline(int stages, long megabytes) {
+	char line[256];
+	int length = snprintf(line, sizeof(line), "head -c %ld /dev/zero", megabytes * 1024 * 1024);
+	for (int i = 1; i < stages && length < (int) sizeof(line) - 8; i++) {
+		length += snprintf(&line[length], sizeof(line) - length, " | cat");
+	}
+	char metric[32];
+	snprintf(metric, sizeof(metric), "%d_stages", stages);
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	runLine(line);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printRow("pipeline", metric, 1, megabytes / (nanosBetween(&start, &end) / 1e9), "MB/s");
+}
+
+/*
+Measure how fast a storm of background jobs ("true &") are launched and reaped.
+
+@param jobs The number of background jobs
+
+@return void
+*/
+void benchStorm(long jobs) {
+	resetShellStat();
+	unsigned long recorded = completions.head;
+	unsigned long overflow = completions.overflow;
+	struct timespec start, launched, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (long i = 0; i < jobs; i++) {
+		runLine("true &");
+	}
+	clock_gettime(CLOCK_MONOTONIC, &launched);
+	// wait until every job is reaped (at most 60s)
+	struct timespec pause = {0, 1000000};
+	for (int i = 0; i < 60000 && atomic_load(&runningBackground) > 0; i++) {
+		nanosleep(&pause, NULL);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	discardOutput(1);
+	printCompletions();
+	discardOutput(0);
+	printRow("storm", "launch_rate", jobs, jobs / (nanosBetween(&start, &launched) / 1e9), "jobs/s");
+	printRow("storm", "drain_time", jobs, nanosBetween(&launched, &end) / 1e6, "ms");
+	printRow("storm", "reaped", jobs, jobs - atomic_load(&runningBackground), "jobs");
+	printRow("storm", "sigchld", jobs, shellStat.sigchlds, "signals");
+	printRow("storm", "completions", jobs, completions.head - recorded, "records");
+	printRow("storm", "overflowed", jobs, completions.overflow - overflow, "records");
+	printPercentiles("fork_to_reap", &shellStat.forkToReap);
+}
+
+/*
+Measure the heap and RSS that grow with the number of commands run (e.g. task records, command cache).
+
+@param name The name of case
+@param distinct 1 if every command line is different (so it is parsed and cached), 0 if it is repeated
+@param iterations The number of commands
+
+@return void
+*/
+void benchMemory(char* name, int distinct, long iterations) {
+	struct mallinfo2 before = mallinfo2();
+	long rssBefore = 0, rssAfter = 0;
+	FILE* statm = fopen("/proc/self/statm", "r");
+	if (statm != NULL) {
+		if (fscanf(statm, "%*s %ld", &rssBefore) != 1) {
+			rssBefore = 0;
+		}
+		fclose(statm);
+	}
+	char line[64];
+	for (long i = 0; i < iterations; i++) {
+		snprintf(line, sizeof(line), distinct == 1 ? "true %ld" : "true", i);
+		runLine(line);
+	}
+	struct mallinfo2 after = mallinfo2();
+	statm = fopen("/proc/self/statm", "r");
+	if (statm != NULL) {
+		if (fscanf(statm, "%*s %ld", &rssAfter) != 1) {
+			rssAfter = rssBefore;
+		}
+		fclose(statm);
+	}
+	printRow("memory", name, iterations, ((double) after.uordblks - (double) before.uordblks) / iterations, "heap_bytes/command");
+	printRow("memory", name, iterations, (double) (rssAfter - rssBefore) * sysconf(_SC_PAGESIZE) / iterations, "rss_bytes/command");
+}
+
+/*
+Run the microbenchmarks.
+Usage: 3230bench [--version VERSION] [--build BUILD] [--quick] [--header]
+
+@param argc Argument Count
+@param argv Argument Vector
+
+@return status 0 if success, 1 if the arguments are invalid
+*/
+int main(int argc, char* argv[]) {
+	int header = 0;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--version") == 0 && i + 1 < argc) {
+			benchVersion = argv[++i];
+		}
+		else if (strcmp(argv[i], "--build") == 0 && i + 1 < argc) {
+			benchBuild = argv[++i];
+		}
+		else if (strcmp(argv[i], "--quick") == 0) {
+			benchScale = 10;
+		}
+		else if (strcmp(argv[i], "--header") == 0) {
+			header = 1;
+		}
+		else {
+			fprintf(stderr, "usage: %s [--version VERSION] [--build BUILD] [--quick] [--header]\n", argv[0]);
+			return 1;
+		}
+	}
+	taskRecords = (Node**) malloc(sizeof(Node*));
+	(*taskRecords) = NULL;
+	initCompletionRing();
+	regMainSighandler();
+	// the output of commands is not mixed into the CSV
+	setvbuf(stdout, NULL, _IOFBF, 65536);
+	if (header == 1) {
+		printf("version,build,benchmark,metric,iterations,value,unit\n");
+	}
+
+	benchParse("short", "ls -l -a", 200000 / benchScale);
+	benchParse("pipeline", "cat 'a b' \"c d\" | grep -v x | sort -r | uniq -c && echo done ; true &", 100000 / benchScale);
+	benchParse("long", "echo a1 a2 a3 a4 a5 a6 a7 a8 a9 a10 a11 a12 a13 a14 a15 a16 a17 a18 a19 a20 a21 a22 a23 a24 a25 a26 a27 a28 a29 a30 a31 a32 a33 a34 a35 a36 a37 a38 a39 a40 a41 a42 a43 a44 a45 a46 a47 a48 a49 a50 a51 a52 a53 a54 a55 a56 a57 a58 a59 a60", 50000 / benchScale);
+	benchForkExec(2000 / benchScale);
+	for (int stages = 1; stages <= 8; stages *= 2) {
+		benchPipeline(stages, 256 / benchScale);
+	}
+	benchMemory("repeated", 0, 1000 / benchScale);
+	benchMemory("distinct", 1, 1000 / benchScale);
+	benchStorm(10000 / benchScale);
+
+	killAll(taskRecords);
+	freeList(taskRecords);
+	clearCommandCache();
+	return 0;
+}
@@ -6,20 +6,31 @@ Platform:    Linux Debian & Linux Ubuntu
 Description: It contains methods for the self defined structure "Buffer", which is responsible for receiving input and pre-process input.
 Remark:      function implemented in this file:
              1. Process creation and execution – foreground: Should be able to print “$$ 3230shell ##  “ and accept user’s input
+             2. Script mode: read command lines from "-c" string, script file or non-terminal stdin in large blocks
+             3. Here-document: read the bodies of here-documents after the command line
 */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/resource.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <termios.h>
 #include <unistd.h>
 
 #include "buffer.h"
 #include "constant.h"
+#include "editor.h"
+#include "joblog.h"
 #include "linklist.h"
+#include "record.h"
 #include "signals.h"
 #include "task.h"
 
@@ -104,51 +115,501 @@ Buffer* insertBuffer(Buffer* buffer, int pos, char ch) {
 	return buffer;
 }
 
+/*
+Find the end of a quoted string ('...' or "..."), a command substitution ("$(...)") or a process substitution ("<(...)" and ">(...)") that start at $(string[pos]).
+The quotes and substitutions inside a substitution are skipped as a whole, so that "$(echo ')' $(ls))" is one part.
+
+@param string The command line input
+@param pos The position of the opening char (i.e. '\'', '"', or '$', '<' and '>' before '(')
+
+@return end The position of the closing char, or the position of '\0' if it is not closed
+*/
+int skipQuoted(char* string, int pos) {
+	// '...': everything is literal until the next '
+	if (string[pos] == '\'') {
+		int i = pos + 1;
+		while (string[i] != '\0' && string[i] != '\'') {
+			i++;
+		}
+		return i;
+	}
+	// "...": only "$(...)" is special
+	if (string[pos] == '"') {
+		int i = pos + 1;
+		while (string[i] != '\0' && string[i] != '"') {
+			if (string[i] == '$' && string[i+1] == '(') {
+				i = skipQuoted(string, i);
+				if (string[i] == '\0') {
+					return i;
+				}
+			}
+			i++;
+		}
+		return i;
+	}
+	// $(...), <(...) and >(...): find the matching ')'
+	int depth = 0;
+	int i = pos + 2;
+	while (string[i] != '\0') {
+		if (string[i] == '\'' || string[i] == '"' || (string[i] == '$' && string[i+1] == '(')) {
+			i = skipQuoted(string, i);
+			if (string[i] == '\0') {
+				return i;
+			}
+		}
+		else if (string[i] == '(') {
+			depth++;
+		}
+		else if (string[i] == ')') {
+			if (depth == 0) {
+				return i;
+			}
+			depth--;
+		}
+		i++;
+	}
+	return i;
+}
+
 /*
 It convert all white space char into a space.
-It insert space around char "|" and "&"
+It insert space around char "|", "&" and ";", and keep "&&" and "||" together as one operator.
+It also insert space around the redirections ("<<", "<<<", "<", ">", ">>", "<&" and ">&"), a fd number before them is kept (e.g. "2>&1").
+The quoted strings, command substitutions and process substitutions are copied as they are.
+The string is copied once into a buffer that is large enough, instead of inserting the spaces one by one.
 
 @param buffer The pointer to the buffer that need preprocess
 
 @return buffer The pointer to the buffer that finish the preprocess
 */
 Buffer* preprocessBuffer(Buffer* buffer) {
-	for (int i = 0; i < buffer->capacity; i++) {
+	// count the number of spaces to be inserted
+	int length = strlen(buffer->string);
+	int extra = 0;
+	for (int i = 0; i < length; i++) {
 		char ch = buffer->string[i];
+		if (ch == '|' || ch == '&' || ch == ';' || ch == '<' || ch == '>') {
+			extra += 2;
+		}
+	}
+	// nothing to insert, convert the white space in place
+	Buffer* result = buffer;
+	if (extra > 0) {
+		result = initBuffer(length + extra + 2);
+	}
+	int pos = 0;
+	for (int i = 0; i < length; i++) {
+		char ch = buffer->string[i];
+		// copy the quoted string and command substitution as it is
+		if (ch == '\'' || ch == '"' || ((ch == '$' || ch == '<' || ch == '>') && buffer->string[i+1] == '(')) {
+			int end = skipQuoted(buffer->string, i);
+			if (end == length) {
+				end = length - 1;
+			}
+			memmove(&result->string[pos], &buffer->string[i], end - i + 1);
+			pos += end - i + 1;
+			i = end;
+		}
 		// convert all space into white space
-		if (ch == '\v' || ch == '\t' || ch == '\r' || ch == '\n') {
-			buffer->string[i] = ' ';
-			continue;
+		else if (ch == '\v' || ch == '\t' || ch == '\r' || ch == '\n') {
+			result->string[pos++] = ' ';
+		}
+		// insert space around '|', '&', ';', '||' and '&&'
+		else if (ch == '|' || ch == '&' || ch == ';') {
+			result->string[pos++] = ' ';
+			result->string[pos++] = ch;
+			if (ch != ';' && buffer->string[i+1] == ch) {
+				result->string[pos++] = ch;
+				i++;
+			}
+			result->string[pos++] = ' ';
+		}
+		// insert space around the redirections, i.e. '<<', '<<<', '<', '>', '>>', '<&' and '>&'
+		else if (ch == '<' || ch == '>') {
+			// the fd number before the operator stay with it (e.g. "2>&1" -> "2>& 1")
+			int start = pos;
+			while (start > 0 && result->string[start-1] >= '0' && result->string[start-1] <= '9') {
+				start--;
+			}
+			if (start == pos || (start > 0 && result->string[start-1] != ' ')) {
+				result->string[pos++] = ' ';
+			}
+			int count = 0;
+			while (count < (ch == '<' ? 3 : 2) && buffer->string[i] == ch) {
+				result->string[pos++] = buffer->string[i++];
+				count++;
+			}
+			if (count == 1 && buffer->string[i] == '&') {
+				result->string[pos++] = buffer->string[i++];
+			}
+			i--;
+			result->string[pos++] = ' ';
+		}
+		else {
+			result->string[pos++] = ch;
+		}
+	}
+	result->string[pos] = '\0';
+	if (result != buffer) {
+		buffer = freeBuffer(buffer);
+	}
+	return result;
+}
+
+/*
+Open the source of command line input according to the arguments of the shell.
+"3230shell -c CMD" read from the string CMD, "3230shell FILE" read from FILE (by mmap()).
+"3230shell --replay LOG" read LOG like FILE, but the command lines are taken from its records (see record.c).
+Otherwise it read from stdin, and become script mode if stdin is not a terminal.
+"--record LOG" can be put in front of the other arguments.
+
+@param argc Argument Count of the shell
+@param argv Argument Vector of the shell
+
+@return source The pointer to the input source (NULL if the arguments are invalid)
+*/
+InputSource* openInputSource(int argc, char* argv[]) {
+	InputSource* source = (InputSource*) malloc(sizeof(InputSource));
+	memset(source, 0, sizeof(InputSource));
+	source->fd = -1;
+	// 3230shell --record FILE ...: the other arguments are handled as usual
+	if (argc >= 3 && strcmp(argv[1], "--record") == 0) {
+		source->record = argv[2];
+		argv = &argv[2];
+		argc -= 2;
+	}
+	// 3230shell --replay FILE [--speed X]: the log is read as a script
+	if ((argc == 3 || argc == 5) && strcmp(argv[1], "--replay") == 0) {
+		char* end = NULL;
+		source->replay = 1;
+		source->speed = argc == 5 ? strtod(argv[4], &end) : 1;
+		if (argc == 5 && (strcmp(argv[3], "--speed") != 0 || *end != '\0' || end == argv[4] || source->speed < 0)) {
+			printf("3230shell: replay: invalid speed (0 to replay as fast as possible)\n");
+			free(source);
+			return NULL;
+		}
+		argv = &argv[1];
+		argc = 2;
+	}
+	// 3230shell -c CMD
+	if (argc == 3 && strcmp(argv[1], "-c") == 0) {
+		source->data = argv[2];
+		source->length = strlen(argv[2]);
+	}
+	// 3230shell --listen PATH
+	else if (argc == 3 && strcmp(argv[1], "--listen") == 0) {
+		source->listen = argv[2];
+	}
+	// 3230shell FILE
+	else if (argc == 2 && argv[1][0] != '-') {
+		int fd = open(argv[1], O_RDONLY | O_CLOEXEC);
+		struct stat info;
+		if (fd == -1 || fstat(fd, &info) == -1) {
+			char temp[max_length_of_command];
+			snprintf(temp, sizeof(temp), "3230shell: '%s'", argv[1]);
+			perror(temp);
+			if (fd != -1) {
+				close(fd);
+			}
+			free(source);
+			return NULL;
+		}
+		// map the whole script into memory, so that no read() is needed for each line
+		if (info.st_size > 0) {
+			source->data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (source->data == MAP_FAILED) {
+				source->data = NULL;
+			}
+			else {
+				madvise(source->data, info.st_size, MADV_SEQUENTIAL);
+				source->mapped = 1;
+				source->length = info.st_size;
+			}
+		}
+		// fall back to read() if the file cannot be mapped (e.g. it is a pipe)
+		if (source->data == NULL) {
+			source->fd = fd;
 		}
-		// insert space around '|' and '&'
-		if (ch == '|' || ch == '&') {
-			buffer = insertBuffer(buffer, i, ' ');
-			buffer = insertBuffer(buffer, i+2, ' ');
-			i = i+2;
+		else {
+			close(fd);
+		}
+	}
+	// 3230shell
+	else if (argc == 1) {
+		if (isatty(STDIN_FILENO)) {
+			source->interactive = 1;
+			// the line editor need a terminal that understand the escape sequences
+			struct termios setting;
+			char* term = getenv("TERM");
+			source->editor = isatty(STDOUT_FILENO) && tcgetattr(STDIN_FILENO, &setting) == 0 && (term == NULL || strcmp(term, "dumb") != 0);
 		}
+		else {
+			source->fd = STDIN_FILENO;
+		}
+	}
+	else {
+		printf("usage: 3230shell [--record log] [-c command | file | --replay log [--speed X] | --listen socket]\n");
+		free(source);
+		return NULL;
+	}
+	return source;
+}
+
+/*
+Close the source of command line input.
+
+@param source The pointer to the input source
+
+@return NULL to NULL the source.
+*/
+InputSource* closeInputSource(InputSource* source) {
+	if (source->mapped == 1) {
+		munmap(source->data, source->length);
+	}
+	else if (source->capacity > 0) {
+		free(source->data);
+	}
+	if (source->fd > STDIN_FILENO) {
+		close(source->fd);
+	}
+	free(source);
+	return NULL;
+}
+
+/*
+Read the next block of script from $(source->fd) into $(source->data).
+The unused part of previous block is moved to the front first.
+While waiting for the input (e.g. stdin is a pipe), the completions of background processes are printed as they come.
+
+@param source The pointer to the input source
+
+@return count Number of bytes read (0 for end of file)
+*/
+long readInputBlock(InputSource* source) {
+	// allocate the block at the first time
+	if (source->capacity == 0) {
+		source->capacity = script_block_size;
+		source->data = (char*) malloc(source->capacity * sizeof(char));
+	}
+	// move the unused part to the front
+	long remain = source->length - source->pos;
+	memmove(source->data, &source->data[source->pos], remain);
+	source->length = remain;
+	source->pos = 0;
+	// extend the block if a line is longer than it
+	if (source->length == source->capacity) {
+		source->capacity *= 2;
+		source->data = (char*) realloc(source->data, source->capacity * sizeof(char));
+	}
+	// wait for the input, a background process that has finished, or the output of a background job (see joblog.c)
+	struct pollfd fds[3];
+	fds[0].fd = source->fd;
+	fds[0].events = POLLIN;
+	fds[1].fd = completionNotifyFd();
+	fds[1].events = POLLIN;
+	fds[2].events = POLLIN;
+	while (fds[1].fd != -1) {
+		fds[2].fd = jobLogFd();
+		if (poll(fds, 3, -1) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		if ((fds[2].revents & POLLIN) != 0) {
+			drainJobLogs();
+		}
+		if ((fds[1].revents & POLLIN) != 0) {
+			printCompletions();
+		}
+		if (fds[0].revents != 0) {
+			break;
+		}
+	}
+	long count = read(source->fd, &source->data[source->length], source->capacity - source->length);
+	if (count <= 0) {
+		return 0;
+	}
+	source->length += count;
+	return count;
+}
+
+/*
+Make sure the buffer could hold a string of $(length) chars, extend the string in place if necessary.
+
+@param buffer The pointer to the buffer
+@param length The length of string to be held
+
+@return buffer The pointer to the buffer (it is the same buffer)
+*/
+Buffer* reserveBuffer(Buffer* buffer, int length) {
+	if (length + 2 > buffer->capacity) {
+		int capacity = buffer->capacity;
+		while (length + 2 > capacity) {
+			capacity *= 2;
+		}
+		buffer->string = (char*) realloc(buffer->string, capacity * sizeof(char));
+		memset(&buffer->string[buffer->capacity], 0, (capacity - buffer->capacity) * sizeof(char));
+		buffer->capacity = capacity;
 	}
 	return buffer;
 }
 
 /*
-Get at most $(buffer->capacity) chars from the command line.
-The minimum capacity will be 1024.
+Read one line of input into $(buffer->string) starting at $(offset), without the '\10'.
+The buffer is extended when the line is longer than its capacity.
 
 @param buffer The pointer to the buffer that need input.
+@param offset The position in the buffer to hold the line.
+@param source The pointer to the input source.
 
-@return buffer The pointer to the buffer that finish the input.
+@return status 0 if a line is read, -1 if there is no more input.
 */
-int getCommandLineInput(Buffer* buffer) {
-	// allow the user to input $(buffer->capacity - 2) chars
-	// the last 2 char is reserved for '\10' and '\0'
-	fgets((buffer->string), (buffer->capacity), stdin);
-	// change the '\10' to '\0'
-	buffer->string[strlen((buffer->string))-1] = '\0';
+int readLine(Buffer* buffer, int offset, InputSource* source) {
+	// the bodies of here-documents are read after the prompt "> "
+	if (source->editor == 1) {
+		return editLine(buffer, offset, offset == 0 ? "$$ 3230shell ## " : "> ");
+	}
+	if (source->interactive == 1) {
+		int length = offset;
+		buffer->string[length] = '\0';
+		// read until the '\10' is received
+		while (length == offset || buffer->string[length-1] != '\n') {
+			reserveBuffer(buffer, length + max_length_of_command);
+			if (fgets(&buffer->string[length], buffer->capacity - length, stdin) == NULL) {
+				if (length == offset) {
+					return -1;
+				}
+				break;
+			}
+			length += strlen(&buffer->string[length]);
+		}
+		// change the '\10' to '\0'
+		if (buffer->string[length-1] == '\n') {
+			buffer->string[length-1] = '\0';
+		}
+		return 0;
+	}
+	// find the end of next line, read more block if necessary
+	char* end = NULL;
+	while (1) {
+		end = memchr(&source->data[source->pos], '\n', source->length - source->pos);
+		if (end != NULL || source->fd == -1 || readInputBlock(source) == 0) {
+			break;
+		}
+	}
+	long length = (end != NULL ? end - source->data : source->length) - source->pos;
+	// no more line
+	if (end == NULL && length == 0) {
+		return -1;
+	}
+	// copy the line into the buffer
+	reserveBuffer(buffer, offset + length);
+	memcpy(&buffer->string[offset], &source->data[source->pos], length);
+	buffer->string[offset + length] = '\0';
+	source->pos += length + (end != NULL ? 1 : 0);
 	return 0;
 }
 
+/*
+Find the delimiters of here-documents ("<<WORD") in a command line, the quotes of delimiter are removed.
+i.e. "cat <<EOF | tr a-z A-Z; cat <<'END'" -> {"EOF", "END"}
 
+@param string The command line
 
-	
-	
+@return delimiters The NULL terminated delimiters (free each of them and the vector by free())
+*/
+char** hereDocumentDelimiters(char* string) {
+	int count = 0;
+	char** delimiters = (char**) malloc(sizeof(char*));
+	for (int i = 0; string[i] != '\0'; i++) {
+		// skip the quoted string and command substitution
+		if (string[i] == '\'' || string[i] == '"' || (string[i] == '$' && string[i+1] == '(')) {
+			i = skipQuoted(string, i);
+			if (string[i] == '\0') {
+				break;
+			}
+			continue;
+		}
+		// skip here-string "<<<"
+		if (strncmp(&string[i], "<<<", 3) == 0) {
+			i += 2;
+			continue;
+		}
+		if (strncmp(&string[i], "<<", 2) != 0) {
+			continue;
+		}
+		// collect the delimiter
+		i += 2;
+		while (string[i] == ' ' || string[i] == '\t') {
+			i++;
+		}
+		char* delimiter = (char*) malloc((strlen(&string[i]) + 1) * sizeof(char));
+		int length = 0;
+		while (string[i] != '\0' && strchr(" \t|&;<>", string[i]) == NULL) {
+			if (string[i] == '\'' || string[i] == '"') {
+				int end = skipQuoted(string, i);
+				memcpy(&delimiter[length], &string[i+1], end - i - 1);
+				length += end - i - 1;
+				i = string[end] == '\0' ? end : end + 1;
+				continue;
+			}
+			delimiter[length++] = string[i++];
+		}
+		delimiter[length] = '\0';
+		delimiters = (char**) realloc(delimiters, (count + 2) * sizeof(char*));
+		delimiters[count++] = delimiter;
+		i--;
+	}
+	delimiters[count] = NULL;
+	return delimiters;
+}
+
+/*
+Get a command line from the input source, there is no limit on its length.
+In script mode, the line is taken from the block of script in memory, and comment lines ("#...") are skipped.
+If the line has here-documents ("<<WORD"), their bodies are read from the following lines and appended
+to the buffer, i.e. "cat <<EOF\nbody\nEOF".
 
+@param buffer The pointer to the buffer that need input.
+@param source The pointer to the input source.
+
+@return status 0 if a line is read, -1 if there is no more input.
+*/
+int getCommandLineInput(Buffer* buffer, InputSource* source) {
+	// the command line in a session log already has the bodies of here-documents
+	if (source->replay == 1) {
+		return readReplay(buffer, source);
+	}
+	if (readLine(buffer, 0, source) == -1) {
+		return -1;
+	}
+	// skip the blank line and the comment (they may be indented)
+	int first = strspn(buffer->string, " \t");
+	if (source->interactive == 0 && (buffer->string[first] == '\0' || buffer->string[first] == '#')) {
+		buffer->string[0] = '\0';
+		return 0;
+	}
+	// read the bodies of here-documents until their delimiters
+	char** delimiters = hereDocumentDelimiters(buffer->string);
+	for (int i = 0; delimiters[i] != NULL; i++) {
+		while (1) {
+			if (source->interactive == 1) {
+				printf("> ");
+			}
+			int length = strlen(buffer->string);
+			reserveBuffer(buffer, length + 1);
+			buffer->string[length] = '\n';
+			if (readLine(buffer, length + 1, source) == -1) {
+				buffer->string[length] = '\0';
+				break;
+			}
+			if (strcmp(&buffer->string[length + 1], delimiters[i]) == 0) {
+				break;
+			}
+		}
+		free(delimiters[i]);
+	}
+	free(delimiters);
+	return 0;
+}
@@ -16,15 +16,43 @@ typedef struct Buffer {
 	int capacity;
 } Buffer;
 
+// the source of command line input (terminal, "-c" string, script file or non-terminal stdin)
+typedef struct InputSource {
+	int interactive;    // 1 -> print prompt and read line by line, 0 -> script mode
+	int editor;         // 1 -> the line is read by the line editor (the terminal support raw mode)
+	int fd;             // the fd that blocks are read from (-1 if all data is already in memory)
+	int mapped;         // 1 -> $(data) is mmap() from a script file
+	char* data;         // the script text that has not been split into lines yet
+	long length;        // number of valid bytes in $(data)
+	long capacity;      // size of $(data) if it is allocated by malloc()
+	long pos;           // position of the next line in $(data)
+	char* listen;       // the path of unix socket in server mode (NULL otherwise, see server.c)
+	char* record;       // the path of session log (NULL if the session is not recorded, see record.c)
+	int replay;         // 1 -> the script is a session log, its command lines are replayed with the recorded timing
+	double speed;       // the speed of replay (0 -> as fast as possible)
+} InputSource;
+
 Buffer* initBuffer(int capacity);
 
 Buffer* freeBuffer(Buffer* buffer);
 
 Buffer* insertBuffer(Buffer* buffer, int pos, char ch);
 
+Buffer* reserveBuffer(Buffer* buffer, int length);
+
+int skipQuoted(char* string, int pos);
+
 Buffer* preprocessBuffer(Buffer* buffer);
 
-int getCommandLineInput(Buffer* buffer);
+InputSource* openInputSource(int argc, char* argv[]);
+
+InputSource* closeInputSource(InputSource* source);
+
+char** hereDocumentDelimiters(char* string);
+
+int readLine(Buffer* buffer, int offset, InputSource* source);
+
+int getCommandLineInput(Buffer* buffer, InputSource* source);
 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,317 @@
+/*
+FileName:    cache.c
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: A LRU cache that map the raw command line to its parsed command list (including the full path of commands),
+             so that a repeated command line could be executed without parsing again.
+Remark:      function implemented in this file:
+             1. Parsed command cache: ALL
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "ast.h"
+#include "buffer.h"
+#include "cache.h"
+#include "constant.h"
+#include "pathindex.h"
+#include "shellstat.h"
+
+// a global variable that store the counters of the shell since startup
+extern ShellStat shellStat;
+// a global variable that store the source of command line input
+extern InputSource* inputSource;
+
+// the hash table of cache entries (allocated at the first insertion)
+CacheEntry** cacheBuckets = NULL;
+// the most recently used entry
+CacheEntry* cacheHead = NULL;
+// the least recently used entry
+CacheEntry* cacheTail = NULL;
+// number of entries in the cache
+int cacheCount = 0;
+// the value of $PATH when the commands in cache are resolved
+char* cachePath = NULL;
+// the generation of the index of $PATH when the commands in cache are resolved
+unsigned long cacheGeneration = 0;
+
+/*
+Hash a string by FNV-1a.
+
+@param string The string
+
+@return hash The hash value
+*/
+unsigned long hashString(char* string) {
+	unsigned long hash = 14695981039346656037UL;
+	for (int i = 0; string[i] != '\0'; i++) {
+		hash ^= (unsigned char) string[i];
+		hash *= 1099511628211UL;
+	}
+	return hash;
+}
+
+/*
+Find the full path of a command by searching the directories in $PATH (same as execvp()).
+The index of $PATH is used instead of searching the directories if it is exact (see refreshPathIndex()),
+it is built by the interactive shell (or the tab completion) only.
+
+@param name The command without path (e.g. "ls")
+
+@return path The full path (e.g. "/bin/ls", free it by free()), NULL if not found
+*/
+char* resolveCommand(char* name) {
+	char* path = getenv("PATH");
+	if (path == NULL || strchr(name, '/') != NULL || name[0] == '\0') {
+		return NULL;
+	}
+	// a script does not build the index, scanning all directories cost more than searching a few commands
+	int indexed = pathIndexGeneration() != 0 || (inputSource != NULL && inputSource->interactive == 1);
+	if (indexed && refreshPathIndex() == 1) {
+		return lookupPathIndex(name);
+	}
+	char full[max_length_of_command];
+	char* dir = path;
+	while (dir != NULL) {
+		char* end = strchr(dir, ':');
+		int length = end != NULL ? (int) (end - dir) : (int) strlen(dir);
+		// an empty directory means the current directory
+		if (length == 0) {
+			snprintf(full, sizeof(full), "./%s", name);
+		}
+		else {
+			snprintf(full, sizeof(full), "%.*s/%s", length, dir, name);
+		}
+		struct stat info;
+		if (stat(full, &info) == 0 && S_ISREG(info.st_mode) && access(full, X_OK) == 0) {
+			return strdup(full);
+		}
+		dir = end != NULL ? end + 1 : NULL;
+	}
+	return NULL;
+}
+
+/*
+Check whether a command is given its own $PATH (e.g. "PATH=/opt/bin tool"), so it is searched by the child process.
+
+@param stage The command
+
+@return 1 if $PATH is assigned, 0 otherwise
+*/
+int assignsPath(Stage* stage) {
+	for (int i = 0; i < stage->assignmentNum; i++) {
+		if (strncmp(stage->assignments[i], "PATH=", 5) == 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+Replace the command of every stage in the list by its full path.
+The full paths are stored in one block owned by the list.
+
+@param list The command list
+
+@return void
+*/
+void resolveCommandList(CommandList* list) {
+	int stageNum = 0;
+	for (int i = 0; i < list->pipelineNum; i++) {
+		stageNum += list->pipelines[i].stageNum;
+	}
+	// resolve every stage and count the size of the paths
+	char** paths = (char**) malloc((stageNum + 1) * sizeof(char*));
+	int size = 0;
+	for (int i = 0; i < stageNum; i++) {
+		paths[i] = NULL;
+		if (list->stages[i].path != NULL && list->stages[i].expand == 0 && assignsPath(&list->stages[i]) == 0) {
+			paths[i] = resolveCommand(list->stages[i].path);
+		}
+		if (paths[i] != NULL) {
+			size += strlen(paths[i]) + 1;
+		}
+	}
+	// copy the paths into the list
+	list->paths = (char*) malloc((size + 1) * sizeof(char));
+	int pos = 0;
+	for (int i = 0; i < stageNum; i++) {
+		if (paths[i] != NULL) {
+			strcpy(&list->paths[pos], paths[i]);
+			list->stages[i].path = &list->paths[pos];
+			pos += strlen(paths[i]) + 1;
+			free(paths[i]);
+		}
+	}
+	free(paths);
+}
+
+/*
+Remove an entry from the LRU list.
+
+@param entry The entry
+
+@return void
+*/
+void unlinkEntry(CacheEntry* entry) {
+	if (entry->prev != NULL) {
+		entry->prev->next = entry->next;
+	}
+	else {
+		cacheHead = entry->next;
+	}
+	if (entry->next != NULL) {
+		entry->next->prev = entry->prev;
+	}
+	else {
+		cacheTail = entry->prev;
+	}
+	entry->prev = NULL;
+	entry->next = NULL;
+}
+
+/*
+Put an entry to the front (most recently used) of the LRU list.
+
+@param entry The entry
+
+@return void
+*/
+void pushEntry(CacheEntry* entry) {
+	entry->prev = NULL;
+	entry->next = cacheHead;
+	if (cacheHead != NULL) {
+		cacheHead->prev = entry;
+	}
+	cacheHead = entry;
+	if (cacheTail == NULL) {
+		cacheTail = entry;
+	}
+}
+
+/*
+Remove an entry from the cache and free it.
+
+@param entry The entry
+
+@return void
+*/
+void evictEntry(CacheEntry* entry) {
+	// remove it from the bucket
+	CacheEntry** p = &cacheBuckets[entry->hash % command_cache_buckets];
+	while (*p != entry) {
+		p = &(*p)->chain;
+	}
+	*p = entry->chain;
+	// remove it from the LRU list
+	unlinkEntry(entry);
+	freeCommandList(entry->list);
+	free(entry->line);
+	free(entry);
+	cacheCount -= 1;
+}
+
+/*
+Empty the cache (e.g. when $PATH is changed).
+
+@param void
+
+@return void
+*/
+void clearCommandCache(void) {
+	while (cacheHead != NULL) {
+		evictEntry(cacheHead);
+	}
+	free(cachePath);
+	cachePath = NULL;
+}
+
+/*
+Find the parsed command list of a command line.
+The cache is emptied if $PATH or any command in it is changed since the commands are resolved.
+
+@param line The raw command line
+
+@return list The command list (free it by freeCommandList()), NULL if it is not in cache
+*/
+CommandList* lookupCommandCache(char* line) {
+	// the full paths are not valid anymore if $PATH is changed
+	char* path = getenv("PATH");
+	if (cachePath != NULL && (path == NULL || strcmp(path, cachePath) != 0 || pathIndexGeneration() != cacheGeneration)) {
+		clearCommandCache();
+	}
+	if (cacheBuckets == NULL) {
+		shellStat.cacheMisses += 1;
+		return NULL;
+	}
+	unsigned long hash = hashString(line);
+	CacheEntry* entry = cacheBuckets[hash % command_cache_buckets];
+	while (entry != NULL) {
+		if (entry->hash == hash && strcmp(entry->line, line) == 0) {
+			// move the entry to the front
+			unlinkEntry(entry);
+			pushEntry(entry);
+			shellStat.cacheHits += 1;
+			entry->list->refs += 1;
+			return entry->list;
+		}
+		entry = entry->chain;
+	}
+	shellStat.cacheMisses += 1;
+	return NULL;
+}
+
+/*
+Resolve the commands of a parsed command list and put it into the cache.
+The least recently used entry is removed if the cache is full.
+
+@param line The raw command line
+@param list The command list parsed from the line
+
+@return void
+*/
+void insertCommandCache(char* line, CommandList* list) {
+	resolveCommandList(list);
+	// remember the $PATH that the commands are resolved with
+	if (cachePath == NULL) {
+		char* path = getenv("PATH");
+		cachePath = strdup(path != NULL ? path : "");
+		cacheGeneration = pathIndexGeneration();
+	}
+	if (cacheBuckets == NULL) {
+		cacheBuckets = (CacheEntry**) malloc(command_cache_buckets * sizeof(CacheEntry*));
+		memset(cacheBuckets, 0, command_cache_buckets * sizeof(CacheEntry*));
+	}
+	// remove the least recently used entry
+	if (cacheCount >= command_cache_size) {
+		evictEntry(cacheTail);
+	}
+	CacheEntry* entry = (CacheEntry*) malloc(sizeof(CacheEntry));
+	memset(entry, 0, sizeof(CacheEntry));
+	entry->hash = hashString(line);
+	entry->line = strdup(line);
+	entry->list = list;
+	list->refs += 1;
+	// insert it into the bucket and the LRU list
+	entry->chain = cacheBuckets[entry->hash % command_cache_buckets];
+	cacheBuckets[entry->hash % command_cache_buckets] = entry;
+	pushEntry(entry);
+	cacheCount += 1;
+}
+
+/*
+Count the entries in the cache.
+
+@param void
+
+@return count Number of entries
+*/
+int countCommandCache(void) {
+	return cacheCount;
+}
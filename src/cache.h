@@ -0,0 +1,37 @@
+/*
+FileName:    cache.h
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: Hold the function header of cache.c, provide self defined structure.
+Remark:      None of function is implemented in this file.
+*/
+
+#include "ast.h"
+
+#ifndef CACHE_H
+#define CACHE_H
+
+// an entry of the parsed command cache
+typedef struct CacheEntry {
+	unsigned long hash;
+	char* line;                     // the raw command line
+	CommandList* list;              // the parsed command list of the line
+	struct CacheEntry* chain;       // the next entry in the same bucket
+	struct CacheEntry* prev;        // the more recently used entry
+	struct CacheEntry* next;        // the less recently used entry
+} CacheEntry;
+
+unsigned long hashString(char* string);
+
+char* resolveCommand(char* name);
+
+CommandList* lookupCommandCache(char* line);
+
+void insertCommandCache(char* line, CommandList* list);
+
+int countCommandCache(void);
+
+void clearCommandCache(void);
+
+#endif
@@ -0,0 +1,406 @@
+/*
+FileName:    cgroup.c
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: An opt-in mode that put every job into its own cgroup v2 leaf under a delegated directory,
+             so the resource usage of the whole process tree (including the processes that are not waited) is known.
+             The usage is read from cpu.stat, memory.peak and io.stat when the job finish.
+             If no cgroup could be created, the jobs are run as usual and timeX report the usage of wait4() only.
+Remark:      function implemented in this file:
+             1. Built-in command: cgroup: ALL
+             2. Resource accounting of jobs by cgroup v2: ALL
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "cgroup.h"
+#include "constant.h"
+
+// the delegated directory that the leaves are created in (NULL if the mode is off)
+char* cgroupRoot = NULL;
+// the number of leaves created, it is used to name the leaves
+long cgroupCount = 0;
+// the leaves that wait to be removed (their processes are still running, or the usage is not reported yet)
+JobCgroup* pendingCgroups = NULL;
+
+/*
+Read a small file in a directory into a string.
+
+@param dir The directory
+@param name The name of file
+@param output The space to hold the content
+@param size The size of $(output)
+
+@return length The length of content, -1 if it could not be read
+*/
+int readCgroupFile(char* dir, char* name, char* output, int size) {
+	char path[max_length_of_command];
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		return -1;
+	}
+	int length = read(fd, output, size - 1);
+	close(fd);
+	if (length < 0) {
+		return -1;
+	}
+	output[length] = '\0';
+	return length;
+}
+
+/*
+Write a string into a file in a directory.
+
+@param dir The directory
+@param name The name of file
+@param value The string
+
+@return 0 if success, -1 otherwise
+*/
+int writeCgroupFile(char* dir, char* name, char* value) {
+	char path[max_length_of_command];
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	int fd = open(path, O_WRONLY | O_CLOEXEC);
+	if (fd == -1) {
+		return -1;
+	}
+	int result = write(fd, value, strlen(value)) == (long) strlen(value) ? 0 : -1;
+	close(fd);
+	return result;
+}
+
+/*
+Find the cgroup v2 directory of the shell, i.e. the mount point of cgroup2 joined with the path in /proc/self/cgroup.
+
+@param void
+
+@return dir The directory (free it by free()), NULL if cgroup v2 is not mounted
+*/
+char* findOwnCgroup(void) {
+	char mount[max_length_of_command];
+	char line[max_length_of_command];
+	mount[0] = '\0';
+	FILE* file = fopen("/proc/self/mountinfo", "r");
+	if (file == NULL) {
+		return NULL;
+	}
+	// e.g. "42 32 0:38 / /sys/fs/cgroup rw,relatime - cgroup2 cgroup2 rw"
+	while (fgets(line, sizeof(line), file) != NULL) {
+		if (strstr(line, " - cgroup2 ") != NULL && sscanf(line, "%*s %*s %*s %*s %1000s", mount) == 1) {
+			break;
+		}
+		mount[0] = '\0';
+	}
+	fclose(file);
+	if (mount[0] == '\0') {
+		return NULL;
+	}
+	// e.g. "0::/user.slice/user-1000.slice/session-2.scope"
+	char path[max_length_of_command];
+	path[0] = '\0';
+	file = fopen("/proc/self/cgroup", "r");
+	if (file == NULL) {
+		return NULL;
+	}
+	while (fgets(line, sizeof(line), file) != NULL) {
+		if (strncmp(line, "0::", 3) == 0) {
+			line[strcspn(line, "\n")] = '\0';
+			snprintf(path, sizeof(path), "%s", &line[3]);
+			break;
+		}
+	}
+	fclose(file);
+	char* dir = (char*) malloc(strlen(mount) + strlen(path) + 1);
+	sprintf(dir, "%s%s", mount, strcmp(path, "/") == 0 ? "" : path);
+	return dir;
+}
+
+/*
+Create the cgroup leaf of a job, the processes are placed into it by placeInCgroup() before they exec().
+
+@param command The command of job
+
+@return cgroup The leaf (NULL if the mode is off or the leaf could not be created, then the job run without cgroup)
+*/
+JobCgroup* createJobCgroup(char* command) {
+	if (cgroupRoot == NULL) {
+		return NULL;
+	}
+	char path[max_length_of_command];
+	snprintf(path, sizeof(path), "%s/3230shell-%d-%ld", cgroupRoot, getpid(), ++cgroupCount);
+	if (mkdir(path, 0755) == -1) {
+		return NULL;
+	}
+	char procs[max_length_of_command];
+	snprintf(procs, sizeof(procs), "%s/cgroup.procs", path);
+	JobCgroup* cgroup = (JobCgroup*) malloc(sizeof(JobCgroup));
+	memset(cgroup, 0, sizeof(JobCgroup));
+	cgroup->path = strdup(path);
+	cgroup->command = strdup(command);
+	cgroup->procs = open(procs, O_WRONLY | O_CLOEXEC);
+	if (cgroup->procs == -1) {
+		rmdir(path);
+		free(cgroup->path);
+		free(cgroup->command);
+		free(cgroup);
+		return NULL;
+	}
+	return cgroup;
+}
+
+/*
+Move a process into the leaf of its job.
+It is called by the parent after fork() and before the child is allowed to exec(), so no descendant is missed.
+
+@param cgroup The leaf (NULL if the job has no cgroup)
+@param pid The pid of process
+
+@return void
+*/
+void placeInCgroup(JobCgroup* cgroup, pid_t pid) {
+	if (cgroup == NULL || cgroup->procs == -1) {
+		return;
+	}
+	char value[32];
+	int length = snprintf(value, sizeof(value), "%d", pid);
+	if (write(cgroup->procs, value, length) != length) {
+		cgroup->failed = 1;
+	}
+}
+
+/*
+Read the resource usage of a leaf.
+
+@param path The directory of leaf
+@param usage The usage (the unavailable fields are -1)
+
+@return 0 if success, -1 if cpu.stat could not be read
+*/
+int readCgroupUsage(char* path, CgroupUsage* usage) {
+	char content[pipe_data_size];
+	usage->userUsec = -1;
+	usage->systemUsec = -1;
+	usage->memoryPeak = -1;
+	usage->ioRead = -1;
+	usage->ioWrite = -1;
+	// e.g. "usage_usec 1234\nuser_usec 1000\nsystem_usec 234\n..."
+	if (readCgroupFile(path, "cpu.stat", content, sizeof(content)) == -1) {
+		return -1;
+	}
+	for (char* line = strtok(content, "\n"); line != NULL; line = strtok(NULL, "\n")) {
+		sscanf(line, "user_usec %lld", &usage->userUsec);
+		sscanf(line, "system_usec %lld", &usage->systemUsec);
+	}
+	// memory.peak only exist if the memory controller is enabled (Linux 5.19 or later)
+	if (readCgroupFile(path, "memory.peak", content, sizeof(content)) > 0) {
+		usage->memoryPeak = atoll(content);
+	}
+	// e.g. "8:0 rbytes=1024 wbytes=0 rios=1 wios=0 dbytes=0 dios=0\n", one line per device
+	if (readCgroupFile(path, "io.stat", content, sizeof(content)) >= 0) {
+		usage->ioRead = 0;
+		usage->ioWrite = 0;
+		for (char* p = content; (p = strstr(p, "bytes=")) != NULL; p += 6) {
+			if (p - content >= 1 && p[-1] == 'r') {
+				usage->ioRead += atoll(&p[6]);
+			}
+			else if (p - content >= 1 && p[-1] == 'w') {
+				usage->ioWrite += atoll(&p[6]);
+			}
+		}
+	}
+	return 0;
+}
+
+/*
+Format a size in KB, or "n/a" if it is not available.
+
+@param value The size in bytes (-1 if not available)
+@param output The space to hold the string (at least 32 chars)
+
+@return output The string
+*/
+char* formatKilobytes(long long value, char* output) {
+	if (value < 0) {
+		strcpy(output, "n/a");
+	}
+	else {
+		sprintf(output, "%lld KB", value / 1024);
+	}
+	return output;
+}
+
+/*
+Format the usage of the whole job (i.e. all processes in its leaf) as a line of timeX.
+e.g. "(JOB)make    (user)1.234 s  (sys)0.120 s  (memory peak)10240 KB  (io read)0 KB  (io write)16 KB"
+
+@param cgroup The leaf (NULL if the job has no cgroup)
+@param label The label in front of the line (e.g. "(JOB)")
+@param output The space to hold the line
+@param size The size of $(output)
+
+@return length The length of line, 0 if the usage is not available (the job has no cgroup, or a process is not placed)
+*/
+int formatCgroupUsage(JobCgroup* cgroup, char* label, char* output, int size) {
+	CgroupUsage usage;
+	if (cgroup == NULL || cgroup->failed == 1 || readCgroupUsage(cgroup->path, &usage) == -1) {
+		return 0;
+	}
+	char memory[32];
+	char ioRead[32];
+	char ioWrite[32];
+	return snprintf(output, size, "%s%s    (user)%lld.%03lld s  (sys)%lld.%03lld s  (memory peak)%s  (io read)%s  (io write)%s\n",
+		label, cgroup->command, usage.userUsec / 1000000, usage.userUsec / 1000 % 1000, usage.systemUsec / 1000000, usage.systemUsec / 1000 % 1000,
+		formatKilobytes(usage.memoryPeak, memory), formatKilobytes(usage.ioRead, ioRead), formatKilobytes(usage.ioWrite, ioWrite));
+}
+
+/*
+Free a leaf.
+
+@param cgroup The leaf
+
+@return void
+*/
+void freeJobCgroup(JobCgroup* cgroup) {
+	if (cgroup->procs != -1) {
+		close(cgroup->procs);
+	}
+	free(cgroup->path);
+	free(cgroup->command);
+	free(cgroup);
+}
+
+/*
+Release the leaf of a job after all of its processes are started (background) or waited (foreground).
+The leaf is removed if it is empty, otherwise (e.g. a daemon is left, or the job is in background)
+it wait in the pending list until reapJobCgroups() find it empty.
+
+@param cgroup The leaf (NULL if the job has no cgroup)
+@param report 1 to print the usage when the leaf become empty
+
+@return void
+*/
+void releaseJobCgroup(JobCgroup* cgroup, int report) {
+	if (cgroup == NULL) {
+		return;
+	}
+	close(cgroup->procs);
+	cgroup->procs = -1;
+	cgroup->report = report && cgroup->failed == 0;
+	if (cgroup->report == 0 && rmdir(cgroup->path) == 0) {
+		freeJobCgroup(cgroup);
+		return;
+	}
+	cgroup->next = pendingCgroups;
+	pendingCgroups = cgroup;
+}
+
+/*
+Remove the pending leaves that become empty, the usage of background jobs are printed before removal.
+It is called by the main loop before the prompt.
+
+@param void
+
+@return void
+*/
+void reapJobCgroups(void) {
+	JobCgroup** link = &pendingCgroups;
+	while (*link != NULL) {
+		JobCgroup* cgroup = *link;
+		char events[pipe_data_size];
+		// e.g. "populated 0\nfrozen 0\n"
+		if (readCgroupFile(cgroup->path, "cgroup.events", events, sizeof(events)) >= 0 && strstr(events, "populated 1") != NULL) {
+			link = &cgroup->next;
+			continue;
+		}
+		if (cgroup->report == 1) {
+			char line[max_length_of_command];
+			if (formatCgroupUsage(cgroup, "[cgroup] ", line, sizeof(line)) > 0) {
+				printf("%s", line);
+			}
+		}
+		// the leaf could not be removed if it is not empty yet (it is checked again later)
+		if (rmdir(cgroup->path) == -1 && errno == EBUSY) {
+			cgroup->report = 0;
+			link = &cgroup->next;
+			continue;
+		}
+		*link = cgroup->next;
+		freeJobCgroup(cgroup);
+	}
+}
+
+/*
+Detect the errors of the arguments of "cgroup", i.e. "cgroup", "cgroup on [DIR]" or "cgroup off".
+
+@param argv The argument vector
+
+@return 1 if there is error (the message is printed), 0 otherwise
+*/
+int checkCgroupArgs(char** argv) {
+	if (argv[1] == NULL || (strcmp(argv[1], "off") == 0 && argv[2] == NULL)
+		|| (strcmp(argv[1], "on") == 0 && (argv[2] == NULL || argv[3] == NULL))) {
+		return 0;
+	}
+	printf("3230shell: cgroup: usage: cgroup [on [DIR] | off]\n");
+	return 1;
+}
+
+/*
+The built-in command "cgroup".
+"cgroup on [DIR]" put every later job into its own leaf under DIR (the cgroup of shell by default),
+"cgroup off" stop it, and "cgroup" print the state.
+The mode is not turned on if a leaf could not be created in DIR, i.e. it is not a delegated cgroup v2 directory.
+
+@param argv The argument vector (it is checked by checkCgroupArgs())
+
+@return status 0 if success, 1 otherwise
+*/
+int runCgroup(char** argv) {
+	if (argv[1] == NULL) {
+		int pending = 0;
+		for (JobCgroup* cgroup = pendingCgroups; cgroup != NULL; cgroup = cgroup->next) {
+			pending++;
+		}
+		if (cgroupRoot == NULL) {
+			printf("cgroup: off (timeX report the usage of wait4)\n");
+		}
+		else {
+			printf("cgroup: on (%s), %d leaves pending\n", cgroupRoot, pending);
+		}
+		return 0;
+	}
+	free(cgroupRoot);
+	cgroupRoot = NULL;
+	if (strcmp(argv[1], "off") == 0) {
+		return 0;
+	}
+	char* root = argv[2] != NULL ? strdup(argv[2]) : findOwnCgroup();
+	if (root == NULL) {
+		printf("3230shell: cgroup: cgroup v2 is not mounted\n");
+		return 1;
+	}
+	// the controllers are enabled for the leaves if possible (memory.peak and io.stat need them)
+	writeCgroupFile(root, "cgroup.subtree_control", "+cpu");
+	writeCgroupFile(root, "cgroup.subtree_control", "+memory");
+	writeCgroupFile(root, "cgroup.subtree_control", "+io");
+	// try to create a leaf
+	cgroupRoot = root;
+	JobCgroup* probe = createJobCgroup("probe");
+	if (probe == NULL) {
+		printf("3230shell: cgroup: %s: %s, timeX report the usage of wait4\n", root, strerror(errno));
+		free(cgroupRoot);
+		cgroupRoot = NULL;
+		return 1;
+	}
+	releaseJobCgroup(probe, 0);
+	return 0;
+}
@@ -0,0 +1,48 @@
+/*
+FileName:    cgroup.h
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: Hold the function header of cgroup.c, provide self defined structure.
+Remark:      None of function is implemented in this file.
+*/
+
+#include <sys/types.h>
+
+#ifndef CGROUP_H
+#define CGROUP_H
+
+// the cgroup v2 leaf of a job, all processes of the job (and their descendants) are in it
+typedef struct JobCgroup {
+	char* path;                 // the directory of the leaf
+	char* command;              // the command of job (for the report of background job)
+	int procs;                  // the fd of "cgroup.procs" (-1 after all processes are placed)
+	int failed;                 // 1 if a process could not be placed, so the usage is incomplete
+	int report;                 // 1 to report the usage when the leaf become empty
+	struct JobCgroup* next;     // the next leaf that wait to be removed
+} JobCgroup;
+
+// the resource usage of a job read from its cgroup (-1 if it is not available)
+typedef struct CgroupUsage {
+	long long userUsec;         // "user_usec" of cpu.stat
+	long long systemUsec;       // "system_usec" of cpu.stat
+	long long memoryPeak;       // memory.peak in bytes
+	long long ioRead;           // sum of "rbytes" of io.stat
+	long long ioWrite;          // sum of "wbytes" of io.stat
+} CgroupUsage;
+
+JobCgroup* createJobCgroup(char* command);
+
+void placeInCgroup(JobCgroup* cgroup, pid_t pid);
+
+int formatCgroupUsage(JobCgroup* cgroup, char* label, char* output, int size);
+
+void releaseJobCgroup(JobCgroup* cgroup, int report);
+
+void reapJobCgroups(void);
+
+int checkCgroupArgs(char** argv);
+
+int runCgroup(char** argv);
+
+#endif
@@ -13,6 +13,22 @@ Remark:      None of function is implemented in this file.
 // the maximum length of command (reserve 2 extra space for holding '\10' and '\0")
 static const int max_length_of_command = (1024 + 2);
 
+// the size of block that a script is read in (also the size of stdout buffer in script mode)
+static const int script_block_size = 65536;
+
+// the maximum number of command lines in the parsed command cache, and the number of buckets of its hash table
+static const int command_cache_size = 256;
+static const int command_cache_buckets = 509;
+
+// the maximum size of here-document that is passed by pipe (larger one is passed by memfd)
+static const int pipe_data_size = 4096;
+
+// the size of buffer that the entries of a directory are read in by getdents64() (for wildcard expansion)
+static const int directory_batch_size = 262144;
+
+// the maximum size of history file, the older half is removed when it is exceeded
+static const long history_file_limit = 16 * 1024 * 1024;
+
 // the maximum number of arguments (reserve 1 extra space for holding 'NULL' as a end point marker)
 static const int max_num_of_arguments = (30 + 1);
 
@@ -0,0 +1,241 @@
+/*
+FileName:    coproc.c
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: The coprocesses, i.e. "coproc NAME command" start a long-lived background job with a pipe on both ends,
+             so a tool that is slow to start (e.g. loading a model or a dictionary) is started once and used by many later commands:
+                 coproc BC bc -l
+                 echo 'scale=3; 1/7' >&${BC[1]}
+                 head -1 <&${BC[0]}
+             The job is launched by executePipeline() like any background job (it is in the task record, and "Done" is printed when it exit).
+             The shell keep the other ends of pipes (close-on-exec, so only the commands that redirect them get them),
+             their fds are stored in the variables NAME[0] (read the output) and NAME[1] (write the input), and the pid in NAME_PID.
+Remark:      function implemented in this file:
+             1. Built-in command: coproc: ALL (the redirections "<&N" and ">&N" are in redirect.c)
+*/
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "ast.h"
+#include "coproc.h"
+#include "linklist.h"
+#include "task.h"
+#include "variable.h"
+
+// a global variable that store the PIDs and corresponding CMD.
+extern Node** taskRecords;
+// the pid of the last process of the last background job ($!)
+extern pid_t lastBackground;
+
+// a global variable that store the coprocesses, the newest first
+Coproc* coprocs = NULL;
+
+/*
+Set a variable of coprocess (e.g. "BC[1]" or "BC_PID") to a number.
+
+@param name The name of coprocess
+@param suffix The suffix of variable (e.g. "[1]" or "_PID")
+@param number The number (-1 to unset the variable)
+
+@return void
+*/
+void setCoprocVariable(char* name, char* suffix, long number) {
+	char variable[strlen(name) + strlen(suffix) + 1];
+	sprintf(variable, "%s%s", name, suffix);
+	if (number == -1) {
+		unsetVariable(variable);
+		return;
+	}
+	char value[24];
+	snprintf(value, sizeof(value), "%ld", number);
+	setVariable(variable, strlen(variable), value, 0);
+}
+
+/*
+Find a coprocess by its name.
+
+@param name The name
+
+@return coproc The coprocess (NULL if not found)
+*/
+Coproc* findCoproc(char* name) {
+	for (Coproc* coproc = coprocs; coproc != NULL; coproc = coproc->next) {
+		if (strcmp(coproc->name, name) == 0) {
+			return coproc;
+		}
+	}
+	return NULL;
+}
+
+/*
+Close the input of a coprocess, so it see the end of file (its output could still be read).
+
+@param coproc The coprocess
+
+@return void
+*/
+void closeCoprocInput(Coproc* coproc) {
+	if (coproc->writeFd != -1) {
+		close(coproc->writeFd);
+		coproc->writeFd = -1;
+		setCoprocVariable(coproc->name, "[1]", -1);
+	}
+}
+
+/*
+Close both pipes of a coprocess, remove its variables and free it.
+
+@param name The name of coprocess
+
+@return 1 if it is removed, 0 if there is no such coprocess
+*/
+int removeCoproc(char* name) {
+	Coproc** link = &coprocs;
+	while (*link != NULL && strcmp((*link)->name, name) != 0) {
+		link = &(*link)->next;
+	}
+	Coproc* coproc = *link;
+	if (coproc == NULL) {
+		return 0;
+	}
+	*link = coproc->next;
+	closeCoprocInput(coproc);
+	if (coproc->readFd != -1) {
+		close(coproc->readFd);
+	}
+	setCoprocVariable(coproc->name, "[0]", -1);
+	setCoprocVariable(coproc->name, "_PID", -1);
+	free(coproc->name);
+	free(coproc);
+	return 1;
+}
+
+/*
+Start a coprocess (i.e. a pipeline with prefix "coproc NAME").
+The pipeline run in background with its input and output connected to the pipes, a coprocess with the same name is replaced.
+
+@param pipeline The pipeline
+@param status The exit status (1 if it could not be started)
+
+@return output The return value of executePipeline() (1 if the shell should quit)
+*/
+int startCoproc(Pipeline* pipeline, int* status) {
+	// the fds of the old coprocess are reused
+	removeCoproc(pipeline->coproc);
+	// pipes[0]: shell -> coprocess, pipes[1]: coprocess -> shell
+	int pipes[2][2];
+	if (pipe2(pipes[0], O_CLOEXEC) == -1) {
+		perror("3230shell: pipe");
+		*status = 1;
+		return 0;
+	}
+	if (pipe2(pipes[1], O_CLOEXEC) == -1) {
+		perror("3230shell: pipe");
+		close(pipes[0][0]);
+		close(pipes[0][1]);
+		*status = 1;
+		return 0;
+	}
+	// the pipeline is run as a background job that read from and write to the pipes
+	Pipeline run = *pipeline;
+	run.coproc = NULL;
+	run.background = 1;
+	run.input = pipes[0][0];
+	run.capture = pipes[1][1];
+	lastBackground = 0;
+	int output = executePipeline(&run, status);
+	close(pipes[0][0]);
+	close(pipes[1][1]);
+	if (*status != 0 || lastBackground == 0) {
+		close(pipes[0][1]);
+		close(pipes[1][0]);
+		*status = 1;
+		return output;
+	}
+	Coproc* coproc = (Coproc*) malloc(sizeof(Coproc));
+	coproc->name = strdup(pipeline->coproc);
+	coproc->pid = lastBackground;
+	coproc->readFd = pipes[1][0];
+	coproc->writeFd = pipes[0][1];
+	coproc->next = coprocs;
+	coprocs = coproc;
+	setCoprocVariable(coproc->name, "[0]", coproc->readFd);
+	setCoprocVariable(coproc->name, "[1]", coproc->writeFd);
+	setCoprocVariable(coproc->name, "_PID", coproc->pid);
+	return output;
+}
+
+/*
+Detect the errors of the arguments of "coproc" without command,
+i.e. "coproc" (list the coprocesses), "coproc -c NAME" (close its input) or "coproc -d NAME" (close both pipes).
+
+@param argv The argument vector
+
+@return 1 if there is error (the message is printed), 0 otherwise
+*/
+int checkCoprocArgs(char** argv) {
+	if (argv[1] == NULL) {
+		return 0;
+	}
+	if ((strcmp(argv[1], "-c") == 0 || strcmp(argv[1], "-d") == 0) && argv[2] != NULL && argv[3] == NULL) {
+		return 0;
+	}
+	if (argv[2] == NULL && argv[1][0] != '-') {
+		printf("3230shell: \"coproc %s\" need a command to run\n", argv[1]);
+		return 1;
+	}
+	printf("3230shell: coproc: usage: coproc [NAME command | -c NAME | -d NAME]\n");
+	return 1;
+}
+
+/*
+Run the built-in command "coproc" without command (the arguments are checked by checkCoprocArgs()).
+
+@param argv The argument vector
+
+@return status The exit status (1 if there is no such coprocess)
+*/
+int runCoproc(char** argv) {
+	// list the coprocesses
+	if (argv[1] == NULL) {
+		for (Coproc* coproc = coprocs; coproc != NULL; coproc = coproc->next) {
+			Node* node = searchNode(taskRecords, coproc->pid);
+			printf("%s  pid %d  %s  output fd %d  input fd %d\n", coproc->name, coproc->pid, node != NULL && node->done == 1 ? "done" : "running",
+				coproc->readFd, coproc->writeFd);
+		}
+		return 0;
+	}
+	Coproc* coproc = findCoproc(argv[2]);
+	if (coproc == NULL) {
+		printf("3230shell: coproc: '%s': no such coprocess\n", argv[2]);
+		return 1;
+	}
+	if (strcmp(argv[1], "-c") == 0) {
+		closeCoprocInput(coproc);
+	}
+	else {
+		removeCoproc(argv[2]);
+	}
+	return 0;
+}
+
+/*
+Close the pipes of all coprocesses (the processes are killed with the other jobs).
+
+@param void
+
+@return void
+*/
+void freeCoprocs(void) {
+	while (coprocs != NULL) {
+		removeCoproc(coprocs->name);
+	}
+}
@@ -0,0 +1,34 @@
+/*
+FileName:    coproc.h
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: Hold the function header of coproc.c, provide self defined structure.
+Remark:      None of function is implemented in this file.
+*/
+
+#include <sys/types.h>
+
+#include "ast.h"
+
+#ifndef COPROC_H
+#define COPROC_H
+
+// a coprocess started by "coproc NAME command", the shell hold both ends of its pipes
+typedef struct Coproc {
+	char* name;
+	pid_t pid;              // the last process of coprocess ($NAME_PID)
+	int readFd;             // the output of coprocess, read by "<&${NAME[0]}" (-1 if closed)
+	int writeFd;            // the input of coprocess, written by ">&${NAME[1]}" (-1 if closed)
+	struct Coproc* next;
+} Coproc;
+
+int startCoproc(Pipeline* pipeline, int* status);
+
+int checkCoprocArgs(char** argv);
+
+int runCoproc(char** argv);
+
+void freeCoprocs(void);
+
+#endif
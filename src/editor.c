@@ -0,0 +1,637 @@
+/*
+FileName:    editor.c
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: A line editor that read the command line from terminal in raw mode,
+             it support cursor movement, history browsing and tab completion of commands and paths.
+Remark:      function implemented in this file:
+             1. Line editor: ALL
+             2. Tab completion: ALL (the commands in $PATH are listed by pathindex.c)
+*/
+
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "buffer.h"
+#include "constant.h"
+#include "editor.h"
+#include "history.h"
+#include "joblog.h"
+#include "pathindex.h"
+#include "signals.h"
+
+// a global variable that store the command history
+extern History* history;
+
+// the built-in commands that are completed together with the commands in $PATH
+char* builtinCommands[] = {"cgroup", "coproc", "every", "exit", "export", "history", "joblog", "jobtop", "limit", "memo", "shellstat", "timeX", "timeout", "ulimit", "unset", NULL};
+
+/*
+Put the terminal into raw mode, so every key is received immediately without echo.
+The output processing is kept, so '\10' still move the cursor to the start of next line.
+
+@param saved The original setting of terminal, it is restored by disableRawMode()
+
+@return status 0 if success, -1 if the terminal does not support raw mode
+*/
+int enableRawMode(struct termios* saved) {
+	if (tcgetattr(STDIN_FILENO, saved) == -1) {
+		return -1;
+	}
+	struct termios raw = *saved;
+	raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+	raw.c_cflag |= CS8;
+	// Ctrl-C is handled by the editor, as there is no child process to be interrupted
+	raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+	raw.c_cc[VMIN] = 1;
+	raw.c_cc[VTIME] = 0;
+	return tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+}
+
+/*
+Restore the original setting of terminal.
+
+@param saved The original setting of terminal
+
+@return void
+*/
+void disableRawMode(struct termios* saved) {
+	tcsetattr(STDIN_FILENO, TCSANOW, saved);
+}
+
+/*
+Get the width of terminal.
+
+@param void
+
+@return columns Number of columns (80 if it is not known)
+*/
+int terminalColumns(void) {
+	struct winsize size;
+	if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == -1 || size.ws_col == 0) {
+		return 80;
+	}
+	return size.ws_col;
+}
+
+/*
+Write a string to terminal.
+
+@param string The string
+@param length The length of string
+
+@return void
+*/
+void writeTerminal(char* string, int length) {
+	while (length > 0) {
+		int count = write(STDOUT_FILENO, string, length);
+		if (count <= 0 && errno != EINTR) {
+			return;
+		}
+		if (count > 0) {
+			string += count;
+			length -= count;
+		}
+	}
+}
+
+/*
+Draw the prompt and the line again, and move the cursor to its position.
+The line is scrolled horizontally if it is wider than the terminal.
+Everything is written by one write(), so the line does not flicker.
+
+@param editor The line editor
+
+@return void
+*/
+void refreshLine(LineEditor* editor) {
+	char* line = &editor->buffer->string[editor->offset];
+	int promptLength = strlen(editor->prompt);
+	int width = terminalColumns() - promptLength - 1;
+	if (width < 1) {
+		width = 1;
+	}
+	int start = editor->cursor >= width ? editor->cursor - width + 1 : 0;
+	int shown = editor->length - start < width ? editor->length - start : width;
+	Buffer* output = initBuffer(promptLength + shown + 32);
+	int size = sprintf(output->string, "\r%s", editor->prompt);
+	memcpy(&output->string[size], &line[start], shown);
+	size += shown;
+	// clear the rest of the row, then go back to the column of cursor
+	size += sprintf(&output->string[size], "\x1b[0K\r");
+	if (promptLength + editor->cursor - start > 0) {
+		size += sprintf(&output->string[size], "\x1b[%dC", promptLength + editor->cursor - start);
+	}
+	writeTerminal(output->string, size);
+	freeBuffer(output);
+}
+
+/*
+Insert a text at the cursor.
+
+@param editor The line editor
+@param text The text
+@param length The length of text
+
+@return void
+*/
+void insertText(LineEditor* editor, char* text, int length) {
+	reserveBuffer(editor->buffer, editor->offset + editor->length + length);
+	char* line = &editor->buffer->string[editor->offset];
+	memmove(&line[editor->cursor + length], &line[editor->cursor], editor->length - editor->cursor);
+	memcpy(&line[editor->cursor], text, length);
+	editor->length += length;
+	editor->cursor += length;
+	line[editor->length] = '\0';
+}
+
+/*
+Delete the chars in [from, to) of the line, the cursor is moved to $(from).
+
+@param editor The line editor
+@param from The start of chars
+@param to The end of chars
+
+@return void
+*/
+void deleteText(LineEditor* editor, int from, int to) {
+	if (from >= to) {
+		return;
+	}
+	char* line = &editor->buffer->string[editor->offset];
+	memmove(&line[from], &line[to], editor->length - to);
+	editor->length -= to - from;
+	editor->cursor = from;
+	line[editor->length] = '\0';
+}
+
+/*
+Replace the whole line by a text (e.g. a command line in history), the cursor is moved to the end.
+Only the first line of the text is taken (the bodies of here-documents are not editable).
+
+@param editor The line editor
+@param text The text
+
+@return void
+*/
+void replaceLine(LineEditor* editor, char* text) {
+	char* end = strchr(text, '\n');
+	editor->length = 0;
+	editor->cursor = 0;
+	insertText(editor, text, end != NULL ? (int) (end - text) : (int) strlen(text));
+}
+
+/*
+Show the previous (-1) or next (+1) command line in history.
+The new line is kept when the history is browsed, and it is shown again after the last command line.
+
+@param editor The line editor
+@param step -1 for the previous command line, +1 for the next one
+
+@return void
+*/
+void browseHistory(LineEditor* editor, int step) {
+	if (history == NULL) {
+		return;
+	}
+	// the history is counted at the first use, so it is not indexed if it is not browsed
+	long count = countHistory();
+	if (editor->historyPos == 0) {
+		editor->historyPos = count + 1;
+	}
+	long target = editor->historyPos + step;
+	if (target < 1 || target > count + 1) {
+		return;
+	}
+	// keep the new line before leaving it
+	if (editor->historyPos == count + 1) {
+		free(editor->saved);
+		editor->saved = strndup(&editor->buffer->string[editor->offset], editor->length);
+	}
+	editor->historyPos = target;
+	replaceLine(editor, target == count + 1 ? editor->saved : getHistory(target));
+	refreshLine(editor);
+}
+
+/*
+Compare two strings for qsort().
+
+@param a The pointer to the first string
+@param b The pointer to the second string
+
+@return result <0, 0 or >0 as strcmp()
+*/
+int compareNames(const void* a, const void* b) {
+	return strcmp(*(char**) a, *(char**) b);
+}
+
+/*
+Append a name to a NULL terminated vector of names.
+
+@param names The vector
+@param count The number of names in the vector
+@param name The name
+
+@return names The vector (it may be moved)
+*/
+char** appendName(char** names, int* count, char* name) {
+	names = (char**) realloc(names, (*count + 2) * sizeof(char*));
+	names[(*count)++] = name;
+	names[*count] = NULL;
+	return names;
+}
+
+/*
+List the commands that start with a prefix, i.e. the built-in commands and the commands in $PATH.
+
+@param prefix The prefix
+
+@return names The sorted NULL terminated names (free each of them and the vector by free())
+*/
+char** completeCommand(char* prefix) {
+	char** names = completePathIndex(prefix);
+	int count = 0;
+	while (names[count] != NULL) {
+		count++;
+	}
+	for (int i = 0; builtinCommands[i] != NULL; i++) {
+		if (strncmp(builtinCommands[i], prefix, strlen(prefix)) == 0) {
+			names = appendName(names, &count, strdup(builtinCommands[i]));
+		}
+	}
+	qsort(names, count, sizeof(char*), compareNames);
+	// remove the duplicated names (e.g. a built-in command that is also in $PATH)
+	int unique = 0;
+	for (int i = 0; i < count; i++) {
+		if (unique > 0 && strcmp(names[unique-1], names[i]) == 0) {
+			free(names[i]);
+		}
+		else {
+			names[unique++] = names[i];
+		}
+	}
+	names[unique] = NULL;
+	return names;
+}
+
+/*
+List the files that start with a path, a '/' is appended to directory.
+Hidden files are listed only if the name start with '.'.
+
+@param word The path (e.g. "src/bu")
+
+@return names The sorted NULL terminated paths (e.g. {"src/buffer.c", "src/buffer.h"}, free each of them and the vector by free())
+*/
+char** completePath(char* word) {
+	int count = 0;
+	char** names = (char**) malloc(sizeof(char*));
+	names[0] = NULL;
+	char* slash = strrchr(word, '/');
+	int dirLength = slash != NULL ? (int) (slash - word) + 1 : 0;
+	char* base = &word[dirLength];
+	char* dir = dirLength > 0 ? strndup(word, dirLength) : strdup(".");
+	DIR* stream = opendir(dir);
+	if (stream == NULL) {
+		free(dir);
+		return names;
+	}
+	struct dirent* entry = NULL;
+	while ((entry = readdir(stream)) != NULL) {
+		char* name = entry->d_name;
+		if (strncmp(name, base, strlen(base)) != 0 || strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+			continue;
+		}
+		if (name[0] == '.' && base[0] != '.') {
+			continue;
+		}
+		int isDir = entry->d_type == DT_DIR;
+		// the type of the file behind a symbolic link is not known from d_type
+		if (entry->d_type == DT_LNK || entry->d_type == DT_UNKNOWN) {
+			struct stat info;
+			isDir = fstatat(dirfd(stream), name, &info, 0) == 0 && S_ISDIR(info.st_mode);
+		}
+		char* path = (char*) malloc(dirLength + strlen(name) + 2);
+		sprintf(path, "%.*s%s%s", dirLength, word, name, isDir ? "/" : "");
+		names = appendName(names, &count, path);
+	}
+	closedir(stream);
+	free(dir);
+	qsort(names, count, sizeof(char*), compareNames);
+	return names;
+}
+
+/*
+Print the candidates of completion below the line in columns, then draw the line again.
+Only the last component of paths is printed.
+
+@param editor The line editor
+@param names The candidates
+
+@return void
+*/
+void listCandidates(LineEditor* editor, char** names) {
+	int width = 0;
+	int count = 0;
+	for (count = 0; names[count] != NULL; count++) {
+		char* slash = strrchr(names[count], '/');
+		char* name = slash != NULL && slash[1] != '\0' ? slash + 1 : names[count];
+		if ((int) strlen(name) > width) {
+			width = strlen(name);
+		}
+	}
+	width += 2;
+	int columns = terminalColumns() / width > 0 ? terminalColumns() / width : 1;
+	int rows = (count + columns - 1) / columns;
+	writeTerminal("\n", 1);
+	for (int row = 0; row < rows; row++) {
+		for (int column = 0; column < columns && column * rows + row < count; column++) {
+			char* path = names[column * rows + row];
+			// the name of directory is printed with its '/'
+			int length = strlen(path);
+			int start = length - 1;
+			while (start > 0 && path[start-1] != '/') {
+				start--;
+			}
+			printf("%-*s", width, &path[start]);
+		}
+		printf("\n");
+	}
+	fflush(stdout);
+	refreshLine(editor);
+}
+
+/*
+Complete the word before the cursor.
+The first word of a command is completed by the commands, the others (and the word with '/') are completed by the paths.
+The longest common prefix of candidates is inserted, the candidates are listed at the second tab if it is not unique.
+
+@param editor The line editor
+
+@return void
+*/
+void completeLine(LineEditor* editor) {
+	char* line = &editor->buffer->string[editor->offset];
+	int start = editor->cursor;
+	while (start > 0 && strchr(" \t|&;<>()", line[start-1]) == NULL) {
+		start--;
+	}
+	int before = start;
+	while (before > 0 && line[before-1] == ' ') {
+		before--;
+	}
+	int isCommand = before == 0 || strchr("|&;(", line[before-1]) != NULL;
+	char* word = strndup(&line[start], editor->cursor - start);
+	char** names = isCommand && strchr(word, '/') == NULL ? completeCommand(word) : completePath(word);
+	int wordLength = strlen(word);
+	free(word);
+	if (names[0] == NULL) {
+		writeTerminal("\a", 1);
+	}
+	else {
+		// find the longest common prefix of candidates
+		int common = strlen(names[0]);
+		for (int i = 1; names[i] != NULL; i++) {
+			int j = 0;
+			while (j < common && names[i][j] == names[0][j]) {
+				j++;
+			}
+			common = j;
+		}
+		if (common > wordLength) {
+			insertText(editor, &names[0][wordLength], common - wordLength);
+		}
+		// a unique candidate is finished by a space, unless it is a directory
+		if (names[1] == NULL && names[0][common-1] != '/') {
+			insertText(editor, " ", 1);
+		}
+		if (names[1] != NULL && common == wordLength) {
+			if (editor->tabs >= 2) {
+				listCandidates(editor, names);
+			}
+			else {
+				writeTerminal("\a", 1);
+			}
+		}
+		refreshLine(editor);
+	}
+	for (int i = 0; names[i] != NULL; i++) {
+		free(names[i]);
+	}
+	free(names);
+}
+
+/*
+Read the escape sequence of a special key (e.g. arrow keys), the ESC is already read.
+
+@param void
+
+@return key The final char of sequence ('A' up, 'B' down, 'C' right, 'D' left, 'H' home, 'F' end, '3' delete), 0 if unknown
+*/
+char readEscapeSequence(void) {
+	char sequence[3];
+	if (read(STDIN_FILENO, &sequence[0], 1) != 1 || read(STDIN_FILENO, &sequence[1], 1) != 1) {
+		return 0;
+	}
+	if (sequence[0] == '[' && sequence[1] >= '0' && sequence[1] <= '9') {
+		// e.g. "ESC [ 3 ~"
+		if (read(STDIN_FILENO, &sequence[2], 1) != 1 || sequence[2] != '~') {
+			return 0;
+		}
+		switch (sequence[1]) {
+			case '1': case '7': return 'H';
+			case '4': case '8': return 'F';
+			case '3': return '3';
+			default: return 0;
+		}
+	}
+	if (sequence[0] == '[' || sequence[0] == 'O') {
+		return sequence[1];
+	}
+	return 0;
+}
+
+/*
+Read one line from terminal by the line editor, the line is stored at $(buffer->string + offset) without the '\10'.
+The prompt is printed by caller, it is only used to draw the line again.
+
+Keys: Left/Right/Home/End/Ctrl-A/Ctrl-E/Ctrl-B/Ctrl-F move the cursor, Up/Down/Ctrl-P/Ctrl-N browse the history,
+Backspace/Delete/Ctrl-H/Ctrl-D/Ctrl-K/Ctrl-U/Ctrl-W delete chars, Ctrl-L clear the screen, Tab complete the word,
+Ctrl-C discard the line, Ctrl-D at an empty line end the input.
+
+@param buffer The pointer to the buffer that need input.
+@param offset The position in the buffer to hold the line.
+@param prompt The prompt in front of the line.
+
+@return status 0 if a line is read, -1 if there is no more input.
+*/
+int editLine(Buffer* buffer, int offset, char* prompt) {
+	LineEditor editor;
+	memset(&editor, 0, sizeof(LineEditor));
+	editor.buffer = buffer;
+	editor.offset = offset;
+	editor.prompt = prompt;
+	reserveBuffer(buffer, offset);
+	buffer->string[offset] = '\0';
+	struct termios saved;
+	if (enableRawMode(&saved) == -1) {
+		return -1;
+	}
+	int status = 0;
+	int done = 0;
+	struct pollfd fds[3];
+	fds[0].fd = STDIN_FILENO;
+	fds[0].events = POLLIN;
+	fds[1].fd = completionNotifyFd();
+	fds[1].events = POLLIN;
+	fds[2].events = POLLIN;
+	while (done == 0) {
+		// wait for a key, a background process that has finished, or the output of a background job (see joblog.c)
+		fds[2].fd = jobLogFd();
+		fds[0].revents = 0;
+		fds[1].revents = 0;
+		fds[2].revents = 0;
+		if (poll(fds, 3, -1) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+		}
+		// print the completions and the output above the line being typed, then draw the line again
+		else if (((fds[1].revents | fds[2].revents) & POLLIN) != 0 && (fds[0].revents & POLLIN) == 0) {
+			writeTerminal("\r\x1b[0K", 5);
+			drainJobLogs();
+			printCompletions();
+			refreshLine(&editor);
+			continue;
+		}
+		char ch;
+		int count = read(STDIN_FILENO, &ch, 1);
+		if (count == -1 && errno == EINTR) {
+			continue;
+		}
+		if (count <= 0) {
+			status = editor.length == 0 ? -1 : 0;
+			break;
+		}
+		editor.tabs = ch == '\t' ? editor.tabs + 1 : 0;
+		switch (ch) {
+			// Enter
+			case '\r': case '\n':
+				done = 1;
+				break;
+			// Tab
+			case '\t':
+				completeLine(&editor);
+				break;
+			// Ctrl-C: discard the line and show the prompt again
+			case 3:
+				writeTerminal("^C\n", 3);
+				editor.length = 0;
+				editor.cursor = 0;
+				buffer->string[offset] = '\0';
+				editor.historyPos = 0;
+				refreshLine(&editor);
+				break;
+			// Ctrl-D: end of input at an empty line, otherwise delete the char at cursor
+			case 4:
+				if (editor.length == 0) {
+					status = -1;
+					done = 1;
+				}
+				else {
+					deleteText(&editor, editor.cursor, editor.cursor < editor.length ? editor.cursor + 1 : editor.cursor);
+					refreshLine(&editor);
+				}
+				break;
+			// Backspace
+			case 8: case 127:
+				if (editor.cursor > 0) {
+					deleteText(&editor, editor.cursor - 1, editor.cursor);
+					refreshLine(&editor);
+				}
+				break;
+			// Ctrl-A, Ctrl-E, Ctrl-B, Ctrl-F
+			case 1: editor.cursor = 0; refreshLine(&editor); break;
+			case 5: editor.cursor = editor.length; refreshLine(&editor); break;
+			case 2: editor.cursor -= editor.cursor > 0; refreshLine(&editor); break;
+			case 6: editor.cursor += editor.cursor < editor.length; refreshLine(&editor); break;
+			// Ctrl-P, Ctrl-N
+			case 16: browseHistory(&editor, -1); break;
+			case 14: browseHistory(&editor, 1); break;
+			// Ctrl-K: delete until the end of line
+			case 11:
+				buffer->string[offset + editor.cursor] = '\0';
+				editor.length = editor.cursor;
+				refreshLine(&editor);
+				break;
+			// Ctrl-U: delete until the start of line
+			case 21:
+				deleteText(&editor, 0, editor.cursor);
+				refreshLine(&editor);
+				break;
+			// Ctrl-W: delete the word before cursor
+			case 23: {
+				int start = editor.cursor;
+				while (start > 0 && buffer->string[offset + start - 1] == ' ') {
+					start--;
+				}
+				while (start > 0 && buffer->string[offset + start - 1] != ' ') {
+					start--;
+				}
+				deleteText(&editor, start, editor.cursor);
+				refreshLine(&editor);
+				break;
+			}
+			// Ctrl-L: clear the screen
+			case 12:
+				writeTerminal("\x1b[H\x1b[2J", 7);
+				refreshLine(&editor);
+				break;
+			// ESC: special keys
+			case 27:
+				switch (readEscapeSequence()) {
+					case 'A': browseHistory(&editor, -1); break;
+					case 'B': browseHistory(&editor, 1); break;
+					case 'C': editor.cursor += editor.cursor < editor.length; refreshLine(&editor); break;
+					case 'D': editor.cursor -= editor.cursor > 0; refreshLine(&editor); break;
+					case 'H': editor.cursor = 0; refreshLine(&editor); break;
+					case 'F': editor.cursor = editor.length; refreshLine(&editor); break;
+					case '3':
+						if (editor.cursor < editor.length) {
+							deleteText(&editor, editor.cursor, editor.cursor + 1);
+							refreshLine(&editor);
+						}
+						break;
+				}
+				break;
+			default:
+				// ignore the other control chars
+				if ((unsigned char) ch >= 32) {
+					insertText(&editor, &ch, 1);
+					// redraw only if the char is not appended at the end
+					if (editor.cursor == editor.length && (int) strlen(prompt) + editor.length < terminalColumns()) {
+						writeTerminal(&ch, 1);
+					}
+					else {
+						refreshLine(&editor);
+					}
+				}
+				break;
+		}
+	}
+	disableRawMode(&saved);
+	if (status == 0) {
+		writeTerminal("\n", 1);
+	}
+	free(editor.saved);
+	return status;
+}
@@ -0,0 +1,29 @@
+/*
+FileName:    editor.h
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: Hold the function header of editor.c, provide self defined structure.
+Remark:      None of function is implemented in this file.
+*/
+
+#include "buffer.h"
+
+#ifndef EDITOR_H
+#define EDITOR_H
+
+// the state of the line that is being edited
+typedef struct LineEditor {
+	Buffer* buffer;     // the buffer that hold the line
+	int offset;         // position of the line in $(buffer->string)
+	int length;         // length of the line
+	int cursor;         // position of cursor in the line
+	char* prompt;       // the prompt in front of the line
+	long historyPos;    // number of the history entry shown (count + 1 for the new line, 0 if the history is not browsed yet)
+	char* saved;        // the new line that is kept while browsing the history
+	int tabs;           // number of consecutive tabs
+} LineEditor;
+
+int editLine(Buffer* buffer, int offset, char* prompt);
+
+#endif
@@ -0,0 +1,206 @@
+/*
+FileName:    every.c
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: The prefix "every INTERVAL [-n COUNT] [-c] pipeline" that run a pipeline periodically inside the shell,
+             so there is no extra process for "watch" or "sleep" in each run.
+             The same parsed pipeline is launched on the ticks of a periodic timerfd, the ticks are anchored to the first run,
+             so the schedule does not drift, and the ticks missed by a slow run are skipped instead of run in a burst.
+             With "-c", the output is captured in a memfd and only printed when it is different from the previous run.
+Remark:      function implemented in this file:
+             1. Prefix "every" of pipeline: ALL (the pipeline is launched by executePipeline() in task.c)
+*/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/timerfd.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "ast.h"
+#include "every.h"
+#include "task.h"
+#include "watchdog.h"
+
+// 1 if the runs are interrupted by Ctrl-C
+volatile sig_atomic_t everyInterrupted = 0;
+
+/*
+Handler of SIGINT while waiting for the next run.
+It stop the runs instead of printing a new prompt.
+
+@param signum Signal Number
+
+@return void
+*/
+void everySighandler(int signum) {
+	everyInterrupted = 1;
+}
+
+/*
+Parse the prefix "every INTERVAL [-n COUNT] [-c]" at the beginning of a pipeline.
+
+@param tokens The tokens start with "every"
+@param pipeline The pipeline to hold the settings
+
+@return consumed The number of tokens after "every" that are taken (-1 if they are invalid, the message is printed)
+*/
+int parseEvery(char** tokens, Pipeline* pipeline) {
+	if (tokens[1] == NULL) {
+		printf("3230shell: every: usage: every INTERVAL [-n COUNT] [-c] command\n");
+		return -1;
+	}
+	if (parseDuration(tokens[1], &pipeline->every) != 0) {
+		printf("3230shell: every: invalid interval '%s'\n", tokens[1]);
+		return -1;
+	}
+	int consumed = 1;
+	while (tokens[consumed + 1] != NULL) {
+		char* option = tokens[consumed + 1];
+		if (strcmp(option, "-c") == 0) {
+			pipeline->everyChanges = 1;
+			consumed += 1;
+		}
+		else if (strcmp(option, "-n") == 0) {
+			char* count = tokens[consumed + 2];
+			char* end = NULL;
+			errno = 0;
+			pipeline->everyCount = count != NULL ? strtol(count, &end, 10) : 0;
+			if (count == NULL || errno != 0 || *end != '\0' || end == count || pipeline->everyCount <= 0) {
+				printf("3230shell: every: invalid count '%s'\n", count != NULL ? count : "");
+				return -1;
+			}
+			consumed += 2;
+		}
+		else {
+			break;
+		}
+	}
+	return consumed;
+}
+
+/*
+Read the output that is captured in a memory file.
+
+@param fd The memory file
+@param size The space to hold the size of output
+
+@return output The output (free it by free())
+*/
+char* readCaptured(int fd, long* size) {
+	long length = lseek(fd, 0, SEEK_END);
+	char* output = (char*) malloc((length > 0 ? length : 0) + 1);
+	long done = 0;
+	while (done < length) {
+		long count = pread(fd, &output[done], length - done, done);
+		if (count <= 0) {
+			break;
+		}
+		done += count;
+	}
+	output[done] = '\0';
+	*size = done;
+	return output;
+}
+
+/*
+Run a pipeline with the prefix "every" until COUNT runs are done, Ctrl-C is pressed, or "exit" is run.
+
+@param pipeline The pipeline (it is not modified, the runs use a copy without "every")
+@param status The space to hold the exit status of the last run
+
+@return output The status code of exit, if 1, then quit main process.
+*/
+int runEvery(Pipeline* pipeline, int* status) {
+	Pipeline run = *pipeline;
+	run.every = 0;
+	// the periodic timer, the first run start immediately
+	int timer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (timer == -1) {
+		perror("3230shell: every");
+		*status = 1;
+		return 0;
+	}
+	struct itimerspec spec;
+	spec.it_interval.tv_sec = (time_t) pipeline->every;
+	spec.it_interval.tv_nsec = (long) ((pipeline->every - (time_t) pipeline->every) * 1e9);
+	spec.it_value = spec.it_interval;
+	// the output of each run is captured to compare with the previous one
+	char* previous = NULL;
+	long previousSize = -1;
+	if (pipeline->everyChanges == 1) {
+		run.capture = memfd_create("3230shell-every", MFD_CLOEXEC);
+		if (run.capture == -1) {
+			perror("3230shell: memfd_create");
+			close(timer);
+			*status = 1;
+			return 0;
+		}
+	}
+	// Ctrl-C stop the runs (the child processes of a run are terminated by it too)
+	struct sigaction saved;
+	struct sigaction sa_int = {0};
+	sa_int.sa_handler = &everySighandler;
+	everyInterrupted = 0;
+	sigaction(SIGINT, &sa_int, &saved);
+
+	int output = 0;
+	timerfd_settime(timer, 0, &spec, NULL);
+	for (long count = 0; pipeline->everyCount == 0 || count < pipeline->everyCount; count++) {
+		if (count > 0) {
+			// the number of ticks since the last read, the ticks missed by a slow run are skipped
+			uint64_t ticks = 0;
+			while (everyInterrupted == 0 && read(timer, &ticks, sizeof(ticks)) == -1 && errno == EINTR) {
+				continue;
+			}
+		}
+		if (everyInterrupted == 1) {
+			break;
+		}
+		if (run.capture > 0) {
+			ftruncate(run.capture, 0);
+			lseek(run.capture, 0, SEEK_SET);
+		}
+		output = executePipeline(&run, status);
+		// the handlers of child process are registered while launching, so the handler is set again
+		sigaction(SIGINT, &sa_int, NULL);
+		fflush(stdout);
+		if (run.capture > 0) {
+			long size = 0;
+			char* current = readCaptured(run.capture, &size);
+			if (size != previousSize || memcmp(current, previous, size) != 0) {
+				fwrite(current, 1, size, stdout);
+				fflush(stdout);
+				free(previous);
+				previous = current;
+				previousSize = size;
+			}
+			else {
+				free(current);
+			}
+		}
+		// stop if a run is interrupted by Ctrl-C, or "exit" is run
+		if (output == 1 || *status == 128 + SIGINT) {
+			break;
+		}
+	}
+	if (everyInterrupted == 1) {
+		printf("\n");
+	}
+	sigaction(SIGINT, &saved, NULL);
+	if (run.capture > 0) {
+		close(run.capture);
+	}
+	free(previous);
+	close(timer);
+	return output;
+}
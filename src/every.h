@@ -0,0 +1,19 @@
+/*
+FileName:    every.h
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: Hold the function header of every.c.
+Remark:      None of function is implemented in this file.
+*/
+
+#include "ast.h"
+
+#ifndef EVERY_H
+#define EVERY_H
+
+int parseEvery(char** tokens, Pipeline* pipeline);
+
+int runEvery(Pipeline* pipeline, int* status);
+
+#endif
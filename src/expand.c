@@ -0,0 +1,530 @@
+/*
+FileName:    expand.c
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: It expand the arguments just before execution, i.e. run the command substitutions ("$(...)"), replace the variables ("$NAME") and remove the quotes.
+             The expansion is done when the command is run instead of parsing, so a cached command list always see the current variables
+             (e.g. "A=1; echo $A").
+Remark:      function implemented in this file:
+             1. Command substitution: ALL
+             2. Quoting ('...' and "..."): ALL
+             3. Expansion of here-document and here-string
+             4. Wildcard expansion of the arguments (the matching is done by wildcard.c)
+             5. Expansion of variables: "$NAME", "${NAME}", "$?" and "$$" (the variables are kept by variable.c)
+             6. Process substitution: "<(...)" and ">(...)" are replaced by "/dev/fd/N" (the commands are run by procsub.c)
+*/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "buffer.h"
+#include "constant.h"
+#include "expand.h"
+#include "joblog.h"
+#include "procsub.h"
+#include "task.h"
+#include "variable.h"
+#include "wildcard.h"
+
+// the exit status of the last foreground pipeline
+extern int lastStatus;
+// 1 in a forked shell of "$(...)", "<(...)" or ">(...)"
+extern int subshell;
+// the pid of the last process of the last background job ($!)
+extern pid_t lastBackground;
+
+// a growing vector of fields produced by expanding the arguments
+typedef struct Fields {
+	char** words;       // NULL terminated vector of fields
+	int count;          // number of fields
+	int capacity;       // capacity of $(words)
+	Buffer* current;    // the field that is being built
+	int length;         // length of $(current)
+	int started;        // 1 if $(current) should be kept even it is empty (e.g. "")
+	int split;          // 1 if the output of unquoted substitution is split into fields
+	int quotes;         // 1 if the quotes are special, 0 if they are literal (e.g. body of here-document)
+	Buffer* pattern;    // $(current) with the quoted special chars escaped by '\' (NULL if wildcards are not expanded)
+	int patternLength;  // length of $(pattern)
+	int wildcard;       // 1 if $(current) has an unquoted wildcard
+	int process;        // 1 if "<(...)" and ">(...)" are replaced by the paths of their pipes
+} Fields;
+
+/*
+Get the length of the parameter that start at $(word[pos]) (i.e. the '$'), e.g. "$HOME", "${HOME}", "${BC[1]}", "$?", "$$" and "$!".
+
+@param word The argument
+@param pos The position of '$'
+
+@return length The length of parameter including '$', 0 if it is not a parameter (e.g. the '$' of "grep c$")
+*/
+int parameterLength(char* word, int pos) {
+	char* name = &word[pos + 1];
+	if (*name == '?' || *name == '$' || *name == '!') {
+		return 2;
+	}
+	if (*name == '{') {
+		int length = nameLengthOf(name + 1);
+		// the fds of coprocess, e.g. "${BC[0]}"
+		if (length > 0 && name[length + 1] == '[') {
+			int digits = strspn(&name[length + 2], "0123456789");
+			if (digits > 0 && name[length + 2 + digits] == ']') {
+				length += digits + 2;
+			}
+		}
+		return length > 0 && name[length + 1] == '}' ? length + 3 : 0;
+	}
+	int length = nameLengthOf(name);
+	return length > 0 ? length + 1 : 0;
+}
+
+/*
+Check whether a text has command substitution ("$(") or parameter (e.g. "$HOME").
+
+@param text The text
+
+@return 1 if it need substitution, 0 otherwise
+*/
+int needsSubstitution(char* text) {
+	for (char* dollar = strchr(text, '$'); dollar != NULL; dollar = strchr(dollar + 1, '$')) {
+		if (dollar[1] == '(' || parameterLength(dollar, 0) > 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+Check whether an argument need to be expanded before execution.
+
+@param word The argument
+
+@return 1 if it contains quote, "$(", parameter, wildcard or process substitution, 0 otherwise
+*/
+int needsExpansion(char* word) {
+	return strpbrk(word, "'\"*?[") != NULL || needsSubstitution(word) || strstr(word, "<(") != NULL || strstr(word, ">(") != NULL;
+}
+
+/*
+Run a command line by startTasks() in a forked shell, and capture its standard output in memory.
+The forked shell has its own copy of the variables, limits and coprocesses, so "$(A=1)" or "$(exit)" does not change the shell.
+The output is written into an anonymous memory file (memfd), so there is no temporary file on disk
+and the size of output is only limited by memory. $? is set to the exit status of the command line.
+
+@param line The command line (e.g. "ls | wc -l")
+@param size The size of output
+
+@return output The output (free it by free()), NULL if it fail to capture
+*/
+char* captureOutput(char* line, long* size) {
+	*size = 0;
+	int fd = memfd_create("3230shell-subst", MFD_CLOEXEC);
+	if (fd == -1) {
+		perror("3230shell: memfd_create");
+		return NULL;
+	}
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid == -1) {
+		perror("3230shell: fork");
+		close(fd);
+		return NULL;
+	}
+	if (pid == 0) {
+		// the standard output of the forked shell (and its child processes) is the memory file
+		dup2(fd, STDOUT_FILENO);
+		close(fd);
+		// the pipes of process substitutions are held by the shell only
+		dropSubstitutions();
+		subshell = 1;
+		startTasks(line);
+		fflush(stdout);
+		_exit(lastStatus);
+	}
+	// wait for the forked shell (the output of background jobs is read meanwhile)
+	int status = 0;
+	waitDrainingJobLogs(pid);
+	while (waitpid(pid, &status, 0) == -1 && errno == EINTR) {
+		continue;
+	}
+	lastStatus = exitStatusOf(status);
+	// copy the output into a string
+	long length = lseek(fd, 0, SEEK_END);
+	char* output = (char*) malloc((length > 0 ? length : 0) + 1);
+	long done = 0;
+	while (done < length) {
+		long count = pread(fd, &output[done], length - done, done);
+		if (count <= 0) {
+			break;
+		}
+		done += count;
+	}
+	output[done] = '\0';
+	close(fd);
+	*size = done;
+	return output;
+}
+
+/*
+Append a char to the field that is being built.
+The char is also appended to the pattern of wildcard expansion, it is escaped by '\\' if it is quoted.
+
+@param fields The fields
+@param ch The char
+@param quoted 1 if the char is quoted, so it is not a wildcard
+
+@return void
+*/
+void appendChar(Fields* fields, char ch, int quoted) {
+	reserveBuffer(fields->current, fields->length + 1);
+	fields->current->string[fields->length++] = ch;
+	fields->current->string[fields->length] = '\0';
+	fields->started = 1;
+	if (fields->pattern == NULL) {
+		return;
+	}
+	reserveBuffer(fields->pattern, fields->patternLength + 2);
+	if (strchr("*?[]\\", ch) != NULL && (quoted == 1 || ch == '\\')) {
+		fields->pattern->string[fields->patternLength++] = '\\';
+	}
+	else if (strchr("*?[", ch) != NULL) {
+		fields->wildcard = 1;
+	}
+	fields->pattern->string[fields->patternLength++] = ch;
+	fields->pattern->string[fields->patternLength] = '\0';
+}
+
+/*
+Append a finished field to the vector.
+
+@param fields The fields
+@param word The field (it is owned by the vector)
+
+@return void
+*/
+void appendField(Fields* fields, char* word) {
+	if (fields->count + 1 >= fields->capacity) {
+		fields->capacity *= 2;
+		fields->words = (char**) realloc(fields->words, fields->capacity * sizeof(char*));
+	}
+	fields->words[fields->count++] = word;
+	fields->words[fields->count] = NULL;
+}
+
+/*
+Finish the field that is being built and append it to the vector.
+Empty field is dropped unless it is quoted (e.g. "").
+A field with unquoted wildcard is replaced by the matching paths, it is kept as it is if nothing match.
+
+@param fields The fields
+
+@return void
+*/
+void endField(Fields* fields) {
+	char** paths = fields->wildcard == 1 ? expandWildcard(fields->pattern->string) : NULL;
+	if (paths != NULL) {
+		for (int i = 0; paths[i] != NULL; i++) {
+			appendField(fields, paths[i]);
+		}
+		free(paths);
+	}
+	else if (fields->started == 1) {
+		appendField(fields, strdup(fields->current->string));
+	}
+	fields->length = 0;
+	fields->current->string[0] = '\0';
+	fields->started = 0;
+	if (fields->pattern != NULL) {
+		fields->patternLength = 0;
+		fields->pattern->string[0] = '\0';
+		fields->wildcard = 0;
+	}
+}
+
+/*
+Append the result of a substitution to the fields.
+Unquoted result is split by white space, i.e. "a$(echo 'b c')d" -> {"ab", "cd"}.
+
+@param fields The fields
+@param text The result
+@param size The size of result
+@param quoted 1 if the substitution is inside "...", the result is not split
+
+@return void
+*/
+void appendResult(Fields* fields, char* text, long size, int quoted) {
+	for (long i = 0; i < size; i++) {
+		char ch = text[i];
+		if (quoted == 0 && fields->split == 1 && (ch == ' ' || ch == '\t' || ch == '\n')) {
+			endField(fields);
+		}
+		else {
+			appendChar(fields, ch, quoted);
+		}
+	}
+}
+
+/*
+Run a command substitution and append its output to the fields.
+The trailing newlines are removed.
+
+@param fields The fields
+@param line The command line inside "$(...)"
+@param quoted 1 if the substitution is inside "...", the output is not split
+
+@return void
+*/
+void substitute(Fields* fields, char* line, int quoted) {
+	long size = 0;
+	char* output = captureOutput(line, &size);
+	if (output == NULL) {
+		return;
+	}
+	while (size > 0 && output[size-1] == '\n') {
+		size--;
+	}
+	appendResult(fields, output, size, quoted);
+	free(output);
+}
+
+/*
+Replace the parameter that start at $(word[pos]) by its value, an unset variable is replaced by nothing.
+
+@param fields The fields
+@param word The argument
+@param pos The position of '$'
+@param quoted 1 if the parameter is inside "..."
+
+@return end The position of the last char of parameter
+*/
+int expandParameter(Fields* fields, char* word, int pos, int quoted) {
+	int length = parameterLength(word, pos);
+	char number[24];
+	char* value = NULL;
+	if (word[pos+1] == '?') {
+		snprintf(number, sizeof(number), "%d", lastStatus);
+		value = number;
+	}
+	else if (word[pos+1] == '$') {
+		snprintf(number, sizeof(number), "%d", (int) getpid());
+		value = number;
+	}
+	else if (word[pos+1] == '!') {
+		snprintf(number, sizeof(number), "%d", (int) lastBackground);
+		value = lastBackground != 0 ? number : NULL;
+	}
+	else if (word[pos+1] == '{') {
+		value = getVariable(&word[pos+2], length - 3);
+	}
+	else {
+		value = getVariable(&word[pos+1], length - 1);
+	}
+	if (value != NULL) {
+		appendResult(fields, value, strlen(value), quoted);
+	}
+	return pos + length - 1;
+}
+
+/*
+Run the command substitution that start at $(word[pos]) (i.e. the '$' of "$(").
+
+@param fields The fields
+@param word The argument
+@param pos The position of '$'
+@param quoted 1 if the substitution is inside "..."
+
+@return end The position of the closing ')'
+*/
+int expandSubstitution(Fields* fields, char* word, int pos, int quoted) {
+	int end = skipQuoted(word, pos);
+	char* line = strndup(&word[pos+2], end - pos - 2);
+	substitute(fields, line, quoted);
+	free(line);
+	return end;
+}
+
+/*
+Start the process substitution that start at $(word[pos]) (i.e. the '<' of "<(" or the '>' of ">("),
+and append the path of its pipe (e.g. "/dev/fd/63").
+
+@param fields The fields
+@param word The argument
+@param pos The position of '<' or '>'
+
+@return end The position of the closing ')'
+*/
+int expandProcess(Fields* fields, char* word, int pos) {
+	int end = skipQuoted(word, pos);
+	char* line = strndup(&word[pos+2], end - pos - 2);
+	int fd = startSubstitution(line, word[pos] == '>');
+	free(line);
+	if (fd == -1) {
+		return end;
+	}
+	char path[32];
+	snprintf(path, sizeof(path), "/dev/fd/%d", fd);
+	for (int i = 0; path[i] != '\0'; i++) {
+		appendChar(fields, path[i], 1);
+	}
+	return end;
+}
+
+/*
+Expand one argument into the fields.
+
+@param fields The fields
+@param word The argument
+
+@return void
+*/
+void expandWord(Fields* fields, char* word) {
+	for (int j = 0; word[j] != '\0'; j++) {
+		// '...': copy literally
+		if (fields->quotes == 1 && word[j] == '\'') {
+			int end = skipQuoted(word, j);
+			fields->started = 1;
+			for (int k = j + 1; k < end; k++) {
+				appendChar(fields, word[k], 1);
+			}
+			j = word[end] == '\0' ? end - 1 : end;
+		}
+		// "...": copy literally except "$(...)" and parameters
+		else if (fields->quotes == 1 && word[j] == '"') {
+			int end = skipQuoted(word, j);
+			fields->started = 1;
+			for (int k = j + 1; k < end; k++) {
+				if (word[k] == '$' && word[k+1] == '(') {
+					k = expandSubstitution(fields, word, k, 1);
+				}
+				else if (word[k] == '$' && parameterLength(word, k) > 0) {
+					k = expandParameter(fields, word, k, 1);
+				}
+				else {
+					appendChar(fields, word[k], 1);
+				}
+			}
+			j = word[end] == '\0' ? end - 1 : end;
+		}
+		// $(...)
+		else if (word[j] == '$' && word[j+1] == '(') {
+			int end = expandSubstitution(fields, word, j, 0);
+			j = word[end] == '\0' ? end - 1 : end;
+		}
+		// $NAME, ${NAME}, $? and $$
+		else if (word[j] == '$' && parameterLength(word, j) > 0) {
+			j = expandParameter(fields, word, j, 0);
+		}
+		// <(...) and >(...), only in the arguments of command and the files of redirections
+		else if (fields->process == 1 && (word[j] == '<' || word[j] == '>') && word[j+1] == '(') {
+			int end = expandProcess(fields, word, j);
+			j = word[end] == '\0' ? end - 1 : end;
+		}
+		else {
+			appendChar(fields, word[j], 0);
+		}
+	}
+}
+
+/*
+Initialize the fields.
+
+@param fields The fields
+@param split 1 if the output of unquoted substitution is split into fields, and the wildcards are expanded
+@param quotes 1 if the quotes are special
+
+@return void
+*/
+void initFields(Fields* fields, int split, int quotes) {
+	memset(fields, 0, sizeof(Fields));
+	fields->capacity = max_num_of_arguments;
+	fields->words = (char**) malloc(fields->capacity * sizeof(char*));
+	fields->words[0] = NULL;
+	fields->current = initBuffer(-1);
+	fields->split = split;
+	fields->quotes = quotes;
+	fields->process = split;
+	if (split == 1) {
+		fields->pattern = initBuffer(-1);
+	}
+}
+
+/*
+Expand the arguments, i.e. run the command substitutions, remove the quotes and expand the wildcards.
+e.g. {"echo", "'a b'", "$(ls)", "*.h"} -> {"echo", "a b", "file1", "file2", "ast.h", "buffer.h"}
+
+@param words The NULL terminated arguments
+
+@return fields The expanded arguments (free it by freeWords())
+*/
+char** expandWords(char** words) {
+	Fields fields;
+	initFields(&fields, 1, 1);
+	for (int i = 0; words[i] != NULL; i++) {
+		expandWord(&fields, words[i]);
+		endField(&fields);
+	}
+	fields.current = freeBuffer(fields.current);
+	fields.pattern = freeBuffer(fields.pattern);
+	return fields.words;
+}
+
+/*
+Expand a text as one string (i.e. the output of substitution is not split).
+It is used by here-string (quotes are removed) and here-document (quotes are literal).
+
+@param text The text
+@param quotes 1 if the quotes are special and removed, 0 if they are literal
+
+@return string The expanded text (free it by free())
+*/
+char* expandText(char* text, int quotes) {
+	Fields fields;
+	initFields(&fields, 0, quotes);
+	expandWord(&fields, text);
+	char* result = strdup(fields.current->string);
+	fields.current = freeBuffer(fields.current);
+	fields.words = freeWords(fields.words);
+	return result;
+}
+
+/*
+Expand the file of a redirection as one string, the process substitution is expanded too (e.g. "> >(gzip > log.gz)").
+
+@param word The file
+
+@return path The expanded path (free it by free())
+*/
+char* expandPath(char* word) {
+	Fields fields;
+	initFields(&fields, 0, 1);
+	fields.process = 1;
+	expandWord(&fields, word);
+	char* result = strdup(fields.current->string);
+	fields.current = freeBuffer(fields.current);
+	fields.words = freeWords(fields.words);
+	return result;
+}
+
+/*
+Free the arguments returned by expandWords().
+
+@param words The arguments
+
+@return NULL to NULL the arguments
+*/
+char** freeWords(char** words) {
+	for (int i = 0; words[i] != NULL; i++) {
+		free(words[i]);
+	}
+	free(words);
+	return NULL;
+}
@@ -0,0 +1,29 @@
+/*
+FileName:    expand.h
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: Hold the function header of expand.c.
+Remark:      None of function is implemented in this file.
+*/
+
+#ifndef EXPAND_H
+#define EXPAND_H
+
+int parameterLength(char* word, int pos);
+
+int needsSubstitution(char* text);
+
+int needsExpansion(char* word);
+
+char* captureOutput(char* line, long* size);
+
+char** expandWords(char** words);
+
+char* expandText(char* text, int quotes);
+
+char* expandPath(char* word);
+
+char** freeWords(char** words);
+
+#endif
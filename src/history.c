@@ -0,0 +1,466 @@
+/*
+FileName:    history.c
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: The persistent command history. The history file is mapped into memory at startup and indexed at the first use,
+             so the startup time does not grow with the size of history.
+Remark:      function implemented in this file:
+             1. Built-in command: history: ALL
+             2. History expansion (!!, !N, !-N, !prefix): ALL
+*/
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "buffer.h"
+#include "constant.h"
+#include "history.h"
+
+// a global variable that store the command history
+History* history = NULL;
+
+/*
+Keep only the newest part of the history file when it is larger than $(history_file_limit).
+The newest half of the limit is copied into a new file, which then replace the history file.
+
+@param fd The fd of history file (opened for reading)
+@param size The size of history file
+
+@return void
+*/
+void compactHistory(int fd, long size) {
+	char* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		return;
+	}
+	// start from the first complete command line in the newest half
+	char* start = memchr(&map[size - history_file_limit / 2], '\0', history_file_limit / 2);
+	if (start != NULL) {
+		start += 1;
+		char temp[strlen(history->path) + 5];
+		snprintf(temp, sizeof(temp), "%s.tmp", history->path);
+		int out = open(temp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+		if (out != -1) {
+			long length = &map[size] - start;
+			if (write(out, start, length) == length && close(out) == 0) {
+				rename(temp, history->path);
+			}
+			else {
+				unlink(temp);
+			}
+		}
+	}
+	munmap(map, size);
+}
+
+/*
+Open the history file ($HISTFILE, or ~/.3230shell_history) and map it into memory.
+
+@param void
+
+@return void
+*/
+void openHistory(void) {
+	history = (History*) malloc(sizeof(History));
+	memset(history, 0, sizeof(History));
+	history->fd = -1;
+	history->capacity = max_num_of_arguments;
+	history->session = (char**) malloc(history->capacity * sizeof(char*));
+	// find the path of history file
+	char* path = getenv("HISTFILE");
+	if (path != NULL) {
+		history->path = strdup(path);
+	}
+	else if (getenv("HOME") != NULL) {
+		history->path = (char*) malloc(strlen(getenv("HOME")) + 20);
+		sprintf(history->path, "%s/.3230shell_history", getenv("HOME"));
+	}
+	else {
+		return;
+	}
+	int fd = open(history->path, O_RDONLY | O_CLOEXEC);
+	struct stat info;
+	if (fd != -1 && fstat(fd, &info) == 0 && info.st_size > history_file_limit) {
+		compactHistory(fd, info.st_size);
+		close(fd);
+		fd = open(history->path, O_RDONLY | O_CLOEXEC);
+	}
+	// map the history file, the command lines are indexed at the first use
+	if (fd != -1 && fstat(fd, &info) == 0 && info.st_size > 0) {
+		history->map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (history->map == MAP_FAILED) {
+			history->map = NULL;
+		}
+		else {
+			history->mapSize = info.st_size;
+		}
+	}
+	if (fd != -1) {
+		close(fd);
+	}
+	// open the history file for appending new command lines
+	history->fd = open(history->path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+}
+
+/*
+Close the history file and free the history.
+
+@param void
+
+@return void
+*/
+void closeHistory(void) {
+	if (history == NULL) {
+		return;
+	}
+	if (history->map != NULL) {
+		munmap(history->map, history->mapSize);
+	}
+	if (history->fd != -1) {
+		close(history->fd);
+	}
+	for (long i = 0; i < history->sessionCount; i++) {
+		free(history->session[i]);
+	}
+	free(history->session);
+	free(history->entries);
+	free(history->sorted);
+	free(history->path);
+	free(history);
+	history = NULL;
+}
+
+/*
+Build the index of the command lines in the history file.
+A command line that is not terminated by '\0' (e.g. the shell crashed while writing it) is ignored.
+
+@param void
+
+@return void
+*/
+void indexHistory(void) {
+	if (history->indexed == 1) {
+		return;
+	}
+	history->indexed = 1;
+	long capacity = max_num_of_arguments;
+	history->entries = (char**) malloc(capacity * sizeof(char*));
+	char* p = history->map;
+	char* end = history->map + history->mapSize;
+	while (p != NULL && p < end) {
+		char* next = memchr(p, '\0', end - p);
+		if (next == NULL) {
+			break;
+		}
+		if (history->mapCount == capacity) {
+			capacity *= 2;
+			history->entries = (char**) realloc(history->entries, capacity * sizeof(char*));
+		}
+		history->entries[history->mapCount++] = p;
+		p = next + 1;
+	}
+}
+
+/*
+Get the number of the last command line.
+
+@param void
+
+@return count The number of command lines in history
+*/
+long countHistory(void) {
+	indexHistory();
+	return history->mapCount + history->sessionCount;
+}
+
+/*
+Get a command line by its number (start from 1).
+
+@param number The number
+
+@return line The command line (NULL if not found)
+*/
+char* getHistory(long number) {
+	if (history == NULL || number < 1 || number > countHistory()) {
+		return NULL;
+	}
+	if (number <= history->mapCount) {
+		return history->entries[number - 1];
+	}
+	return history->session[number - history->mapCount - 1];
+}
+
+/*
+Get the N-th last command line without building the index, the history file is scanned backward from its end by memrchr().
+A command line that is not terminated by '\0' is ignored, as indexHistory() does.
+
+@param back The position from the end (1 is the last command line)
+
+@return line The command line (NULL if there are not so many command lines)
+*/
+char* lastHistory(long back) {
+	if (history == NULL || back < 1) {
+		return NULL;
+	}
+	if (back <= history->sessionCount) {
+		return history->session[history->sessionCount - back];
+	}
+	back -= history->sessionCount;
+	// the '\0' that end the command line being checked
+	char* end = history->map != NULL ? memrchr(history->map, '\0', history->mapSize) : NULL;
+	while (end != NULL) {
+		char* start = end > history->map ? memrchr(history->map, '\0', end - history->map) : NULL;
+		start = start != NULL ? start + 1 : history->map;
+		back -= 1;
+		if (back == 0) {
+			return start;
+		}
+		end = start > history->map ? start - 1 : NULL;
+	}
+	return NULL;
+}
+
+/*
+Append a command line to the history and the history file.
+The command line is not added if it is the same as the last one.
+
+@param line The command line
+
+@return void
+*/
+void addHistory(char* line) {
+	if (history == NULL || line[0] == '\0') {
+		return;
+	}
+	char* last = lastHistory(1);
+	if (last != NULL && strcmp(last, line) == 0) {
+		return;
+	}
+	if (history->sessionCount == history->capacity) {
+		history->capacity *= 2;
+		history->session = (char**) realloc(history->session, history->capacity * sizeof(char*));
+	}
+	history->session[history->sessionCount++] = strdup(line);
+	// one write() with O_APPEND, so the shells sharing the file do not mix their lines
+	if (history->fd != -1 && write(history->fd, line, strlen(line) + 1) == -1) {
+		close(history->fd);
+		history->fd = -1;
+	}
+}
+
+/*
+Compare two command lines in the history file by string (for qsort()).
+
+@param a The position of first command line
+@param b The position of second command line
+
+@return order The order of strings, the older one first when they are the same
+*/
+int compareEntries(const void* a, const void* b) {
+	long x = *(const long*) a;
+	long y = *(const long*) b;
+	int order = strcmp(history->entries[x], history->entries[y]);
+	if (order != 0) {
+		return order;
+	}
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/*
+Find the newest command line that start with $(prefix).
+The command lines of this session are searched first, then the history file is searched
+by binary search in the sorted index (the newest one is the last one among the same strings).
+
+@param prefix The prefix
+
+@return number The number of command line (0 if not found)
+*/
+long searchHistoryPrefix(char* prefix) {
+	if (history == NULL) {
+		return 0;
+	}
+	int length = strlen(prefix);
+	for (long i = history->sessionCount - 1; i >= 0; i--) {
+		if (strncmp(history->session[i], prefix, length) == 0) {
+			return countHistory() - history->sessionCount + i + 1;
+		}
+	}
+	indexHistory();
+	if (history->mapCount == 0) {
+		return 0;
+	}
+	// sort the command lines in history file at the first search
+	if (history->sorted == NULL) {
+		history->sorted = (long*) malloc(history->mapCount * sizeof(long));
+		for (long i = 0; i < history->mapCount; i++) {
+			history->sorted[i] = i;
+		}
+		qsort(history->sorted, history->mapCount, sizeof(long), compareEntries);
+	}
+	// find the first command line that is not smaller than the prefix
+	long low = 0;
+	long high = history->mapCount;
+	while (low < high) {
+		long mid = (low + high) / 2;
+		if (strcmp(history->entries[history->sorted[mid]], prefix) < 0) {
+			low = mid + 1;
+		}
+		else {
+			high = mid;
+		}
+	}
+	// the command lines start with prefix are next to each other
+	long found = -1;
+	for (long i = low; i < history->mapCount && strncmp(history->entries[history->sorted[i]], prefix, length) == 0; i++) {
+		if (history->sorted[i] > found) {
+			found = history->sorted[i];
+		}
+	}
+	return found + 1;
+}
+
+/*
+Check the arguments of built-in command "history".
+
+@param argv The arguments (e.g. {"history", "-s", "make", NULL})
+
+@return 1 if there is error (the message is printed), 0 otherwise
+*/
+int checkHistoryArgs(char** argv) {
+	if (argv[1] == NULL) {
+		return 0;
+	}
+	if ((strcmp(argv[1], "-s") == 0 || strcmp(argv[1], "-p") == 0) && argv[2] != NULL && argv[3] == NULL) {
+		return 0;
+	}
+	if (argv[2] == NULL && strspn(argv[1], "0123456789") == strlen(argv[1])) {
+		return 0;
+	}
+	printf("3230shell: usage: history [N | -s TEXT | -p PREFIX]\n");
+	return 1;
+}
+
+/*
+Print a command line with its number.
+
+@param number The number
+@param line The command line
+
+@return void
+*/
+void printEntry(long number, char* line) {
+	printf("%6ld  %s\n", number, line);
+}
+
+/*
+Print the history (i.e. the built-in command "history").
+"history" print all, "history N" print the last N, "history -s TEXT" print the command lines containing TEXT,
+"history -p PREFIX" print the command lines starting with PREFIX.
+
+@param argv The arguments
+
+@return void
+*/
+void printHistory(char** argv) {
+	if (history == NULL) {
+		return;
+	}
+	long count = countHistory();
+	// history -s TEXT: search the whole mapped file at once, then the command lines of this session
+	if (argv[1] != NULL && strcmp(argv[1], "-s") == 0) {
+		char* text = argv[2];
+		int length = strlen(text);
+		char* p = history->map;
+		char* end = history->map + history->mapSize;
+		long number = 0;
+		while (p != NULL && length > 0 && history->mapCount > 0 && (p = memmem(p, end - p, text, length)) != NULL) {
+			// find the command line that contains the match
+			while (number < history->mapCount - 1 && history->entries[number + 1] <= p) {
+				number++;
+			}
+			// the match is in the incomplete command line at the end of file
+			if (p >= history->entries[number] + strlen(history->entries[number])) {
+				break;
+			}
+			printEntry(number + 1, history->entries[number]);
+			p = history->entries[number] + strlen(history->entries[number]) + 1;
+			number++;
+		}
+		for (long i = 0; i < history->sessionCount; i++) {
+			if (strstr(history->session[i], text) != NULL) {
+				printEntry(history->mapCount + i + 1, history->session[i]);
+			}
+		}
+		return;
+	}
+	// history -p PREFIX
+	if (argv[1] != NULL && strcmp(argv[1], "-p") == 0) {
+		int length = strlen(argv[2]);
+		for (long i = 1; i <= count; i++) {
+			if (strncmp(getHistory(i), argv[2], length) == 0) {
+				printEntry(i, getHistory(i));
+			}
+		}
+		return;
+	}
+	// history [N]
+	long first = 1;
+	if (argv[1] != NULL) {
+		first = count - atol(argv[1]) + 1;
+		if (first < 1) {
+			first = 1;
+		}
+	}
+	for (long i = first; i <= count; i++) {
+		printEntry(i, getHistory(i));
+	}
+}
+
+/*
+Replace the history expansion at the beginning of the command line by the command line in history.
+"!!" is the last command line, "!N" is the N-th, "!-N" is the N-th last, "!prefix" is the newest one starting with prefix.
+The rest of the line is kept, i.e. "!! | wc" -> "ls | wc".
+
+@param buffer The buffer holding the command line (starting with '!')
+
+@return buffer The buffer holding the expanded command line (NULL if event is not found, the buffer is freed)
+*/
+Buffer* expandHistory(Buffer* buffer) {
+	char* string = buffer->string;
+	int length = strcspn(string, " \t|&;<");
+	char event[length + 1];
+	memcpy(event, string, length);
+	event[length] = '\0';
+	// "!!" and "!-N" only scan the tail of history, "!N" and "!prefix" build the index
+	char* line = NULL;
+	if (strcmp(event, "!!") == 0) {
+		line = lastHistory(1);
+	}
+	else if (event[1] == '-' && length > 2 && strspn(&event[2], "0123456789") == (size_t) (length - 2)) {
+		line = lastHistory(atol(&event[2]));
+	}
+	else if (length > 1 && strspn(&event[1], "0123456789") == (size_t) (length - 1)) {
+		line = getHistory(atol(&event[1]));
+	}
+	else if (length > 1) {
+		line = getHistory(searchHistoryPrefix(&event[1]));
+	}
+	if (line == NULL) {
+		printf("3230shell: %s: event not found\n", event);
+		return freeBuffer(buffer);
+	}
+	Buffer* result = initBuffer(strlen(line) + strlen(&string[length]) + 2);
+	strcpy(result->string, line);
+	strcat(result->string, &string[length]);
+	buffer = freeBuffer(buffer);
+	return result;
+}
@@ -0,0 +1,48 @@
+/*
+FileName:    history.h
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: Hold the function header of history.c, provide self defined structure.
+Remark:      None of function is implemented in this file.
+*/
+
+#include "buffer.h"
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+// the command history, the history file is a log of '\0' terminated command lines
+typedef struct History {
+	char* path;         // path of the history file
+	int fd;             // the fd to append new command lines (-1 if history is not saved)
+	char* map;          // the history file mapped at startup
+	long mapSize;       // size of $(map)
+	char** entries;     // index of the command lines in $(map) (built at the first use)
+	long mapCount;      // number of command lines in $(map)
+	long* sorted;       // positions in $(entries) sorted by string (built at the first prefix search)
+	int indexed;        // 1 if $(entries) is built
+	char** session;     // the command lines entered in this session
+	long sessionCount;  // number of command lines in $(session)
+	long capacity;      // capacity of $(session)
+} History;
+
+void openHistory(void);
+
+void closeHistory(void);
+
+void addHistory(char* line);
+
+long countHistory(void);
+
+char* getHistory(long number);
+
+long searchHistoryPrefix(char* prefix);
+
+void printHistory(char** argv);
+
+int checkHistoryArgs(char** argv);
+
+Buffer* expandHistory(Buffer* buffer);
+
+#endif
@@ -0,0 +1,587 @@
+/*
+FileName:    joblog.c
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: An opt-in mode ("joblog on") that give the last command of every background job a pipe instead of the terminal,
+             so the output of concurrent jobs is not interleaved byte by byte.
+             The pipes are watched by one epoll fd, which is polled by the line editor, the script reader and the wait
+             of foreground jobs, and each pipe is read into the ring of its job directly in large non-blocking reads.
+             The ring of a job grows until its capacity, then the oldest output is evicted.
+             The complete lines are displayed live with the tag "[n] ", and "joblog %n" print the output kept later.
+Remark:      function implemented in this file:
+             1. Built-in command: joblog: ALL
+             2. Output capture of background jobs: ALL (the pipe is connected by executePipeline() in task.c)
+*/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "ast.h"
+#include "joblog.h"
+#include "launch.h"
+
+// 1 if the output of background jobs is captured
+int jobLogMode = 0;
+// 1 if the complete lines are displayed live with the tag of job
+int jobLogLive = 1;
+// the capacity of the ring of a new job
+long jobLogCapacity = job_log_capacity;
+// the number of jobs captured, it is used to number the jobs
+long jobLogCount = 0;
+// the epoll fd that watch the pipes of jobs (-1 if it is not created yet)
+int jobLogEpoll = -1;
+// the number of pipes that are not at end of file
+int openJobLogs = 0;
+// the logs of jobs, newest first
+JobLog* jobLogs = NULL;
+// 1 if "joblog -f" is interrupted by Ctrl-C
+volatile sig_atomic_t joblogInterrupted = 0;
+
+/*
+Handler of SIGINT while following a log.
+It stop following instead of printing a new prompt.
+
+@param signum Signal Number
+
+@return void
+*/
+void joblogSighandler(int signum) {
+	joblogInterrupted = 1;
+}
+
+/*
+Free a log and close its pipe.
+
+@param log The log
+
+@return void
+*/
+void freeJobLog(JobLog* log) {
+	if (log->fd != -1) {
+		epoll_ctl(jobLogEpoll, EPOLL_CTL_DEL, log->fd, NULL);
+		close(log->fd);
+		openJobLogs -= 1;
+	}
+	if (log->writeFd != -1) {
+		close(log->writeFd);
+	}
+	free(log->command);
+	free(log->ring);
+	free(log);
+}
+
+/*
+Free the oldest finished logs when more than $(max_finished_job_logs) are kept.
+
+@param void
+
+@return void
+*/
+void trimJobLogs(void) {
+	int finished = 0;
+	JobLog** link = &jobLogs;
+	while (*link != NULL) {
+		JobLog* log = *link;
+		if (log->fd == -1 && log->writeFd == -1 && log->following == 0 && ++finished > max_finished_job_logs) {
+			*link = log->next;
+			freeJobLog(log);
+			continue;
+		}
+		link = &log->next;
+	}
+}
+
+/*
+Create the log of a background job if the mode is on.
+The write end of its pipe is the stdout of the last command, it is closed by startJobLog() after the job is launched.
+
+@param pipeline The pipeline of job
+
+@return log The log (NULL if the mode is off or the pipe cannot be created)
+*/
+JobLog* createJobLog(Pipeline* pipeline) {
+	if (jobLogMode == 0) {
+		return NULL;
+	}
+	if (jobLogEpoll == -1) {
+		jobLogEpoll = epoll_create1(EPOLL_CLOEXEC);
+		if (jobLogEpoll == -1) {
+			perror("3230shell: joblog");
+			return NULL;
+		}
+	}
+	// both ends are closed in the other processes, only the read end is non-blocking (the write end is the stdout of a command)
+	int fds[2];
+	if (pipe2(fds, O_CLOEXEC) == -1) {
+		perror("3230shell: joblog");
+		return NULL;
+	}
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	// a larger pipe let a chatty job run further while the shell is busy (the size is limited by /proc/sys/fs/pipe-max-size)
+	fcntl(fds[0], F_SETPIPE_SZ, 1024 * 1024);
+	JobLog* log = (JobLog*) malloc(sizeof(JobLog));
+	memset(log, 0, sizeof(JobLog));
+	log->id = ++jobLogCount;
+	log->fd = fds[0];
+	log->writeFd = fds[1];
+	log->capacity = jobLogCapacity;
+	// the command line, e.g. "ls -l | grep c"
+	int length = 0;
+	for (int i = 0; i < pipeline->stageNum; i++) {
+		for (int j = 0; pipeline->stages[i].argv[j] != NULL; j++) {
+			length += strlen(pipeline->stages[i].argv[j]) + 3;
+		}
+	}
+	log->command = (char*) malloc(length + 1);
+	log->command[0] = '\0';
+	for (int i = 0; i < pipeline->stageNum; i++) {
+		if (i > 0) {
+			strcat(log->command, " |");
+		}
+		for (int j = 0; pipeline->stages[i].argv[j] != NULL; j++) {
+			if (i > 0 || j > 0) {
+				strcat(log->command, " ");
+			}
+			strcat(log->command, pipeline->stages[i].argv[j]);
+		}
+	}
+	log->next = jobLogs;
+	jobLogs = log;
+	trimJobLogs();
+	return log;
+}
+
+/*
+Start watching the pipe of a job after it is launched.
+
+@param log The log (NULL if the job is not captured)
+@param pgid The process group of job
+
+@return void
+*/
+void startJobLog(JobLog* log, pid_t pgid) {
+	if (log == NULL) {
+		return;
+	}
+	close(log->writeFd);
+	log->writeFd = -1;
+	log->pgid = pgid;
+	struct epoll_event event = {0};
+	event.events = EPOLLIN;
+	event.data.ptr = log;
+	if (epoll_ctl(jobLogEpoll, EPOLL_CTL_ADD, log->fd, &event) == -1) {
+		close(log->fd);
+		log->fd = -1;
+		return;
+	}
+	openJobLogs += 1;
+	printf("[%ld] %d\n", log->id, pgid);
+}
+
+/*
+Get the fd that become readable when a job has output, it is polled by the line editor and the script reader.
+
+@param void
+
+@return fd The epoll fd (-1 if no job is captured)
+*/
+int jobLogFd(void) {
+	return openJobLogs > 0 ? jobLogEpoll : -1;
+}
+
+/*
+Get the number of bytes that are still in the ring.
+
+@param log The log
+
+@return length The number of bytes
+*/
+long keptLength(JobLog* log) {
+	return log->total < log->size ? log->total : log->size;
+}
+
+/*
+Write the bytes [$(from), $(to)) of the output of a job, they must be still in the ring.
+Each line is prefixed by $(tag) if it is not NULL.
+
+@param log The log
+@param from The position of the first byte (in the whole output)
+@param to The position after the last byte
+@param tag The prefix of lines (NULL for none)
+@param newline 1 to end the output with a '\10' if it does not
+
+@return void
+*/
+void writeJobOutput(JobLog* log, long from, long to, char* tag, int newline) {
+	if (from >= to) {
+		return;
+	}
+	int tagLength = tag != NULL ? strlen(tag) : 0;
+	long lines = 1;
+	if (tag != NULL) {
+		for (long pos = from; pos < to - 1; pos++) {
+			lines += log->ring[pos % log->size] == '\n';
+		}
+	}
+	// the output is written by one fwrite(), the stdout is not buffered in interactive mode
+	char* output = (char*) malloc(to - from + lines * tagLength + 2);
+	long length = 0;
+	int lineStart = 1;
+	for (long pos = from; pos < to; pos++) {
+		if (lineStart == 1 && tag != NULL) {
+			memcpy(&output[length], tag, tagLength);
+			length += tagLength;
+		}
+		output[length++] = log->ring[pos % log->size];
+		lineStart = output[length - 1] == '\n';
+	}
+	if (newline == 1 && lineStart == 0) {
+		output[length++] = '\n';
+	}
+	fwrite(output, 1, length, stdout);
+	free(output);
+}
+
+/*
+Display the complete lines of a job that are not displayed yet, with the tag of job.
+
+@param log The log
+@param final 1 if the job has no more output (the last partial line is displayed too)
+
+@return void
+*/
+void displayJobLog(JobLog* log, int final) {
+	long from = log->total - keptLength(log);
+	if (from < log->shown) {
+		from = log->shown;
+	}
+	long to = log->total;
+	if (final == 0) {
+		// stop after the last '\10', unless the partial line is too long
+		while (to > from && log->ring[(to - 1) % log->size] != '\n') {
+			to--;
+		}
+		if (to == from && log->total - from >= job_log_line_limit) {
+			to = log->total;
+		}
+	}
+	if (jobLogLive == 1 && log->following == 0) {
+		char tag[32];
+		snprintf(tag, sizeof(tag), "[%ld] ", log->id);
+		writeJobOutput(log, from, to, tag, 1);
+	}
+	log->shown = to;
+}
+
+/*
+Read the pipe of a job into its ring until it is empty.
+
+@param log The log
+
+@return void
+*/
+void readJobLog(JobLog* log) {
+	// a job that keeps writing does not hold the shell for more than 16 reads
+	for (int reads = 0; reads < 16; reads++) {
+		// grow the ring before it reach the capacity (the output is not wrapped yet)
+		if (log->size < log->capacity && log->total + job_log_read_size > log->size) {
+			long size = log->size == 0 ? job_log_read_size : log->size * 2;
+			log->size = size < log->capacity ? size : log->capacity;
+			log->ring = (char*) realloc(log->ring, log->size);
+		}
+		// read into the ring directly, up to its end
+		long pos = log->total % log->size;
+		long space = log->size - pos < job_log_read_size ? log->size - pos : job_log_read_size;
+		long count = read(log->fd, &log->ring[pos], space);
+		if (count == -1 && errno == EINTR) {
+			continue;
+		}
+		if (count == -1) {
+			break;
+		}
+		if (count == 0) {
+			epoll_ctl(jobLogEpoll, EPOLL_CTL_DEL, log->fd, NULL);
+			close(log->fd);
+			log->fd = -1;
+			openJobLogs -= 1;
+			break;
+		}
+		log->total += count;
+	}
+	displayJobLog(log, log->fd == -1);
+}
+
+/*
+Read the output of jobs that is ready, and display it live.
+
+@param void
+
+@return count The number of pipes read
+*/
+int drainJobLogs(void) {
+	if (jobLogEpoll == -1 || openJobLogs == 0) {
+		return 0;
+	}
+	struct epoll_event events[32];
+	int count = epoll_wait(jobLogEpoll, events, 32, 0);
+	for (int i = 0; i < count; i++) {
+		readJobLog((JobLog*) events[i].data.ptr);
+	}
+	fflush(stdout);
+	return count > 0 ? count : 0;
+}
+
+/*
+Wait until a foreground process exit, while reading the output of background jobs, so they are not blocked by a full pipe.
+The process is not reaped, it is waited by the caller as usual.
+
+@param pid The process
+
+@return void
+*/
+void waitDrainingJobLogs(pid_t pid) {
+	if (openJobLogs == 0) {
+		return;
+	}
+	int pidfd = syscall(SYS_pidfd_open, pid, 0);
+	if (pidfd == -1) {
+		return;
+	}
+	struct pollfd fds[2];
+	fds[0].fd = pidfd;
+	fds[0].events = POLLIN;
+	fds[1].fd = jobLogEpoll;
+	fds[1].events = POLLIN;
+	while (1) {
+		fds[1].fd = jobLogFd();
+		if (poll(fds, 2, -1) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		if ((fds[1].revents & POLLIN) != 0) {
+			drainJobLogs();
+		}
+		if (fds[0].revents != 0) {
+			break;
+		}
+	}
+	close(pidfd);
+}
+
+/*
+Find the log of job "%n".
+
+@param word The word "%n"
+
+@return log The log (NULL if not found)
+*/
+JobLog* findJobLog(char* word) {
+	char* end = NULL;
+	long id = word[0] == '%' ? strtol(&word[1], &end, 10) : 0;
+	if (id <= 0 || *end != '\0') {
+		return NULL;
+	}
+	for (JobLog* log = jobLogs; log != NULL; log = log->next) {
+		if (log->id == id) {
+			return log;
+		}
+	}
+	return NULL;
+}
+
+/*
+Detect the errors of the arguments of "joblog",
+i.e. "joblog", "joblog on [-q] [SIZE]", "joblog off", "joblog %n" or "joblog -f %n".
+
+@param argv The argument vector
+
+@return 1 if there is error (the message is printed), 0 otherwise
+*/
+int checkJoblogArgs(char** argv) {
+	if (argv[1] == NULL || (strcmp(argv[1], "off") == 0 && argv[2] == NULL)) {
+		return 0;
+	}
+	if (strcmp(argv[1], "on") == 0) {
+		int pos = 2;
+		if (argv[pos] != NULL && strcmp(argv[pos], "-q") == 0) {
+			pos++;
+		}
+		rlim_t size = 0;
+		if (argv[pos] != NULL && (parseSize(argv[pos], &size) == -1 || size < 1024 || size > (1L << 30))) {
+			printf("3230shell: joblog: invalid size '%s' (1K to 1G)\n", argv[pos]);
+			return 1;
+		}
+		if (argv[pos] == NULL || argv[pos + 1] == NULL) {
+			return 0;
+		}
+	}
+	else if (argv[1][0] == '%' && argv[2] == NULL) {
+		return 0;
+	}
+	else if (strcmp(argv[1], "-f") == 0 && argv[2] != NULL && argv[2][0] == '%' && argv[3] == NULL) {
+		return 0;
+	}
+	printf("3230shell: joblog: usage: joblog [on [-q] [SIZE] | off | [-f] %%n]\n");
+	return 1;
+}
+
+/*
+Print the state of mode and the logs of jobs (i.e. "joblog").
+
+@param void
+
+@return void
+*/
+void printJobLogs(void) {
+	if (jobLogMode == 0) {
+		printf("joblog: off\n");
+	}
+	else {
+		printf("joblog: on (%ld KB for each job, %s)\n", jobLogCapacity / 1024, jobLogLive == 1 ? "displayed live" : "quiet");
+	}
+	if (jobLogs == NULL) {
+		return;
+	}
+	printf("%-6s %-8s %-8s %10s %10s  %s\n", "JOB", "PGID", "STATE", "BYTES", "EVICTED", "COMMAND");
+	for (JobLog* log = jobLogs; log != NULL; log = log->next) {
+		char id[24];
+		snprintf(id, sizeof(id), "%%%ld", log->id);
+		printf("%-6s %-8d %-8s %10ld %10ld  %s\n", id, log->pgid, log->fd != -1 ? "running" : "done", log->total, log->total - keptLength(log), log->command);
+	}
+}
+
+/*
+Print the output of a job kept in its ring, then follow it until the job close its output or Ctrl-C is pressed (i.e. "joblog -f %n").
+
+@param log The log
+@param follow 1 to follow the new output
+
+@return void
+*/
+void printJobLog(JobLog* log, int follow) {
+	long evicted = log->total - keptLength(log);
+	// the line that is partly evicted is skipped
+	if (evicted > 0) {
+		long pos = evicted;
+		while (pos < log->total && log->ring[pos % log->size] != '\n') {
+			pos++;
+		}
+		evicted = pos < log->total ? pos + 1 : evicted;
+		printf("3230shell: joblog: %%%ld: the first %ld bytes were evicted\n", log->id, evicted);
+	}
+	long printed = log->total;
+	writeJobOutput(log, evicted, printed, NULL, 0);
+	if (follow == 0 || log->fd == -1) {
+		fflush(stdout);
+		return;
+	}
+	// Ctrl-C stop following (the poll is not restarted)
+	struct sigaction saved;
+	struct sigaction sa_int = {0};
+	sa_int.sa_handler = &joblogSighandler;
+	joblogInterrupted = 0;
+	sigaction(SIGINT, &sa_int, &saved);
+	log->following = 1;
+	struct pollfd fds[1];
+	fds[0].fd = jobLogEpoll;
+	fds[0].events = POLLIN;
+	while (joblogInterrupted == 0 && log->fd != -1) {
+		fflush(stdout);
+		if (poll(fds, 1, -1) == -1) {
+			continue;
+		}
+		drainJobLogs();
+		// the output evicted before it is printed is skipped
+		if (printed < log->total - keptLength(log)) {
+			printed = log->total - keptLength(log);
+		}
+		writeJobOutput(log, printed, log->total, NULL, 0);
+		printed = log->total;
+	}
+	log->following = 0;
+	log->shown = log->total;
+	if (joblogInterrupted == 1) {
+		printf("\n");
+	}
+	fflush(stdout);
+	sigaction(SIGINT, &saved, NULL);
+}
+
+/*
+The built-in command "joblog".
+"joblog on [-q] [SIZE]" capture the output of later background jobs into rings of SIZE (256K by default),
+"-q" keep the output without displaying it, "joblog off" stop capturing,
+"joblog" list the logs, "joblog %n" print the output of job n, and "joblog -f %n" follow it.
+
+@param argv The argument vector (it is checked by checkJoblogArgs())
+
+@return status 0 if success, 1 otherwise
+*/
+int runJoblog(char** argv) {
+	if (argv[1] == NULL) {
+		printJobLogs();
+		return 0;
+	}
+	if (strcmp(argv[1], "off") == 0) {
+		jobLogMode = 0;
+		return 0;
+	}
+	if (strcmp(argv[1], "on") == 0) {
+		int pos = 2;
+		jobLogLive = 1;
+		if (argv[pos] != NULL && strcmp(argv[pos], "-q") == 0) {
+			jobLogLive = 0;
+			pos++;
+		}
+		rlim_t size = job_log_capacity;
+		if (argv[pos] != NULL) {
+			parseSize(argv[pos], &size);
+		}
+		jobLogCapacity = (long) size;
+		jobLogMode = 1;
+		return 0;
+	}
+	int follow = strcmp(argv[1], "-f") == 0;
+	char* word = follow == 1 ? argv[2] : argv[1];
+	JobLog* log = findJobLog(word);
+	if (log == NULL) {
+		printf("3230shell: joblog: %s: no such job\n", word);
+		return 1;
+	}
+	printJobLog(log, follow);
+	return 0;
+}
+
+/*
+Free all logs and close their pipes.
+
+@param void
+
+@return void
+*/
+void freeJobLogs(void) {
+	while (jobLogs != NULL) {
+		JobLog* log = jobLogs;
+		jobLogs = log->next;
+		freeJobLog(log);
+	}
+	if (jobLogEpoll != -1) {
+		close(jobLogEpoll);
+		jobLogEpoll = -1;
+	}
+}
@@ -0,0 +1,61 @@
+/*
+FileName:    joblog.h
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: Hold the function header of joblog.c, provide self defined structure.
+Remark:      None of function is implemented in this file.
+*/
+
+#include <sys/types.h>
+
+#include "ast.h"
+
+#ifndef JOBLOG_H
+#define JOBLOG_H
+
+// the default capacity of the output ring of a job (the oldest output is evicted when it is full)
+#define job_log_capacity (256 * 1024)
+
+// the largest read from the pipe of a job (it is read into the ring directly)
+#define job_log_read_size 65536
+
+// a partial line longer than it is displayed without waiting for its end
+#define job_log_line_limit 4096
+
+// the number of finished logs kept (the oldest finished log is freed first)
+#define max_finished_job_logs 64
+
+// the output of the last command of a background job
+typedef struct JobLog {
+	long id;            // the number of job ("%n")
+	pid_t pgid;         // the process group of job
+	char* command;      // the command line of job
+	int fd;             // the read end of pipe (-1 after end of file)
+	int writeFd;        // the write end, the stdout of the last command (-1 after the job is launched)
+	char* ring;         // the output, it is a ring after it reach $(capacity)
+	long size;          // the size of $(ring), it grows until $(capacity)
+	long capacity;
+	long total;         // number of bytes received, the ring hold the last $(size) of them
+	long shown;         // number of bytes displayed live (the lines are displayed when they are complete)
+	int following;      // 1 if it is being followed by "joblog -f" (it is not displayed live)
+	struct JobLog* next;
+} JobLog;
+
+JobLog* createJobLog(Pipeline* pipeline);
+
+void startJobLog(JobLog* log, pid_t pgid);
+
+int jobLogFd(void);
+
+int drainJobLogs(void);
+
+void waitDrainingJobLogs(pid_t pid);
+
+int checkJoblogArgs(char** argv);
+
+int runJoblog(char** argv);
+
+void freeJobLogs(void);
+
+#endif
@@ -0,0 +1,369 @@
+/*
+FileName:    jobtop.c
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: A live monitor of the running jobs, it samples /proc/<pid>/stat and /proc/<pid>/io of every task
+             in the task record that is not reaped yet, and print the CPU%, RSS, threads, I/O and state of them.
+             The files of a task are opened once and re-read by pread() in every refresh,
+             so a refresh only cost two pread() for each task.
+Remark:      function implemented in this file:
+             1. Built-in command: jobtop: ALL
+*/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "constant.h"
+#include "jobtop.h"
+#include "linklist.h"
+#include "shellstat.h"
+
+// a global variable that store the PIDs and corresponding CMD.
+extern Node** taskRecords;
+
+// the samples of the running tasks (they are kept between the calls, so the fds are reused)
+JobSample* jobSamples = NULL;
+int jobSampleNum = 0;
+int jobSampleCapacity = 0;
+// 1 if the monitor is interrupted by Ctrl-C
+volatile sig_atomic_t jobtopInterrupted = 0;
+
+/*
+Handler of SIGINT while the monitor is running.
+It stop the monitor instead of printing a new prompt.
+
+@param signum Signal Number
+
+@return void
+*/
+void jobtopSighandler(int signum) {
+	jobtopInterrupted = 1;
+}
+
+/*
+Parse the arguments of "jobtop [-d SECONDS] [-n COUNT]".
+
+@param argv The argument vector
+@param interval The space to hold the seconds between refreshes (1 second by default)
+@param count The space to hold the number of refreshes (0 means until no job is running)
+
+@return status 0 if success, 1 otherwise
+*/
+int parseJobtopArgs(char** argv, double* interval, long* count) {
+	*interval = 1;
+	*count = 0;
+	for (int i = 1; argv[i] != NULL; i += 2) {
+		if (argv[i + 1] == NULL) {
+			return 1;
+		}
+		char* end = NULL;
+		errno = 0;
+		if (strcmp(argv[i], "-d") == 0) {
+			*interval = strtod(argv[i + 1], &end);
+			if (errno != 0 || *end != '\0' || end == argv[i + 1] || !(*interval >= 0.01 && *interval <= 86400)) {
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "-n") == 0) {
+			*count = strtol(argv[i + 1], &end, 10);
+			if (errno != 0 || *end != '\0' || end == argv[i + 1] || *count <= 0) {
+				return 1;
+			}
+		}
+		else {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+Check the arguments of the built-in command "jobtop".
+
+@param argv The argument vector
+
+@return error 1 if the arguments are invalid, 0 otherwise
+*/
+int checkJobtopArgs(char** argv) {
+	double interval = 0;
+	long count = 0;
+	if (parseJobtopArgs(argv, &interval, &count) != 0) {
+		printf("3230shell: jobtop: usage: jobtop [-d SECONDS] [-n COUNT]\n");
+		return 1;
+	}
+	return 0;
+}
+
+/*
+Close the files of a sample.
+
+@param sample The sample
+
+@return void
+*/
+void closeJobSample(JobSample* sample) {
+	close(sample->statFd);
+	if (sample->ioFd != -1) {
+		close(sample->ioFd);
+	}
+}
+
+/*
+Find the sample of a task, the files of task are opened if it is not sampled before.
+The first sample is taken since the task is forked, so the CPU% of it is the average since start.
+
+@param node The task in task record
+
+@return sample The sample of task (NULL if the task has gone)
+*/
+JobSample* findJobSample(Node* node) {
+	for (int i = 0; i < jobSampleNum; i++) {
+		if (jobSamples[i].pid == node->pid) {
+			return &jobSamples[i];
+		}
+	}
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/%d/stat", node->pid);
+	int statFd = open(path, O_RDONLY | O_CLOEXEC);
+	if (statFd == -1) {
+		return NULL;
+	}
+	if (jobSampleNum == jobSampleCapacity) {
+		jobSampleCapacity = jobSampleCapacity == 0 ? 16 : jobSampleCapacity * 2;
+		jobSamples = (JobSample*) realloc(jobSamples, jobSampleCapacity * sizeof(JobSample));
+	}
+	JobSample* sample = &jobSamples[jobSampleNum];
+	jobSampleNum += 1;
+	sample->pid = node->pid;
+	sample->statFd = statFd;
+	// /proc/<pid>/io may be unreadable (e.g. the program is setuid)
+	snprintf(path, sizeof(path), "/proc/%d/io", node->pid);
+	sample->ioFd = open(path, O_RDONLY | O_CLOEXEC);
+	sample->ticks = 0;
+	sample->time = node->start;
+	return sample;
+}
+
+/*
+Read a file of /proc from its beginning.
+
+@param fd The fd of file
+@param buffer The space to hold the content
+@param size The size of $(buffer)
+
+@return length The length of content (-1 if it could not be read)
+*/
+int readProcFile(int fd, char* buffer, int size) {
+	int length = pread(fd, buffer, size - 1, 0);
+	if (length < 0) {
+		return -1;
+	}
+	buffer[length] = '\0';
+	return length;
+}
+
+/*
+Take a sample of a task.
+
+@param sample The sample of task
+@param usage The space to hold the values
+
+@return status 0 if success, -1 if the task has gone
+*/
+int readJobUsage(JobSample* sample, JobUsage* usage) {
+	// the command name may contain spaces and ')', so the fields are counted from the last ')'
+	char buffer[1024];
+	if (readProcFile(sample->statFd, buffer, sizeof(buffer)) <= 0) {
+		return -1;
+	}
+	char* fields = strrchr(buffer, ')');
+	unsigned long long utime = 0;
+	unsigned long long stime = 0;
+	long long pages = 0;
+	if (fields == NULL || sscanf(fields + 1, " %c %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %llu %llu %*s %*s %*s %*s %ld %*s %*s %*s %lld",
+		&usage->state, &utime, &stime, &usage->threads, &pages) != 5) {
+		return -1;
+	}
+	usage->ticks = utime + stime;
+	usage->rss = pages * sysconf(_SC_PAGESIZE);
+	// the bytes passed to read() and write(), including pipes and terminal
+	usage->readBytes = -1;
+	usage->writeBytes = -1;
+	if (sample->ioFd != -1 && readProcFile(sample->ioFd, buffer, sizeof(buffer)) > 0) {
+		sscanf(buffer, "rchar: %lld wchar: %lld", &usage->readBytes, &usage->writeBytes);
+	}
+	return 0;
+}
+
+/*
+Format a number of bytes into a human-readable string (e.g. "512B", "4.0K", "12.3M").
+
+@param bytes The number of bytes (-1 if it is not available)
+@param output The space to hold the string
+@param size The size of $(output)
+
+@return void
+*/
+void formatBytes(long long bytes, char* output, int size) {
+	if (bytes < 0) {
+		snprintf(output, size, "-");
+		return;
+	}
+	if (bytes < 1024) {
+		snprintf(output, size, "%lldB", bytes);
+		return;
+	}
+	char units[] = "KMGTP";
+	double value = bytes / 1024.0;
+	int unit = 0;
+	while (value >= 1024 && units[unit + 1] != '\0') {
+		value /= 1024;
+		unit++;
+	}
+	snprintf(output, size, "%.1f%c", value, units[unit]);
+}
+
+/*
+Sample all running tasks and print a table of them.
+The samples of the tasks that have been reaped are closed and removed.
+
+@param tty 1 if the screen is cleared before printing the table
+
+@return running The number of running tasks
+*/
+int printJobTable(int tty) {
+	long ticksPerSecond = sysconf(_SC_CLK_TCK);
+	for (int i = 0; i < jobSampleNum; i++) {
+		jobSamples[i].seen = 0;
+	}
+	// the table is built in a buffer first, so the screen is not flickering
+	int capacity = max_length_of_command;
+	int length = 0;
+	char* table = (char*) malloc(capacity * sizeof(char));
+	table[0] = '\0';
+	int running = 0;
+	for (Node* node = *taskRecords; node != NULL; node = node->next) {
+		if (node->done == 1) {
+			continue;
+		}
+		JobSample* sample = findJobSample(node);
+		JobUsage usage;
+		if (sample == NULL || readJobUsage(sample, &usage) != 0) {
+			continue;
+		}
+		sample->seen = 1;
+		running += 1;
+		// the CPU% since the previous sample
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		double seconds = (now.tv_sec - sample->time.tv_sec) + (now.tv_nsec - sample->time.tv_nsec) / 1e9;
+		double cpu = seconds > 0 ? (usage.ticks - sample->ticks) * 100.0 / (seconds * ticksPerSecond) : 0;
+		sample->ticks = usage.ticks;
+		sample->time = now;
+
+		char rss[16];
+		char readBytes[16];
+		char writeBytes[16];
+		formatBytes(usage.rss, rss, sizeof(rss));
+		formatBytes(usage.readBytes, readBytes, sizeof(readBytes));
+		formatBytes(usage.writeBytes, writeBytes, sizeof(writeBytes));
+		if (length + max_length_of_command + 128 > capacity) {
+			capacity *= 2;
+			table = (char*) realloc(table, capacity * sizeof(char));
+		}
+		length += snprintf(&table[length], capacity - length, "%7d %c %6.1f %8s %4ld %8s %8s %s\n",
+			node->pid, usage.state, cpu, rss, usage.threads, readBytes, writeBytes, node->cmd);
+	}
+	// remove the samples of the tasks that have gone
+	int kept = 0;
+	for (int i = 0; i < jobSampleNum; i++) {
+		if (jobSamples[i].seen == 1) {
+			jobSamples[kept++] = jobSamples[i];
+		}
+		else {
+			closeJobSample(&jobSamples[i]);
+		}
+	}
+	jobSampleNum = kept;
+
+	if (tty == 1) {
+		printf("\x1b[H\x1b[2J");
+	}
+	printf("jobtop: %d running (Ctrl-C to quit)\n", running);
+	printf("%7s %c %6s %8s %4s %8s %8s %s\n", "PID", 'S', "CPU%", "RSS", "THR", "READ", "WRITE", "CMD");
+	printf("%s", table);
+	fflush(stdout);
+	free(table);
+	return running;
+}
+
+/*
+The built-in command "jobtop".
+It refresh the table of running tasks every $(interval) seconds,
+until no task is running, $(count) tables are printed, or Ctrl-C is pressed.
+
+@param argv The argument vector (it is checked by checkJobtopArgs())
+
+@return status 0 if success
+*/
+int runJobtop(char** argv) {
+	double interval = 0;
+	long count = 0;
+	parseJobtopArgs(argv, &interval, &count);
+	// Ctrl-C stop the monitor (the sleep is not restarted)
+	struct sigaction saved;
+	struct sigaction sa_int = {0};
+	sa_int.sa_handler = &jobtopSighandler;
+	jobtopInterrupted = 0;
+	sigaction(SIGINT, &sa_int, &saved);
+
+	int tty = isatty(STDOUT_FILENO);
+	struct timespec deadline;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	for (long refresh = 0; count == 0 || refresh < count; refresh++) {
+		if (refresh > 0) {
+			// sleep until the deadline, the sleep is resumed if it is interrupted by SIGCHLD
+			long long nanos = deadline.tv_nsec + (long long) (interval * 1e9);
+			deadline.tv_sec += nanos / 1000000000;
+			deadline.tv_nsec = nanos % 1000000000;
+			while (jobtopInterrupted == 0 && clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+				continue;
+			}
+		}
+		if (jobtopInterrupted == 1 || printJobTable(tty) == 0) {
+			break;
+		}
+	}
+	if (jobtopInterrupted == 1) {
+		printf("\n");
+	}
+	sigaction(SIGINT, &saved, NULL);
+	return 0;
+}
+
+/*
+Close the files of all samples.
+
+@param void
+
+@return void
+*/
+void freeJobSamples(void) {
+	for (int i = 0; i < jobSampleNum; i++) {
+		closeJobSample(&jobSamples[i]);
+	}
+	free(jobSamples);
+	jobSamples = NULL;
+	jobSampleNum = 0;
+	jobSampleCapacity = 0;
+}
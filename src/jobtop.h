@@ -0,0 +1,42 @@
+/*
+FileName:    jobtop.h
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: Hold the function header of jobtop.c, provide self defined structure.
+Remark:      None of function is implemented in this file.
+*/
+
+#include <sys/types.h>
+#include <time.h>
+
+#ifndef JOBTOP_H
+#define JOBTOP_H
+
+// the open files of /proc/<pid> and the previous sample of a running task
+typedef struct JobSample {
+	pid_t pid;
+	int statFd;                 // the fd of /proc/<pid>/stat
+	int ioFd;                   // the fd of /proc/<pid>/io (-1 if it is not readable)
+	unsigned long long ticks;   // utime + stime of the previous sample
+	struct timespec time;       // the time of the previous sample
+	int seen;                   // 1 if the task is still alive in the current refresh
+} JobSample;
+
+// the values read from /proc/<pid> in one sample
+typedef struct JobUsage {
+	char state;                 // the state in /proc/<pid>/stat (e.g. 'R', 'S', 'Z')
+	unsigned long long ticks;   // utime + stime in clock ticks
+	long long rss;              // VmRSS in bytes (-1 if it is not available)
+	long threads;               // the number of threads (-1 if it is not available)
+	long long readBytes;        // rchar of /proc/<pid>/io (-1 if it is not available)
+	long long writeBytes;       // wchar of /proc/<pid>/io (-1 if it is not available)
+} JobUsage;
+
+void freeJobSamples(void);
+
+int checkJobtopArgs(char** argv);
+
+int runJobtop(char** argv);
+
+#endif
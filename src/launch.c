@@ -0,0 +1,429 @@
+/*
+FileName:    launch.c
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: It parse the launch settings of jobs (resource limits, nice value, I/O priority and CPU affinity),
+             and apply them in the child process just before exec(), so the shell itself is never limited.
+             The settings are given by the built-in "ulimit" (for every later job) or the prefix "limit" (for one command).
+Remark:      function implemented in this file:
+             1. Built-in command: ulimit: ALL
+             2. Prefix "limit" of command: ALL (the prefix is parsed in ast.c)
+*/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "launch.h"
+
+// the arguments of ioprio_set() (see linux/ioprio.h)
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_SHIFT 13
+
+// the settings given by "ulimit", they are applied to every job before the settings of "limit"
+LaunchLimits shellLimits = {0};
+
+/*
+Parse a size with an optional suffix K, M or G (e.g. "512M"), or "unlimited".
+
+@param value The size
+@param size The parsed size in bytes
+
+@return 0 if success, -1 if it is invalid
+*/
+int parseSize(char* value, rlim_t* size) {
+	if (strcmp(value, "unlimited") == 0) {
+		*size = RLIM_INFINITY;
+		return 0;
+	}
+	char* end = NULL;
+	errno = 0;
+	unsigned long long number = strtoull(value, &end, 10);
+	if (errno != 0 || end == value || value[0] == '-') {
+		return -1;
+	}
+	int shift = 0;
+	switch (*end) {
+		case 'K': case 'k': shift = 10; end++; break;
+		case 'M': case 'm': shift = 20; end++; break;
+		case 'G': case 'g': shift = 30; end++; break;
+	}
+	if (*end != '\0' || number > (RLIM_INFINITY >> shift)) {
+		return -1;
+	}
+	*size = (rlim_t) number << shift;
+	return 0;
+}
+
+/*
+Parse an integer in a range.
+
+@param value The integer
+@param low The minimum value
+@param high The maximum value
+@param number The parsed integer
+
+@return 0 if success, -1 if it is invalid
+*/
+int parseInteger(char* value, int low, int high, int* number) {
+	char* end = NULL;
+	long parsed = strtol(value, &end, 10);
+	if (end == value || *end != '\0' || parsed < low || parsed > high) {
+		return -1;
+	}
+	*number = (int) parsed;
+	return 0;
+}
+
+/*
+Parse a list of CPUs (e.g. "0,2-3") into a bitmap.
+
+@param value The list
+@param cpus The bitmap
+
+@return 0 if success, -1 if it is invalid
+*/
+int parseCpuList(char* value, unsigned char* cpus) {
+	memset(cpus, 0, max_num_of_cpus / 8);
+	char* p = value;
+	while (*p != '\0') {
+		char* end = NULL;
+		long low = strtol(p, &end, 10);
+		long high = low;
+		if (end == p) {
+			return -1;
+		}
+		if (*end == '-') {
+			p = end + 1;
+			high = strtol(p, &end, 10);
+			if (end == p) {
+				return -1;
+			}
+		}
+		if (low < 0 || high < low || high >= max_num_of_cpus || (*end != ',' && *end != '\0')) {
+			return -1;
+		}
+		for (long cpu = low; cpu <= high; cpu++) {
+			cpus[cpu / 8] |= 1 << (cpu % 8);
+		}
+		p = *end == ',' ? end + 1 : end;
+	}
+	return 0;
+}
+
+/*
+Parse an I/O priority, i.e. "idle", "be:LEVEL" (best-effort) or "rt:LEVEL" (realtime), LEVEL is 0 (highest) to 7.
+
+@param value The I/O priority
+@param limits The settings
+
+@return 0 if success, -1 if it is invalid
+*/
+int parseIoPriority(char* value, LaunchLimits* limits) {
+	limits->ioLevel = 0;
+	if (strcmp(value, "idle") == 0) {
+		limits->ioClass = 3;
+		return 0;
+	}
+	if (strncmp(value, "be", 2) == 0) {
+		limits->ioClass = 2;
+	}
+	else if (strncmp(value, "rt", 2) == 0) {
+		limits->ioClass = 1;
+	}
+	else {
+		return -1;
+	}
+	if (value[2] == '\0') {
+		limits->ioLevel = 4;
+		return 0;
+	}
+	return value[2] == ':' ? parseInteger(&value[3], 0, 7, &limits->ioLevel) : -1;
+}
+
+/*
+Parse a launch setting "KEY=VALUE" into the settings.
+KEY is one of cpu (seconds), as (bytes of address space, e.g. 512M), nofile, nice, io (idle, be:N, rt:N) and cpus (e.g. 0,2-3).
+The rlimits accept "unlimited".
+
+@param setting The setting (e.g. "nice=10")
+@param limits The settings
+
+@return 1 if it is parsed, 0 if it is not a setting (i.e. it is the command), -1 if the value is invalid (the message is printed)
+*/
+int parseLimit(char* setting, LaunchLimits* limits) {
+	char* value = strchr(setting, '=');
+	if (value == NULL) {
+		return 0;
+	}
+	int keyLength = value - setting;
+	value++;
+	int flag = 0;
+	int result = -1;
+	if (keyLength == 3 && strncmp(setting, "cpu", 3) == 0) {
+		flag = LIMIT_CPU;
+		result = parseSize(value, &limits->cpu);
+		// the CPU time is given in seconds, suffixes make no sense here
+		if (result == 0 && limits->cpu != RLIM_INFINITY && strpbrk(value, "KkMmGg") != NULL) {
+			result = -1;
+		}
+	}
+	else if (keyLength == 2 && strncmp(setting, "as", 2) == 0) {
+		flag = LIMIT_AS;
+		result = parseSize(value, &limits->as);
+	}
+	else if (keyLength == 6 && strncmp(setting, "nofile", 6) == 0) {
+		flag = LIMIT_NOFILE;
+		result = parseSize(value, &limits->nofile);
+	}
+	else if (keyLength == 4 && strncmp(setting, "nice", 4) == 0) {
+		flag = LIMIT_NICE;
+		result = parseInteger(value, -20, 19, &limits->nice);
+	}
+	else if (keyLength == 2 && strncmp(setting, "io", 2) == 0) {
+		flag = LIMIT_IO;
+		result = parseIoPriority(value, limits);
+	}
+	else if (keyLength == 4 && strncmp(setting, "cpus", 4) == 0) {
+		flag = LIMIT_CPUS;
+		result = parseCpuList(value, limits->cpus);
+	}
+	else {
+		return 0;
+	}
+	if (result == -1) {
+		printf("3230shell: limit: invalid value of \"%.*s\": %s\n", keyLength, setting, value);
+		return -1;
+	}
+	limits->flags |= flag;
+	return 1;
+}
+
+/*
+Copy the given settings of $(source) into $(target).
+
+@param target The settings to be changed
+@param source The settings to be copied
+
+@return void
+*/
+void mergeLimits(LaunchLimits* target, LaunchLimits* source) {
+	if (source->flags & LIMIT_CPU) {
+		target->cpu = source->cpu;
+	}
+	if (source->flags & LIMIT_AS) {
+		target->as = source->as;
+	}
+	if (source->flags & LIMIT_NOFILE) {
+		target->nofile = source->nofile;
+	}
+	if (source->flags & LIMIT_NICE) {
+		target->nice = source->nice;
+	}
+	if (source->flags & LIMIT_IO) {
+		target->ioClass = source->ioClass;
+		target->ioLevel = source->ioLevel;
+	}
+	if (source->flags & LIMIT_CPUS) {
+		memcpy(target->cpus, source->cpus, sizeof(target->cpus));
+	}
+	target->flags |= source->flags;
+}
+
+/*
+Set a resource limit (both soft and hard limits) of the current process.
+
+@param resource The resource (e.g. RLIMIT_CPU)
+@param value The limit
+@param name The name of setting for the error message
+
+@return void
+*/
+void setLimit(int resource, rlim_t value, char* name) {
+	struct rlimit limit;
+	getrlimit(resource, &limit);
+	// the hard limit could not be raised without privilege, so an unlimited setting only raise the soft limit
+	limit.rlim_cur = value;
+	if (value != RLIM_INFINITY || limit.rlim_max == RLIM_INFINITY) {
+		limit.rlim_max = value;
+	}
+	else {
+		limit.rlim_cur = limit.rlim_max;
+	}
+	if (setrlimit(resource, &limit) == -1) {
+		char message[64];
+		snprintf(message, sizeof(message), "3230shell: limit %s", name);
+		perror(message);
+	}
+}
+
+/*
+Apply the settings of "ulimit" and the settings of a command (the latter take precedence) to the current process.
+It is called in the child process just before exec(), a setting that fail is reported and skipped.
+
+@param limits The settings of command ("limit" prefix, NULL if none)
+
+@return void
+*/
+void applyLimits(LaunchLimits* limits) {
+	LaunchLimits merged = shellLimits;
+	if (limits != NULL) {
+		mergeLimits(&merged, limits);
+	}
+	if (merged.flags & LIMIT_CPU) {
+		setLimit(RLIMIT_CPU, merged.cpu, "cpu");
+	}
+	if (merged.flags & LIMIT_AS) {
+		setLimit(RLIMIT_AS, merged.as, "as");
+	}
+	if (merged.flags & LIMIT_NOFILE) {
+		setLimit(RLIMIT_NOFILE, merged.nofile, "nofile");
+	}
+	if ((merged.flags & LIMIT_NICE) && setpriority(PRIO_PROCESS, 0, merged.nice) == -1) {
+		perror("3230shell: limit nice");
+	}
+	if ((merged.flags & LIMIT_IO) && syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, (merged.ioClass << IOPRIO_CLASS_SHIFT) | merged.ioLevel) == -1) {
+		perror("3230shell: limit io");
+	}
+	if (merged.flags & LIMIT_CPUS) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (int cpu = 0; cpu < max_num_of_cpus && cpu < CPU_SETSIZE; cpu++) {
+			if (merged.cpus[cpu / 8] & (1 << (cpu % 8))) {
+				CPU_SET(cpu, &set);
+			}
+		}
+		if (sched_setaffinity(0, sizeof(cpu_set_t), &set) == -1) {
+			perror("3230shell: limit cpus");
+		}
+	}
+}
+
+/*
+Detect the errors of the arguments of "ulimit", i.e. "ulimit", "ulimit reset" or "ulimit KEY=VALUE...".
+
+@param argv The argument vector (e.g. {"ulimit", "nice=10", NULL})
+
+@return 1 if there is error (the message is printed), 0 otherwise
+*/
+int checkUlimitArgs(char** argv) {
+	if (argv[1] != NULL && strcmp(argv[1], "reset") == 0 && argv[2] == NULL) {
+		return 0;
+	}
+	LaunchLimits limits;
+	memset(&limits, 0, sizeof(LaunchLimits));
+	for (int i = 1; argv[i] != NULL; i++) {
+		int result = parseLimit(argv[i], &limits);
+		if (result == 0) {
+			printf("3230shell: ulimit: usage: ulimit [reset | KEY=VALUE...], KEY is cpu, as, nofile, nice, io or cpus\n");
+		}
+		if (result != 1) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+Print a resource limit.
+
+@param name The description of limit
+@param given 1 if it is given by "ulimit"
+@param value The limit given by "ulimit"
+@param resource The resource (its current limit is printed if it is not given)
+
+@return void
+*/
+void printLimit(char* name, int given, rlim_t value, int resource) {
+	struct rlimit limit;
+	if (given == 0) {
+		getrlimit(resource, &limit);
+		value = limit.rlim_cur;
+	}
+	if (value == RLIM_INFINITY) {
+		printf("%-24s%s\n", name, "unlimited");
+	}
+	else {
+		printf("%-24s%llu\n", name, (unsigned long long) value);
+	}
+}
+
+/*
+The built-in command "ulimit".
+"ulimit" print the settings that every job is launched with (the settings of shell if it is not given),
+"ulimit KEY=VALUE..." change them, and "ulimit reset" forget them.
+The shell itself is not affected, the settings are only applied to the child processes.
+
+@param argv The argument vector (it is checked by checkUlimitArgs())
+
+@return void
+*/
+void runUlimit(char** argv) {
+	if (argv[1] != NULL && strcmp(argv[1], "reset") == 0) {
+		memset(&shellLimits, 0, sizeof(LaunchLimits));
+		return;
+	}
+	if (argv[1] != NULL) {
+		LaunchLimits limits;
+		memset(&limits, 0, sizeof(LaunchLimits));
+		for (int i = 1; argv[i] != NULL; i++) {
+			parseLimit(argv[i], &limits);
+		}
+		mergeLimits(&shellLimits, &limits);
+		return;
+	}
+	printLimit("cpu (seconds)", shellLimits.flags & LIMIT_CPU, shellLimits.cpu, RLIMIT_CPU);
+	printLimit("as (bytes)", shellLimits.flags & LIMIT_AS, shellLimits.as, RLIMIT_AS);
+	printLimit("nofile", shellLimits.flags & LIMIT_NOFILE, shellLimits.nofile, RLIMIT_NOFILE);
+	printf("%-24s%d\n", "nice", shellLimits.flags & LIMIT_NICE ? shellLimits.nice : getpriority(PRIO_PROCESS, 0));
+	char* classes[] = {"none", "rt", "be", "idle"};
+	if (shellLimits.flags & LIMIT_IO) {
+		printf("%-24s%s:%d\n", "io", classes[shellLimits.ioClass], shellLimits.ioLevel);
+	}
+	else {
+		printf("%-24s%s\n", "io", "inherit");
+	}
+	// print the CPUs as a list of ranges (e.g. "0-3,6")
+	unsigned char cpus[max_num_of_cpus / 8];
+	if (shellLimits.flags & LIMIT_CPUS) {
+		memcpy(cpus, shellLimits.cpus, sizeof(cpus));
+	}
+	else {
+		cpu_set_t set;
+		memset(cpus, 0, sizeof(cpus));
+		if (sched_getaffinity(0, sizeof(cpu_set_t), &set) == 0) {
+			for (int cpu = 0; cpu < max_num_of_cpus && cpu < CPU_SETSIZE; cpu++) {
+				if (CPU_ISSET(cpu, &set)) {
+					cpus[cpu / 8] |= 1 << (cpu % 8);
+				}
+			}
+		}
+	}
+	printf("%-24s", "cpus");
+	int first = 1;
+	for (int cpu = 0; cpu < max_num_of_cpus; cpu++) {
+		if ((cpus[cpu / 8] & (1 << (cpu % 8))) == 0) {
+			continue;
+		}
+		int end = cpu;
+		while (end + 1 < max_num_of_cpus && (cpus[(end + 1) / 8] & (1 << ((end + 1) % 8)))) {
+			end++;
+		}
+		printf(first ? "%d" : ",%d", cpu);
+		if (end > cpu) {
+			printf("-%d", end);
+		}
+		first = 0;
+		cpu = end;
+	}
+	printf("\n");
+}
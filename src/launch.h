@@ -0,0 +1,43 @@
+/*
+FileName:    launch.h
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: Hold the function header of launch.c, provide self defined structure.
+Remark:      None of function is implemented in this file.
+*/
+
+#include <sys/resource.h>
+
+#ifndef LAUNCH_H
+#define LAUNCH_H
+
+// the maximum number of CPUs in the affinity mask
+#define max_num_of_cpus 1024
+
+// the settings that are given in LaunchLimits
+enum LimitFlag {LIMIT_CPU = 1, LIMIT_AS = 2, LIMIT_NOFILE = 4, LIMIT_NICE = 8, LIMIT_IO = 16, LIMIT_CPUS = 32};
+
+// the settings applied to a child process before exec() (e.g. "limit cpu=10 nice=5 cpus=0-1 make")
+typedef struct LaunchLimits {
+	int flags;          // the settings that are given (LimitFlag)
+	rlim_t cpu;         // RLIMIT_CPU in seconds
+	rlim_t as;          // RLIMIT_AS in bytes
+	rlim_t nofile;      // RLIMIT_NOFILE
+	int nice;           // the nice value (-20 to 19)
+	int ioClass;        // the I/O scheduling class (1 realtime, 2 best-effort, 3 idle)
+	int ioLevel;        // the I/O priority in the class (0 to 7)
+	unsigned char cpus[max_num_of_cpus / 8];    // bitmap of the CPUs that the process could run on
+} LaunchLimits;
+
+int parseSize(char* value, rlim_t* size);
+
+int parseLimit(char* setting, LaunchLimits* limits);
+
+void applyLimits(LaunchLimits* limits);
+
+int checkUlimitArgs(char** argv);
+
+void runUlimit(char** argv);
+
+#endif
@@ -28,34 +28,41 @@ Insert a node to the head of linklist.
 @param head The head of link list
 @param pid The pid of node
 @param cmd The command of the node
+@param start The time that the process is forked
+@param background 1 if the process is in a background job
+@param pgid The process group of job (0 if it is in the group of shell)
 
 @return void
 */
-void headInsert(Node** head, pid_t pid, char* cmd) {
+void headInsert(Node** head, pid_t pid, char* cmd, struct timespec start, int background, pid_t pgid) {
 	Node* p = (Node*) malloc(sizeof(Node));
 	p->pid = pid;
 	p->cmd = (char*) malloc(max_length_of_command*sizeof(char));
 	memset(p->cmd, 0, max_length_of_command*sizeof(char));
 	stpcpy(p->cmd, cmd);
+	p->start = start;
+	p->done = 0;
+	p->background = background;
+	p->pgid = pgid;
 	p->next = (*head);
 	(*head) = p;
 }
 
 /*
-Search the cmd of a pid.
+Search the node of a pid.
 
 @param head The head of link list
 @param pid The pid of node
 
-@return cmd The command of the node
+@return node The node (NULL if not found)
 */
-char* searchName(Node** head, pid_t pid)
+Node* searchNode(Node** head, pid_t pid)
 {
     Node * current = (*head);
 	while (current != NULL)
 	{
 		if (current->pid == pid) {
-			return current->cmd;
+			return current;
 		}
 		current = current->next;
 	}
@@ -63,7 +70,43 @@ char* searchName(Node** head, pid_t pid)
 }
 
 /*
-kill all process recorded in the link list.
+Search the cmd of a pid.
+
+@param head The head of link list
+@param pid The pid of node
+
+@return cmd The command of the node
+*/
+char* searchName(Node** head, pid_t pid)
+{
+	Node * node = searchNode(head, pid);
+	if (node != NULL) {
+		return node->cmd;
+	}
+	return NULL;
+}
+
+/*
+Count the nodes in the link list.
+
+@param head The head of link list
+
+@return count The number of nodes
+*/
+long countList(Node** head)
+{
+	long count = 0;
+	Node * current = (*head);
+	while (current != NULL)
+	{
+		count++;
+		current = current->next;
+	}
+	return count;
+}
+
+/*
+kill all process recorded in the link list, the reaped processes are skipped (their pids may be reused).
 
 @param head The head of link list
 
@@ -74,7 +117,9 @@ void killAll(Node** head)
 	Node * current = (*head);
 	while (current != NULL)
 	{
-		kill(current->pid, SIGKILL);
+		if (current->done == 0) {
+			kill(current->pid, SIGKILL);
+		}
 		current = current->next;
 	}
 }
@@ -8,6 +8,7 @@ Remark:      None of function is implemented in this file.
 */
 
 #include <sys/types.h>
+#include <time.h>
 
 #ifndef LINKLIST_H
 #define LINKLIST_H
@@ -17,13 +18,21 @@ typedef struct Node
 {
 	pid_t pid;
 	char* cmd;
+	struct timespec start;
+	int done;       // 1 if the process is reaped (its pid may be reused)
+	int background; // 1 if the process is in a background job (it is reaped by the handler of SIGCHLD)
+	pid_t pgid;     // the process group of job (0 if it is in the group of shell)
 	struct Node * next;
 } Node;
 
-void headInsert(Node** head, pid_t pid, char* cmd);
+void headInsert(Node** head, pid_t pid, char* cmd, struct timespec start, int background, pid_t pgid);
+
+Node* searchNode(Node** head, pid_t pid);
 
 char* searchName(Node** head, pid_t pid);
 
+long countList(Node** head);
+
 void killAll(Node** head);
 
 void freeList(Node** head);
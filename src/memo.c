@@ -0,0 +1,536 @@
+/*
+FileName:    memo.c
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: The prefix "memo pipeline" that cache the output of a deterministic pipeline on disk (e.g. "memo ./report.sh 2023 | sort").
+             The key is made of the working directory, the selected environment ($PATH, $HOME, $LANG, $TZ, $LC_* ...),
+             and for each command the identity (device, inode, size and mtime) of its executable, its expanded arguments and assignments,
+             and the identity of the files it read by "<" or name in its arguments.
+             An entry is named by the hash of key in $MEMODIR (~/.3230shell_memo by default), and hold the exit status, the key and the output.
+             A hit copy the output to the standard output by sendfile() without launching anything.
+             A miss launch the pipeline as usual with the output captured into a new entry,
+             the shell watch the entry by inotify while waiting, and copy the output to the standard output as it is written.
+             The entries are used in LRU order (the mtime is updated on a hit), and the oldest are removed when the total size exceed $MEMOSIZE.
+             A pipeline that write a file by ">" or ">>", read a here-document with expansion, or copy an fd of the shell (e.g. "<&${BC[0]}"),
+             is run without the cache. So is a pipeline whose first command read the standard input of shell (e.g. "memo sort" read the terminal),
+             unless it is /dev/null (e.g. "memo ./report.sh 2023 < /dev/null").
+Remark:      function implemented in this file:
+             1. Prefix "memo" of pipeline: ALL (the pipeline is launched by executePipeline() in task.c)
+*/
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "ast.h"
+#include "cache.h"
+#include "joblog.h"
+#include "launch.h"
+#include "memo.h"
+#include "shellstat.h"
+
+// a global variable that store the counters of the shell since startup
+extern ShellStat shellStat;
+
+// the environment variables that are part of the key, besides the assignments before command
+char* memoEnvironment[] = {"PATH", "HOME", "USER", "LANG", "LANGUAGE", "TZ", "LC_ALL", "LC_COLLATE", "LC_CTYPE", "LC_MESSAGES", "LC_NUMERIC", "LC_TIME", NULL};
+
+// an entry of the memo cache, it is used to remove the least recently used entries
+typedef struct MemoFile {
+	char name[256];
+	long size;
+	struct timespec used;
+} MemoFile;
+
+/*
+Get the directory of memo cache ($MEMODIR, or ~/.3230shell_memo), it is created if it does not exist.
+
+@param void
+
+@return dir The directory (free it by free()), NULL if there is no directory
+*/
+char* memoDirectory(void) {
+	char* dir = NULL;
+	char* home = getenv("HOME");
+	if (getenv("MEMODIR") != NULL) {
+		dir = strdup(getenv("MEMODIR"));
+	}
+	else if (home != NULL) {
+		// sizeof() count the '\0'
+		dir = (char*) malloc(strlen(home) + sizeof("/.3230shell_memo"));
+		sprintf(dir, "%s/.3230shell_memo", home);
+	}
+	else {
+		return NULL;
+	}
+	if (mkdir(dir, 0700) == -1 && errno != EEXIST) {
+		char temp[strlen(dir) + 24];
+		snprintf(temp, sizeof(temp), "3230shell: memo: '%s'", dir);
+		perror(temp);
+		free(dir);
+		return NULL;
+	}
+	return dir;
+}
+
+/*
+Append a field to the key of memo, the fields are separated by '\0'.
+
+@param memo The memo
+@param data The field
+@param length The length of field
+
+@return void
+*/
+void appendKey(Memo* memo, char* data, int length) {
+	if (memo->keyLength + length + 1 > memo->keyCapacity) {
+		while (memo->keyLength + length + 1 > memo->keyCapacity) {
+			memo->keyCapacity = memo->keyCapacity > 0 ? memo->keyCapacity * 2 : 1024;
+		}
+		memo->key = (char*) realloc(memo->key, memo->keyCapacity);
+	}
+	memcpy(&memo->key[memo->keyLength], data, length);
+	memo->key[memo->keyLength + length] = '\0';
+	memo->keyLength += length + 1;
+}
+
+/*
+Append the identity of a file (device, inode, size and mtime) to the key of memo, so the key change when the file is changed.
+
+@param memo The memo
+@param info The status of file
+
+@return void
+*/
+void appendIdentity(Memo* memo, struct stat* info) {
+	char identity[128];
+	int length = snprintf(identity, sizeof(identity), "%lu:%lu:%ld:%ld.%09ld", (unsigned long) info->st_dev, (unsigned long) info->st_ino,
+		(long) info->st_size, (long) info->st_mtim.tv_sec, info->st_mtim.tv_nsec);
+	appendKey(memo, identity, length);
+}
+
+/*
+Free a memo, the entry that is being written (on a miss) is removed.
+
+@param memo The memo
+
+@return NULL to NULL the memo
+*/
+Memo* freeMemo(Memo* memo) {
+	if (memo->fd != -1) {
+		close(memo->fd);
+	}
+	if (memo->watch != -1) {
+		close(memo->watch);
+	}
+	if (memo->temp != NULL) {
+		unlink(memo->temp);
+	}
+	free(memo->temp);
+	free(memo->path);
+	free(memo->key);
+	free(memo);
+	return NULL;
+}
+
+/*
+Build the key of a pipeline after its arguments are expanded and its redirections are opened.
+
+@param memo The memo
+@param stages The commands
+@param stageNum The number of commands
+@param paths The command with path of each command
+@param argvs The expanded argument vector of each command
+@param assigned The expanded assignments of each command (NULL if none)
+@param redirectFds The fds of redirections of each command (NULL if none)
+
+@return 0 if success, -1 if the pipeline could not be memoized
+*/
+int buildMemoKey(Memo* memo, Stage* stages, int stageNum, char** paths, char*** argvs, char*** assigned, int** redirectFds) {
+	// 1 if the standard input of the first command is redirected
+	int input = 0;
+	char cwd[4096];
+	if (getcwd(cwd, sizeof(cwd)) == NULL) {
+		return -1;
+	}
+	appendKey(memo, cwd, strlen(cwd));
+	for (int i = 0; memoEnvironment[i] != NULL; i++) {
+		char* value = getenv(memoEnvironment[i]);
+		appendKey(memo, value != NULL ? value : "", value != NULL ? strlen(value) : 0);
+	}
+	for (int i = 0; i < stageNum; i++) {
+		appendKey(memo, "|", 1);
+		// the executable is the same one that execvp() would run
+		char* path = strchr(paths[i], '/') != NULL ? strdup(paths[i]) : resolveCommand(paths[i]);
+		struct stat info;
+		if (path == NULL || stat(path, &info) == -1) {
+			free(path);
+			return -1;
+		}
+		appendKey(memo, path, strlen(path));
+		appendIdentity(memo, &info);
+		free(path);
+		// an argument that name a file or directory (e.g. "sort data.csv") is identified by the file too
+		for (int j = 1; argvs[i][j] != NULL; j++) {
+			appendKey(memo, argvs[i][j], strlen(argvs[i][j]));
+			if (stat(argvs[i][j], &info) == 0) {
+				appendIdentity(memo, &info);
+			}
+		}
+		for (int j = 0; assigned[i] != NULL && assigned[i][j] != NULL; j++) {
+			appendKey(memo, assigned[i][j], strlen(assigned[i][j]));
+		}
+		for (int j = 0; j < stages[i].redirectNum; j++) {
+			Redirect* redirect = &stages[i].redirects[j];
+			char target[16];
+			appendKey(memo, target, snprintf(target, sizeof(target), "%d<>", redirect->fd));
+			// the output written to a file is not replayed
+			if (redirect->type == REDIRECT_OUTPUT || redirect->type == REDIRECT_APPEND) {
+				return -1;
+			}
+			// the input file is identified by the file that is opened
+			if (redirect->type == REDIRECT_INPUT) {
+				if (fstat(redirectFds[i][j], &info) == -1) {
+					return -1;
+				}
+				appendIdentity(memo, &info);
+			}
+			// a copy of an fd of the shell (e.g. the pipe of a coprocess) could not be replayed,
+			// only the standard output and error (e.g. "2>&1") or an fd redirected earlier by the command (e.g. "3<data <&3") are copied
+			else if (redirect->type == REDIRECT_DUPLICATE) {
+				int known = redirectFds[i][j] <= STDERR_FILENO && redirect->fd != STDIN_FILENO;
+				for (int k = 0; k < j; k++) {
+					if (stages[i].redirects[k].fd == redirectFds[i][j]) {
+						known = 1;
+					}
+				}
+				if (known == 0) {
+					return -1;
+				}
+				appendKey(memo, target, snprintf(target, sizeof(target), "&%d", redirectFds[i][j]));
+			}
+			// the body of here-document is only known before expansion
+			else if (redirect->expand == 1) {
+				return -1;
+			}
+			else {
+				appendKey(memo, redirect->word, strlen(redirect->word));
+			}
+			if (i == 0 && redirect->fd == STDIN_FILENO) {
+				input = 1;
+			}
+		}
+	}
+	// the standard input of shell is not part of the key (e.g. "memo sort" read the terminal or a pipe), only /dev/null is always the same
+	struct stat info;
+	struct stat null;
+	if (input == 0 && (fstat(STDIN_FILENO, &info) == -1 || stat("/dev/null", &null) == -1 || !S_ISCHR(info.st_mode) || info.st_rdev != null.st_rdev)) {
+		return -1;
+	}
+	return 0;
+}
+
+/*
+Look up the output of a pipeline with prefix "memo" in the cache, it is called after the arguments are expanded.
+On a hit, the entry is opened to be replayed by closeMemo().
+On a miss, a new entry is created, and the output of the last command should be captured into $(memo->fd),
+the processes are waited by waitMemo() so the output is copied to $(target) as it is written.
+
+@param stages The commands
+@param stageNum The number of commands
+@param paths The command with path of each command
+@param argvs The expanded argument vector of each command
+@param assigned The expanded assignments of each command (NULL if none)
+@param redirectFds The fds of redirections of each command (NULL if none)
+@param target The fd that the output is written to (e.g. the standard output)
+
+@return memo The memo (free it by closeMemo()), NULL if the pipeline is run without cache
+*/
+Memo* openMemo(Stage* stages, int stageNum, char** paths, char*** argvs, char*** assigned, int** redirectFds, int target) {
+	Memo* memo = (Memo*) malloc(sizeof(Memo));
+	memset(memo, 0, sizeof(Memo));
+	memo->fd = -1;
+	memo->watch = -1;
+	memo->target = target;
+	if (buildMemoKey(memo, stages, stageNum, paths, argvs, assigned, redirectFds) == -1) {
+		return freeMemo(memo);
+	}
+	char* dir = memoDirectory();
+	if (dir == NULL) {
+		return freeMemo(memo);
+	}
+	// the entry is named by two FNV-1a hashes of the key (the second one over the key in reverse)
+	unsigned long hash = 14695981039346656037UL;
+	unsigned long reverse = 14695981039346656037UL;
+	for (int i = 0; i < memo->keyLength; i++) {
+		hash = (hash ^ (unsigned char) memo->key[i]) * 1099511628211UL;
+		reverse = (reverse ^ (unsigned char) memo->key[memo->keyLength - 1 - i]) * 1099511628211UL;
+	}
+	memo->path = (char*) malloc(strlen(dir) + 48);
+	sprintf(memo->path, "%s/%016lx%016lx", dir, hash, reverse);
+	free(dir);
+	// a hit: the header and the key are the same
+	memo->fd = open(memo->path, O_RDONLY | O_CLOEXEC);
+	if (memo->fd != -1) {
+		MemoHeader header;
+		char* key = (char*) malloc(memo->keyLength);
+		if (read(memo->fd, &header, sizeof(header)) == sizeof(header) && memcmp(header.magic, "3230memo", 8) == 0
+			&& header.keyLength == memo->keyLength && read(memo->fd, key, memo->keyLength) == memo->keyLength
+			&& memcmp(key, memo->key, memo->keyLength) == 0) {
+			memo->hit = 1;
+			memo->status = header.status;
+			// the mtime is the time of last use
+			futimens(memo->fd, NULL);
+		}
+		free(key);
+		if (memo->hit == 1) {
+			shellStat.memoHits += 1;
+			return memo;
+		}
+		close(memo->fd);
+	}
+	// a miss: the output is captured into a new entry, it replace the old one when the pipeline finish
+	shellStat.memoMisses += 1;
+	memo->temp = (char*) malloc(strlen(memo->path) + 32);
+	sprintf(memo->temp, "%s.%d.tmp", memo->path, (int) getpid());
+	memo->fd = open(memo->temp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (memo->fd == -1) {
+		char temp[strlen(memo->temp) + 24];
+		snprintf(temp, sizeof(temp), "3230shell: memo: '%s'", memo->temp);
+		perror(temp);
+		free(memo->temp);
+		memo->temp = NULL;
+		return freeMemo(memo);
+	}
+	MemoHeader header = {{0}, -1, memo->keyLength};
+	memcpy(header.magic, "3230memo", 8);
+	if (write(memo->fd, &header, sizeof(header)) != sizeof(header) || write(memo->fd, memo->key, memo->keyLength) != memo->keyLength) {
+		perror("3230shell: memo");
+		return freeMemo(memo);
+	}
+	// the output is copied out when the entry is modified (if inotify is not available, it is copied when each process finish)
+	memo->copied = sizeof(header) + memo->keyLength;
+	memo->watch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (memo->watch != -1 && inotify_add_watch(memo->watch, memo->temp, IN_MODIFY) == -1) {
+		close(memo->watch);
+		memo->watch = -1;
+	}
+	return memo;
+}
+
+/*
+Copy the output in an entry to a fd by sendfile() (without copying it through the shell), or by read() and write() if it is not supported.
+
+@param fd The entry
+@param offset The offset of output
+@param target The fd to write to
+
+@return offset The offset that the output is copied to
+*/
+off_t replayMemo(int fd, off_t offset, int target) {
+	struct stat info;
+	if (fstat(fd, &info) == -1) {
+		return offset;
+	}
+	while (offset < info.st_size) {
+		ssize_t count = sendfile(target, fd, &offset, info.st_size - offset);
+		if (count > 0) {
+			continue;
+		}
+		if (count == -1 && errno == EINTR) {
+			continue;
+		}
+		// e.g. the target is opened with O_APPEND on an old kernel
+		if (count == -1 && (errno == EINVAL || errno == ENOSYS)) {
+			char block[65536];
+			while ((count = pread(fd, block, sizeof(block), offset)) > 0) {
+				if (write(target, block, count) != count) {
+					return offset;
+				}
+				offset += count;
+			}
+		}
+		return offset;
+	}
+	return offset;
+}
+
+/*
+Copy the output that is captured into the entry since the last copy to the target (on a miss).
+
+@param memo The memo
+
+@return void
+*/
+void teeMemo(Memo* memo) {
+	fflush(stdout);
+	memo->copied = replayMemo(memo->fd, memo->copied, memo->target);
+}
+
+/*
+Wait for a process of a pipeline to finish.
+If the pipeline is memoized and missed, its output is copied to the target whenever the entry is modified, so it is displayed live.
+The output of background jobs is read meanwhile (see waitDrainingJobLogs()).
+
+@param memo The memo (NULL if not memoized)
+@param pid The process
+
+@return void
+*/
+void waitMemo(Memo* memo, pid_t pid) {
+	if (memo == NULL || memo->hit == 1) {
+		waitDrainingJobLogs(pid);
+		return;
+	}
+	int pidfd = syscall(SYS_pidfd_open, pid, 0);
+	if (pidfd == -1) {
+		waitDrainingJobLogs(pid);
+		teeMemo(memo);
+		return;
+	}
+	// fds[1] is -1 (ignored) if inotify is not available, fds[2] is -1 if no background job is logged
+	struct pollfd fds[3];
+	fds[0].fd = pidfd;
+	fds[0].events = POLLIN;
+	fds[1].fd = memo->watch;
+	fds[1].events = POLLIN;
+	fds[2].events = POLLIN;
+	while (1) {
+		fds[2].fd = jobLogFd();
+		if (poll(fds, 3, -1) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		if ((fds[1].revents & POLLIN) != 0) {
+			char events[4096];
+			while (read(memo->watch, events, sizeof(events)) > 0) {
+				continue;
+			}
+			teeMemo(memo);
+		}
+		if ((fds[2].revents & POLLIN) != 0) {
+			drainJobLogs();
+		}
+		if (fds[0].revents != 0) {
+			break;
+		}
+	}
+	close(pidfd);
+	teeMemo(memo);
+}
+
+/*
+Compare the entries by the time of last use, the oldest first.
+
+@param a The first entry
+@param b The second entry
+
+@return result Negative if $(a) is used earlier
+*/
+int compareMemoFiles(const void* a, const void* b) {
+	const MemoFile* x = (const MemoFile*) a;
+	const MemoFile* y = (const MemoFile*) b;
+	if (x->used.tv_sec != y->used.tv_sec) {
+		return x->used.tv_sec < y->used.tv_sec ? -1 : 1;
+	}
+	return x->used.tv_nsec < y->used.tv_nsec ? -1 : (x->used.tv_nsec > y->used.tv_nsec);
+}
+
+/*
+Remove the least recently used entries until the total size is within $MEMOSIZE (256M by default).
+
+@param dir The directory of memo cache
+
+@return void
+*/
+void trimMemoCache(char* dir) {
+	rlim_t limit = memo_cache_size;
+	if (getenv("MEMOSIZE") != NULL && parseSize(getenv("MEMOSIZE"), &limit) == -1) {
+		limit = memo_cache_size;
+	}
+	DIR* stream = opendir(dir);
+	if (stream == NULL) {
+		return;
+	}
+	int count = 0;
+	int capacity = 64;
+	long total = 0;
+	MemoFile* files = (MemoFile*) malloc(capacity * sizeof(MemoFile));
+	struct dirent* entry;
+	while ((entry = readdir(stream)) != NULL) {
+		struct stat info;
+		if (entry->d_name[0] == '.' || strlen(entry->d_name) >= sizeof(files[0].name)
+			|| fstatat(dirfd(stream), entry->d_name, &info, AT_SYMLINK_NOFOLLOW) == -1 || !S_ISREG(info.st_mode)) {
+			continue;
+		}
+		if (count == capacity) {
+			capacity *= 2;
+			files = (MemoFile*) realloc(files, capacity * sizeof(MemoFile));
+		}
+		strcpy(files[count].name, entry->d_name);
+		files[count].size = info.st_size;
+		files[count].used = info.st_mtim;
+		total += info.st_size;
+		count++;
+	}
+	if ((rlim_t) total > limit) {
+		qsort(files, count, sizeof(MemoFile), compareMemoFiles);
+		for (int i = 0; i < count && (rlim_t) total > limit; i++) {
+			if (unlinkat(dirfd(stream), files[i].name, 0) == 0) {
+				total -= files[i].size;
+			}
+		}
+	}
+	free(files);
+	closedir(stream);
+}
+
+/*
+Finish a pipeline with prefix "memo", and free the memo.
+On a hit, the output in the entry is replayed.
+On a miss, the rest of captured output is copied, and the entry is put into the cache if the pipeline complete normally.
+
+@param memo The memo
+@param status The exit status of pipeline (on a miss)
+@param store 1 if the pipeline complete normally (not interrupted, timed out or failed to launch), so the entry is kept
+
+@return status The exit status of pipeline (the stored one on a hit)
+*/
+int closeMemo(Memo* memo, int status, int store) {
+	fflush(stdout);
+	if (memo->hit == 1) {
+		status = memo->status;
+		replayMemo(memo->fd, sizeof(MemoHeader) + memo->keyLength, memo->target);
+		freeMemo(memo);
+		return status;
+	}
+	teeMemo(memo);
+	if (store == 1 && pwrite(memo->fd, &status, sizeof(status), offsetof(MemoHeader, status)) == sizeof(status)
+		&& rename(memo->temp, memo->path) == 0) {
+		free(memo->temp);
+		memo->temp = NULL;
+		// the entries are trimmed in the same directory
+		char* slash = strrchr(memo->path, '/');
+		*slash = '\0';
+		trimMemoCache(memo->path);
+	}
+	freeMemo(memo);
+	return status;
+}
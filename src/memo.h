@@ -0,0 +1,48 @@
+/*
+FileName:    memo.h
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: Hold the function header of memo.c, provide self defined structure.
+Remark:      None of function is implemented in this file.
+*/
+
+#include <sys/types.h>
+
+#include "ast.h"
+
+#ifndef MEMO_H
+#define MEMO_H
+
+// the default size of the memo cache on disk ($MEMOSIZE override it), the least recently used entries are removed beyond it
+#define memo_cache_size (256L << 20)
+
+// the header of an entry of the memo cache, it is followed by the key and the output
+typedef struct MemoHeader {
+	char magic[8];          // "3230memo"
+	int status;             // the exit status of pipeline
+	int keyLength;          // the length of key, it is compared on a hit, so a collision of hash is not a hit
+} MemoHeader;
+
+// the lookup of a pipeline with prefix "memo" in the cache
+typedef struct Memo {
+	char* key;              // the key: the working directory, the selected environment, and for each command its executable, arguments, assignments and input files
+	int keyLength;
+	int keyCapacity;
+	char* path;             // the entry in the cache, i.e. "DIR/HASH"
+	char* temp;             // the entry that is being written on a miss (NULL on a hit)
+	int fd;                 // the entry to be replayed on a hit, or the file that capture the output on a miss
+	int target;             // the fd that the output is copied to (e.g. the standard output)
+	int watch;              // the inotify that watch the entry being written (-1 if none)
+	off_t copied;           // the offset in the entry that the output has been copied to (on a miss)
+	int hit;                // 1 if the output is in the cache (nothing is launched)
+	int status;             // the exit status stored in the entry (on a hit)
+} Memo;
+
+Memo* openMemo(Stage* stages, int stageNum, char** paths, char*** argvs, char*** assigned, int** redirectFds, int target);
+
+void waitMemo(Memo* memo, pid_t pid);
+
+int closeMemo(Memo* memo, int status, int store);
+
+#endif
@@ -0,0 +1,386 @@
+/*
+FileName:    pathindex.c
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: An in-memory trie of every executable in the directories of $PATH.
+             It is built at the first use and kept up to date by inotify, so the directories are scanned only once.
+             It serves the tab completion of commands and the search of command path before execution.
+Remark:      function implemented in this file:
+             1. Index of commands in $PATH: ALL
+*/
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "constant.h"
+#include "pathindex.h"
+
+// the index of commands in $PATH (built at the first use)
+PathIndex* pathIndex = NULL;
+
+/*
+Get a child of a trie node by its char, the child is created if necessary.
+
+@param node The index of the node
+@param ch The char
+@param create 1 to create the child if it does not exist
+
+@return child The index of the child (-1 if it does not exist)
+*/
+int trieChild(int node, char ch, int create) {
+	int* link = &pathIndex->nodes[node].child;
+	// the children are sorted, stop at the first child that is not smaller than $(ch)
+	while (*link != -1 && (unsigned char) pathIndex->nodes[*link].ch < (unsigned char) ch) {
+		link = &pathIndex->nodes[*link].sibling;
+	}
+	if (*link != -1 && pathIndex->nodes[*link].ch == ch) {
+		return *link;
+	}
+	if (create == 0) {
+		return -1;
+	}
+	if (pathIndex->nodeNum == pathIndex->capacity) {
+		// $(link) point into the nodes, keep its offset when they are moved
+		long offset = (char*) link - (char*) pathIndex->nodes;
+		pathIndex->capacity *= 2;
+		pathIndex->nodes = (TrieNode*) realloc(pathIndex->nodes, pathIndex->capacity * sizeof(TrieNode));
+		link = (int*) ((char*) pathIndex->nodes + offset);
+	}
+	int child = pathIndex->nodeNum++;
+	pathIndex->nodes[child].ch = ch;
+	pathIndex->nodes[child].dir = -1;
+	pathIndex->nodes[child].child = -1;
+	pathIndex->nodes[child].sibling = *link;
+	*link = child;
+	return child;
+}
+
+/*
+Find the trie node of a name.
+
+@param name The name
+@param create 1 to create the nodes if necessary
+
+@return node The index of the node (-1 if it does not exist)
+*/
+int trieFind(char* name, int create) {
+	int node = 0;
+	for (int i = 0; name[i] != '\0' && node != -1; i++) {
+		node = trieChild(node, name[i], create);
+	}
+	return node;
+}
+
+/*
+Set the directory of a command in the index.
+
+@param node The trie node of the command
+@param dir The index of directory in $PATH (-1 if the command does not exist)
+
+@return void
+*/
+void setCommandDir(int node, int dir) {
+	int old = pathIndex->nodes[node].dir;
+	if (old == dir) {
+		return;
+	}
+	pathIndex->commands += (dir != -1) - (old != -1);
+	pathIndex->nodes[node].dir = dir;
+	pathIndex->generation += 1;
+}
+
+/*
+Check whether a file in a directory is an executable (a regular file, or a symbolic link to it).
+
+@param dirfd The fd of directory
+@param name The name of file
+@param type The d_type of file (DT_UNKNOWN if it is not known)
+
+@return 1 if it is an executable, 0 otherwise
+*/
+int isExecutable(int dirfd, char* name, int type) {
+	if (type != DT_REG && type != DT_LNK && type != DT_UNKNOWN) {
+		return 0;
+	}
+	// the type of the file behind a symbolic link is not known from d_type
+	if (type != DT_REG) {
+		struct stat info;
+		if (fstatat(dirfd, name, &info, 0) == -1 || !S_ISREG(info.st_mode)) {
+			return 0;
+		}
+	}
+	return faccessat(dirfd, name, X_OK, 0) == 0;
+}
+
+/*
+Find the first directory in $PATH that has the command again (after a file is changed in a directory).
+
+@param name The command
+
+@return void
+*/
+void updateCommand(char* name) {
+	int dir = -1;
+	for (int i = 0; i < pathIndex->dirNum && dir == -1; i++) {
+		if (pathIndex->dirs[i][0] == '/') {
+			char full[max_length_of_command];
+			snprintf(full, sizeof(full), "%s/%s", pathIndex->dirs[i], name);
+			if (isExecutable(AT_FDCWD, full, DT_UNKNOWN) == 1) {
+				dir = i;
+			}
+		}
+	}
+	int node = trieFind(name, dir != -1);
+	if (node > 0) {
+		setCommandDir(node, dir);
+	}
+}
+
+/*
+Add every executable in a directory of $PATH to the index.
+The directories are scanned in the order of $PATH, so a command is only taken from the first directory that has it.
+
+@param dir The index of directory in $PATH
+
+@return void
+*/
+void scanDirectory(int dir) {
+	DIR* stream = opendir(pathIndex->dirs[dir]);
+	if (stream == NULL) {
+		return;
+	}
+	struct dirent* entry = NULL;
+	while ((entry = readdir(stream)) != NULL) {
+		if (entry->d_name[0] == '.' && (entry->d_name[1] == '\0' || strcmp(entry->d_name, "..") == 0)) {
+			continue;
+		}
+		// skip the command that is found in the previous directory
+		int node = trieFind(entry->d_name, 0);
+		if (node > 0 && pathIndex->nodes[node].dir != -1) {
+			continue;
+		}
+		if (isExecutable(dirfd(stream), entry->d_name, entry->d_type) == 1) {
+			setCommandDir(trieFind(entry->d_name, 1), dir);
+		}
+	}
+	closedir(stream);
+}
+
+/*
+Free the index of commands in $PATH.
+
+@param void
+
+@return void
+*/
+void freePathIndex(void) {
+	if (pathIndex == NULL) {
+		return;
+	}
+	if (pathIndex->inotify != -1) {
+		close(pathIndex->inotify);
+	}
+	free(pathIndex->dirs);
+	free(pathIndex->path);
+	free(pathIndex->nodes);
+	free(pathIndex);
+	pathIndex = NULL;
+}
+
+/*
+Build the index of commands in $PATH, and watch the directories by inotify.
+The index is only exact (i.e. could replace the search of $PATH) if every directory is absolute and watched.
+
+@param void
+
+@return void
+*/
+void buildPathIndex(void) {
+	// the generation keep increasing, so the commands resolved with the old index are known to be outdated
+	unsigned long generation = pathIndex != NULL ? pathIndex->generation + 1 : 0;
+	freePathIndex();
+	pathIndex = (PathIndex*) malloc(sizeof(PathIndex));
+	memset(pathIndex, 0, sizeof(PathIndex));
+	pathIndex->generation = generation;
+	char* path = getenv("PATH");
+	pathIndex->path = strdup(path != NULL ? path : "");
+	// split $PATH into directories, an empty directory means the current directory
+	pathIndex->dirs = (char**) malloc((strlen(pathIndex->path) + 2) * sizeof(char*));
+	char* dir = path != NULL ? pathIndex->path : NULL;
+	while (dir != NULL) {
+		char* end = strchr(dir, ':');
+		if (end != NULL) {
+			*end = '\0';
+		}
+		pathIndex->dirs[pathIndex->dirNum++] = dir[0] != '\0' ? dir : ".";
+		dir = end != NULL ? end + 1 : NULL;
+	}
+	// the root of trie
+	pathIndex->capacity = max_length_of_command;
+	pathIndex->nodes = (TrieNode*) malloc(pathIndex->capacity * sizeof(TrieNode));
+	pathIndex->nodes[0].ch = '\0';
+	pathIndex->nodes[0].dir = -1;
+	pathIndex->nodes[0].child = -1;
+	pathIndex->nodes[0].sibling = -1;
+	pathIndex->nodeNum = 1;
+	// watch the directories before scanning them, so no change is missed in between
+	pathIndex->inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	pathIndex->exact = pathIndex->inotify != -1;
+	for (int i = 0; i < pathIndex->dirNum; i++) {
+		if (pathIndex->dirs[i][0] != '/') {
+			pathIndex->exact = 0;
+			continue;
+		}
+		// a directory that does not exist is not watched, it is only checked again when $PATH is changed
+		uint32_t mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+		if (pathIndex->inotify != -1 && inotify_add_watch(pathIndex->inotify, pathIndex->dirs[i], mask) == -1 && errno != ENOENT) {
+			pathIndex->exact = 0;
+		}
+		scanDirectory(i);
+	}
+	pathIndex->generation += 1;
+}
+
+/*
+Make sure the index of commands in $PATH is built and up to date.
+The index is rebuilt if $PATH is changed or the events of inotify are lost,
+otherwise only the commands named by the inotify events are updated.
+
+@param void
+
+@return exact 1 if the index is exact (it could replace the search of $PATH), 0 otherwise
+*/
+int refreshPathIndex(void) {
+	char* path = getenv("PATH");
+	if (pathIndex == NULL || strcmp(pathIndex->path, path != NULL ? path : "") != 0) {
+		buildPathIndex();
+		return pathIndex->exact;
+	}
+	if (pathIndex->inotify == -1) {
+		return 0;
+	}
+	char events[pipe_data_size] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	int rebuild = 0;
+	while (1) {
+		long count = read(pathIndex->inotify, events, sizeof(events));
+		if (count <= 0) {
+			break;
+		}
+		for (char* p = events; p < events + count; p += sizeof(struct inotify_event) + ((struct inotify_event*) p)->len) {
+			struct inotify_event* event = (struct inotify_event*) p;
+			// the directory itself is moved or removed, or some events are dropped
+			if (event->mask & (IN_Q_OVERFLOW | IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+				rebuild = 1;
+			}
+			else if (event->len > 0 && rebuild == 0) {
+				updateCommand(event->name);
+			}
+		}
+	}
+	if (rebuild == 1) {
+		buildPathIndex();
+	}
+	return pathIndex->exact;
+}
+
+/*
+Find the full path of a command in the index.
+
+@param name The command without path (e.g. "ls")
+
+@return path The full path (e.g. "/bin/ls", free it by free()), NULL if not found
+*/
+char* lookupPathIndex(char* name) {
+	int node = trieFind(name, 0);
+	if (node <= 0 || pathIndex->nodes[node].dir == -1) {
+		return NULL;
+	}
+	char* dir = pathIndex->dirs[pathIndex->nodes[node].dir];
+	char* full = (char*) malloc(strlen(dir) + strlen(name) + 2);
+	sprintf(full, "%s/%s", dir, name);
+	return full;
+}
+
+/*
+List the commands in $PATH that start with a prefix, in ascending order.
+
+@param prefix The prefix (e.g. "gc")
+
+@return names The NULL terminated names (e.g. {"gcc", "gcov"}, free each of them and the vector by free())
+*/
+char** completePathIndex(char* prefix) {
+	refreshPathIndex();
+	int count = 0;
+	int capacity = max_num_of_arguments;
+	char** names = (char**) malloc(capacity * sizeof(char*));
+	int start = trieFind(prefix, 0);
+	if (start == -1) {
+		names[0] = NULL;
+		return names;
+	}
+	// walk the subtree in depth first order, $(stack) hold the nodes and $(name) hold the chars on the way
+	int length = strlen(prefix);
+	char name[max_length_of_command];
+	int stack[max_length_of_command];
+	int depth = 0;
+	memcpy(name, prefix, length);
+	stack[0] = start;
+	while (depth >= 0) {
+		int node = stack[depth];
+		if (node == -1) {
+			// no more sibling, go back to the parent and visit its next sibling
+			depth -= 1;
+			if (depth >= 0) {
+				stack[depth] = depth == 0 ? -1 : pathIndex->nodes[stack[depth]].sibling;
+			}
+			continue;
+		}
+		if (depth > 0) {
+			name[length + depth - 1] = pathIndex->nodes[node].ch;
+		}
+		if (pathIndex->nodes[node].dir != -1) {
+			if (count + 1 >= capacity) {
+				capacity *= 2;
+				names = (char**) realloc(names, capacity * sizeof(char*));
+			}
+			names[count++] = strndup(name, length + (depth > 0 ? depth : 0));
+		}
+		// visit the children first (the names are limited by the size of $(name))
+		if (pathIndex->nodes[node].child != -1 && length + depth + 1 < max_length_of_command) {
+			depth += 1;
+			stack[depth] = pathIndex->nodes[node].child;
+		}
+		else {
+			stack[depth] = depth == 0 ? -1 : pathIndex->nodes[node].sibling;
+		}
+	}
+	names[count] = NULL;
+	return names;
+}
+
+/*
+Get the generation of the index, it is changed whenever the path of any command is changed.
+The index is only refreshed if it is built already.
+
+@param void
+
+@return generation The generation (0 if the index is not built)
+*/
+unsigned long pathIndexGeneration(void) {
+	if (pathIndex == NULL) {
+		return 0;
+	}
+	refreshPathIndex();
+	return pathIndex->generation;
+}
@@ -0,0 +1,45 @@
+/*
+FileName:    pathindex.h
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: Hold the function header of pathindex.c, provide self defined structure.
+Remark:      None of function is implemented in this file.
+*/
+
+#ifndef PATHINDEX_H
+#define PATHINDEX_H
+
+// a node of the trie of command names, the children of a node are linked by $(sibling) in ascending order
+typedef struct TrieNode {
+	char ch;            // the last char of the name that end at this node
+	int dir;            // index of the directory in $PATH that the command is found (-1 if no command end here)
+	int child;          // index of the first child (-1 if none)
+	int sibling;        // index of the next sibling (-1 if none)
+} TrieNode;
+
+// an index of every executable in the directories of $PATH
+typedef struct PathIndex {
+	char* path;                 // the value of $PATH that the index is built with
+	char** dirs;                // the directories in $PATH
+	int dirNum;                 // number of directories
+	int exact;                  // 1 if the index is always up to date (every directory is absolute and watched)
+	int inotify;                // the inotify fd that watch the directories (-1 if not available)
+	TrieNode* nodes;            // the trie, $(nodes[0]) is the root
+	int nodeNum;                // number of nodes
+	int capacity;               // capacity of $(nodes)
+	int commands;               // number of commands in the index
+	unsigned long generation;   // increased whenever the path of a command is changed
+} PathIndex;
+
+int refreshPathIndex(void);
+
+char* lookupPathIndex(char* name);
+
+char** completePathIndex(char* prefix);
+
+unsigned long pathIndexGeneration(void);
+
+void freePathIndex(void);
+
+#endif
@@ -0,0 +1,294 @@
+/*
+FileName:    procsub.c
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: Process substitution, i.e. "<(...)" and ">(...)" in the arguments (e.g. "diff <(sort a) <(sort b)").
+             The command line inside is run by a forked shell that is connected to the outer command by a pipe,
+             and the argument is replaced by "/dev/fd/N", where N is the other end of pipe.
+             The forked shells are started while the arguments are expanded, but they wait for SIGUSR1 until the outer command is launched,
+             then they join the process group of job and are recorded in the task record like the other processes of job,
+             so a foreground job wait for all of its branches, and a background job has them reaped by the handler of SIGCHLD.
+             The branches run concurrently with each other and with the outer command, no temporary file is needed.
+Remark:      function implemented in this file:
+             1. Process substitution: ALL (the arguments are replaced by expand.c, and the branches are launched by task.c)
+*/
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cgroup.h"
+#include "joblog.h"
+#include "linklist.h"
+#include "procsub.h"
+#include "shellstat.h"
+#include "signals.h"
+#include "task.h"
+
+// a global variable that indicate whether SIGUSER1 is received(1) or not(0).
+extern volatile sig_atomic_t siguser1Received;
+// a global variable that store the PIDs and corresponding CMD.
+extern Node** taskRecords;
+// the number of background processes that are not reaped yet
+extern atomic_long runningBackground;
+// the exit status of the last foreground pipeline
+extern int lastStatus;
+// 1 in a forked shell of "$(...)", "<(...)" or ">(...)"
+extern int subshell;
+
+// a global variable that store the substitutions started by the expansion, until they are taken by the outer command
+Substitutions pending = {0};
+// a global variable that store the substitutions whose pipes are held by the shell (i.e. not launched yet), including the taken ones
+Substitutions live = {0};
+
+/*
+Append a substitution to a list.
+
+@param list The list
+@param item The substitution
+
+@return void
+*/
+void appendSubstitution(Substitutions* list, Substitution* item) {
+	if (list->count == list->capacity) {
+		list->capacity = list->capacity > 0 ? list->capacity * 2 : 4;
+		list->items = (Substitution*) realloc(list->items, list->capacity * sizeof(Substitution));
+	}
+	list->items[list->count++] = *item;
+}
+
+/*
+Remove a substitution from the list of substitutions whose pipes are held by the shell (it is launched or freed).
+
+@param fd The end of pipe held by the shell
+
+@return void
+*/
+void forgetSubstitution(int fd) {
+	for (int i = 0; i < live.count; i++) {
+		if (live.items[i].fd == fd) {
+			live.items[i] = live.items[--live.count];
+			return;
+		}
+	}
+}
+
+/*
+Start a process substitution, i.e. fork a shell that run the command line with a pipe as its standard output ("<(...)") or input (">(...)").
+The forked shell wait for SIGUSR1 (without spinning) until the outer command is launched by launchSubstitutions().
+
+@param line The command line inside the parentheses
+@param output 1 for ">(...)" (the outer command write to it), 0 for "<(...)" (the outer command read from it)
+
+@return fd The end of pipe for the outer command (close-on-exec until it is inherited), -1 if it fail (the message is printed)
+*/
+int startSubstitution(char* line, int output) {
+	int ends[2];
+	if (pipe2(ends, O_CLOEXEC) == -1) {
+		perror("3230shell: pipe");
+		return -1;
+	}
+	int keep = output == 1 ? ends[1] : ends[0];
+	int give = output == 1 ? ends[0] : ends[1];
+	Substitution item;
+	clock_gettime(CLOCK_MONOTONIC, &item.start);
+	// SIGUSR1 is blocked until the forked shell wait for it, so it is not lost
+	sigset_t mask;
+	sigset_t saved;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGUSR1);
+	sigprocmask(SIG_BLOCK, &mask, &saved);
+	fflush(stdout);
+	item.pid = fork();
+	if (item.pid == -1) {
+		perror("3230shell: fork");
+		sigprocmask(SIG_SETMASK, &saved, NULL);
+		close(keep);
+		close(give);
+		return -1;
+	}
+	if (item.pid == 0) {
+		// the forked shell take the other end of pipe
+		dup2(give, output == 1 ? STDIN_FILENO : STDOUT_FILENO);
+		close(give);
+		close(keep);
+		// the pipes of the other substitutions (including the ones taken by the earlier commands of pipeline) are not held,
+		// so their commands see the end of file in time
+		dropSubstitutions();
+		subshell = 1;
+		// wait until the outer command is launched
+		sigset_t waiting = saved;
+		sigdelset(&waiting, SIGUSR1);
+		while (siguser1Received != 1) {
+			sigsuspend(&waiting);
+		}
+		sigprocmask(SIG_SETMASK, &saved, NULL);
+		// the processes of forked shell wait for their own SIGUSR1
+		siguser1Received = 0;
+		regMainSighandler();
+		signal(SIGINT, SIG_DFL);
+		startTasks(line);
+		fflush(stdout);
+		_exit(lastStatus);
+	}
+	sigprocmask(SIG_SETMASK, &saved, NULL);
+	close(give);
+	char name[64];
+	snprintf(name, sizeof(name), "%c(%s)", output == 1 ? '>' : '<', line);
+	item.name = strdup(name);
+	item.fd = keep;
+	appendSubstitution(&pending, &item);
+	appendSubstitution(&live, &item);
+	return keep;
+}
+
+/*
+Close the pipes of every substitution held by the shell, it is called in a forked shell (e.g. of "<(...)" or "$(...)"),
+so the commands of substitutions see the end of file when the shell close its own ends.
+
+@param void
+
+@return void
+*/
+void dropSubstitutions(void) {
+	for (int i = 0; i < live.count; i++) {
+		close(live.items[i].fd);
+	}
+	live.count = 0;
+	pending.count = 0;
+}
+
+/*
+Get the number of pending substitutions, the substitutions started after it belong to the command that is being expanded.
+(a command substitution in the same command may launch its own commands with their own substitutions meanwhile)
+
+@param void
+
+@return mark The number of pending substitutions
+*/
+int substitutionMark(void) {
+	return pending.count;
+}
+
+/*
+Take the substitutions started since $(mark), they are launched together with the outer command.
+
+@param mark The value of substitutionMark() before the expansion
+
+@return subs The substitutions (free it by freeSubstitutions()), NULL if there is none
+*/
+Substitutions* takeSubstitutions(int mark) {
+	if (pending.count <= mark) {
+		return NULL;
+	}
+	Substitutions* subs = (Substitutions*) malloc(sizeof(Substitutions));
+	memset(subs, 0, sizeof(Substitutions));
+	for (int i = mark; i < pending.count; i++) {
+		appendSubstitution(subs, &pending.items[i]);
+	}
+	pending.count = mark;
+	return subs;
+}
+
+/*
+Pass the pipes of substitutions to the outer command, it is called in the child process just before exec().
+
+@param subs The substitutions of command (NULL if none)
+
+@return void
+*/
+void inheritSubstitutions(Substitutions* subs) {
+	for (int i = 0; subs != NULL && i < subs->count; i++) {
+		fcntl(subs->items[i].fd, F_SETFD, 0);
+	}
+}
+
+/*
+Launch the substitutions after the outer command is forked.
+They are recorded in the task record, moved into the process group and cgroup of job, and signalled to start.
+
+@param subs The substitutions of command (NULL if none)
+@param pgid The process group of job (0 if the job run in the group of shell)
+@param cgroup The cgroup leaf of job (NULL if none)
+@param background 1 if the job is in background (the substitutions are reaped by the handler of SIGCHLD)
+
+@return void
+*/
+void launchSubstitutions(Substitutions* subs, pid_t pgid, JobCgroup* cgroup, int background) {
+	for (int i = 0; subs != NULL && i < subs->count; i++) {
+		Substitution* item = &subs->items[i];
+		// the outer command hold the pipe now
+		forgetSubstitution(item->fd);
+		close(item->fd);
+		item->fd = -1;
+		jobStarted();
+		if (background == 1) {
+			runningBackground += 1;
+		}
+		headInsert(taskRecords, item->pid, item->name, item->start, background, pgid);
+		if (pgid != 0) {
+			setpgid(item->pid, pgid);
+		}
+		placeInCgroup(cgroup, item->pid);
+		kill(item->pid, SIGUSR1);
+	}
+}
+
+/*
+Wait for the substitutions of a foreground job (the output of background jobs is read meanwhile).
+
+@param subs The substitutions of command (NULL if none)
+
+@return void
+*/
+void waitSubstitutions(Substitutions* subs) {
+	for (int i = 0; subs != NULL && i < subs->count; i++) {
+		Substitution* item = &subs->items[i];
+		if (item->fd != -1) {
+			continue;
+		}
+		waitDrainingJobLogs(item->pid);
+		waitpid(item->pid, NULL, 0);
+		jobReaped(&item->start);
+		Node* node = searchNode(taskRecords, item->pid);
+		if (node != NULL) {
+			node->done = 1;
+		}
+	}
+}
+
+/*
+Free the substitutions of a command, the ones that are not launched (e.g. the outer command fail to start) are killed.
+
+@param subs The substitutions of command (NULL if none)
+
+@return NULL to NULL the substitutions
+*/
+Substitutions* freeSubstitutions(Substitutions* subs) {
+	if (subs == NULL) {
+		return NULL;
+	}
+	for (int i = 0; i < subs->count; i++) {
+		Substitution* item = &subs->items[i];
+		if (item->fd != -1) {
+			forgetSubstitution(item->fd);
+			close(item->fd);
+			kill(item->pid, SIGKILL);
+			waitpid(item->pid, NULL, 0);
+		}
+		free(item->name);
+	}
+	free(subs->items);
+	free(subs);
+	return NULL;
+}
@@ -0,0 +1,49 @@
+/*
+FileName:    procsub.h
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: Hold the function header of procsub.c, provide self defined structure.
+Remark:      None of function is implemented in this file.
+*/
+
+#include <sys/types.h>
+#include <time.h>
+
+#include "cgroup.h"
+
+#ifndef PROCSUB_H
+#define PROCSUB_H
+
+// a process substitution (e.g. "<(sort a)"), its command line is run by a forked shell
+typedef struct Substitution {
+	pid_t pid;              // the forked shell, it wait for SIGUSR1 until the outer command is launched
+	int fd;                 // the end of pipe that is passed to the outer command as "/dev/fd/N" (-1 after it is launched)
+	char* name;             // the name in task record (e.g. "<(sort a)")
+	struct timespec start;  // the time of fork
+} Substitution;
+
+// the process substitutions of a command
+typedef struct Substitutions {
+	Substitution* items;
+	int count;
+	int capacity;
+} Substitutions;
+
+int startSubstitution(char* line, int output);
+
+void dropSubstitutions(void);
+
+int substitutionMark(void);
+
+Substitutions* takeSubstitutions(int mark);
+
+void inheritSubstitutions(Substitutions* subs);
+
+void launchSubstitutions(Substitutions* subs, pid_t pgid, JobCgroup* cgroup, int background);
+
+void waitSubstitutions(Substitutions* subs);
+
+Substitutions* freeSubstitutions(Substitutions* subs);
+
+#endif
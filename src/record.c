@@ -0,0 +1,282 @@
+/*
+FileName:    record.c
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: Record a session into a JSONL file ("--record FILE"), and replay it with the same timing ("--replay FILE [--speed X]").
+             Each command line is logged as one JSON object, e.g.
+             {"seq":1,"t":1.250000000,"line":"ls -l","status":0,"wall":0.002104000,"user":0.001000,"sys":0.000000,"shell_user":0.000000,"shell_sys":0.000312}
+             "t" is the time the line was received (second since recording starts, monotonic clock),
+             "wall" is the time spent by startTasks(), "user" and "sys" are used by the child processes reaped meanwhile,
+             and "shell_user" and "shell_sys" are used by the shell itself (i.e. the overhead of shell).
+             A replay read the same file as a script, and feed the "line" of each object into the main loop at its "t",
+             so a session can be run against a new build, and recorded again to compare.
+Remark:      function implemented in this file:
+             1. Session record and replay: ALL (the lines are run by the main loop as usual)
+*/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "buffer.h"
+#include "record.h"
+
+// a global variable that store the log of session (NULL if it is not recorded)
+Recorder* recorder = NULL;
+
+// a global variable that store the timing of replay
+Replay replay = {0};
+
+/*
+Get the seconds between 2 points of time.
+
+@param start The start
+@param end The end
+
+@return seconds The seconds
+*/
+double secondsBetween(struct timespec* start, struct timespec* end) {
+	return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+Get the seconds of user or system CPU time in $(time).
+
+@param time The CPU time
+
+@return seconds The seconds
+*/
+double cpuSeconds(struct timeval* time) {
+	return time->tv_sec + time->tv_usec / 1e6;
+}
+
+/*
+Open the log of session, the file is truncated.
+
+@param path The path of log
+
+@return status 0 if success, -1 if the file cannot be opened (the message is printed)
+*/
+int openRecord(char* path) {
+	FILE* file = fopen(path, "we");
+	if (file == NULL) {
+		char temp[strlen(path) + 16];
+		snprintf(temp, sizeof(temp), "3230shell: '%s'", path);
+		perror(temp);
+		return -1;
+	}
+	recorder = (Recorder*) malloc(sizeof(Recorder));
+	memset(recorder, 0, sizeof(Recorder));
+	recorder->file = file;
+	clock_gettime(CLOCK_MONOTONIC, &recorder->start);
+	return 0;
+}
+
+/*
+Close the log of session.
+
+@param void
+
+@return void
+*/
+void closeRecord(void) {
+	if (recorder == NULL) {
+		return;
+	}
+	fclose(recorder->file);
+	free(recorder);
+	recorder = NULL;
+}
+
+/*
+Remember the time and usage before a command line is run.
+
+@param line The command line
+
+@return void
+*/
+void beginRecord(char* line) {
+	if (recorder == NULL) {
+		return;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &recorder->received);
+	getrusage(RUSAGE_SELF, &recorder->self);
+	getrusage(RUSAGE_CHILDREN, &recorder->children);
+}
+
+/*
+Write a string as a JSON string (with the quotes).
+
+@param file The file
+@param string The string
+
+@return void
+*/
+void writeJsonString(FILE* file, char* string) {
+	fputc('"', file);
+	for (unsigned char* ch = (unsigned char*) string; *ch != '\0'; ch++) {
+		switch (*ch) {
+			case '"': fputs("\\\"", file); break;
+			case '\\': fputs("\\\\", file); break;
+			case '\n': fputs("\\n", file); break;
+			case '\t': fputs("\\t", file); break;
+			case '\r': fputs("\\r", file); break;
+			default:
+				if (*ch < 0x20) {
+					fprintf(file, "\\u%04x", *ch);
+				}
+				else {
+					fputc(*ch, file);
+				}
+		}
+	}
+	fputc('"', file);
+}
+
+/*
+Log a command line after it is run, with its exit status and the time and usage it took.
+
+@param line The command line
+@param status The exit status of the last pipeline of line
+
+@return void
+*/
+void endRecord(char* line, int status) {
+	if (recorder == NULL) {
+		return;
+	}
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	struct rusage self, children;
+	getrusage(RUSAGE_SELF, &self);
+	getrusage(RUSAGE_CHILDREN, &children);
+	recorder->seq += 1;
+	fprintf(recorder->file, "{\"seq\":%ld,\"t\":%.9f,\"line\":", recorder->seq, secondsBetween(&recorder->start, &recorder->received));
+	writeJsonString(recorder->file, line);
+	fprintf(recorder->file, ",\"status\":%d,\"wall\":%.9f,\"user\":%.6f,\"sys\":%.6f,\"shell_user\":%.6f,\"shell_sys\":%.6f}\n",
+		status, secondsBetween(&recorder->received, &now),
+		cpuSeconds(&children.ru_utime) - cpuSeconds(&recorder->children.ru_utime),
+		cpuSeconds(&children.ru_stime) - cpuSeconds(&recorder->children.ru_stime),
+		cpuSeconds(&self.ru_utime) - cpuSeconds(&recorder->self.ru_utime),
+		cpuSeconds(&self.ru_stime) - cpuSeconds(&recorder->self.ru_stime));
+	// the log is complete even if the shell is killed
+	fflush(recorder->file);
+}
+
+/*
+Decode the JSON string that start at $(string) (after the opening quote) in place.
+
+@param string The JSON string
+
+@return end The end of decoded string (NULL if the closing quote is not found)
+*/
+char* decodeJsonString(char* string) {
+	char* out = string;
+	for (char* in = string; *in != '\0'; in++) {
+		if (*in == '"') {
+			*out = '\0';
+			return out;
+		}
+		if (*in != '\\') {
+			*out++ = *in;
+			continue;
+		}
+		in++;
+		switch (*in) {
+			case 'n': *out++ = '\n'; break;
+			case 't': *out++ = '\t'; break;
+			case 'r': *out++ = '\r'; break;
+			case 'b': *out++ = '\b'; break;
+			case 'f': *out++ = '\f'; break;
+			case 'u': {
+				unsigned int code = 0;
+				if (sscanf(in + 1, "%4x", &code) != 1) {
+					return NULL;
+				}
+				in += 4;
+				// the code points of Basic Multilingual Plane in UTF-8
+				if (code < 0x80) {
+					*out++ = (char) code;
+				}
+				else if (code < 0x800) {
+					*out++ = (char) (0xc0 | (code >> 6));
+					*out++ = (char) (0x80 | (code & 0x3f));
+				}
+				else {
+					*out++ = (char) (0xe0 | (code >> 12));
+					*out++ = (char) (0x80 | ((code >> 6) & 0x3f));
+					*out++ = (char) (0x80 | (code & 0x3f));
+				}
+				break;
+			}
+			case '\0': return NULL;
+			default: *out++ = *in; break;
+		}
+	}
+	return NULL;
+}
+
+/*
+Get the next command line of replay, it is returned at its recorded time (divided by the speed).
+The lines that are not a record (e.g. blank lines) are skipped.
+
+@param buffer The pointer to the buffer that need input.
+@param source The pointer to the input source (the log file in script mode).
+
+@return status 0 if a line is read, -1 if there is no more input.
+*/
+int readReplay(Buffer* buffer, InputSource* source) {
+	while (readLine(buffer, 0, source) == 0) {
+		char* time = strstr(buffer->string, "\"t\":");
+		char* line = strstr(buffer->string, "\"line\":\"");
+		if (time == NULL || line == NULL) {
+			continue;
+		}
+		double recorded = strtod(time + 4, NULL);
+		line += 8;
+		if (decodeJsonString(line) == NULL) {
+			printf("3230shell: replay: invalid record '%s'\n", buffer->string);
+			continue;
+		}
+		memmove(buffer->string, line, strlen(line) + 1);
+		// the first line start the replay, the others wait for their time since the first line
+		if (replay.started == 0) {
+			replay.started = 1;
+			replay.speed = source->speed;
+			replay.first = recorded;
+			clock_gettime(CLOCK_MONOTONIC, &replay.start);
+		}
+		else if (replay.speed > 0 && recorded > replay.first) {
+			double offset = (recorded - replay.first) / replay.speed;
+			struct timespec due = replay.start;
+			due.tv_sec += (time_t) offset;
+			due.tv_nsec += (long) ((offset - (time_t) offset) * 1e9);
+			if (due.tv_nsec >= 1000000000L) {
+				due.tv_sec += 1;
+				due.tv_nsec -= 1000000000L;
+			}
+			// a line that is late (the previous line took longer than the gap) is run immediately
+			fflush(stdout);
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) == EINTR) {
+				continue;
+			}
+		}
+		replay.last = recorded;
+		replay.count += 1;
+		return 0;
+	}
+	// report the time of replay, so it can be compared with the recorded time
+	if (replay.started == 1) {
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		fflush(stdout);
+		fprintf(stderr, "3230shell: replayed %ld command lines in %.3f s (recorded %.3f s)\n", replay.count, secondsBetween(&replay.start, &now), replay.last - replay.first);
+	}
+	return -1;
+}
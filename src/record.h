@@ -0,0 +1,49 @@
+/*
+FileName:    record.h
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: Hold the function header of record.c, provide self defined structure.
+Remark:      None of function is implemented in this file.
+*/
+
+#include <stdio.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "buffer.h"
+
+#ifndef RECORD_H
+#define RECORD_H
+
+// the log of a session ("--record FILE"), one JSON object for each command line
+typedef struct Recorder {
+	FILE* file;
+	struct timespec start;      // the time that recording starts
+	long seq;                   // number of command lines recorded
+	struct timespec received;   // the time that the current command line is received
+	struct rusage self;         // the usage of shell before the current command line
+	struct rusage children;     // the usage of child processes before the current command line
+} Recorder;
+
+// the timing of a replay ("--replay FILE [--speed X]")
+typedef struct Replay {
+	double speed;               // the recorded gaps are divided by it (0 -> as fast as possible)
+	int started;                // 1 after the first command line is replayed
+	struct timespec start;      // the time that the first command line is replayed
+	double first;               // the recorded time of the first command line
+	double last;                // the recorded time of the last command line
+	long count;                 // number of command lines replayed
+} Replay;
+
+int openRecord(char* path);
+
+void closeRecord(void);
+
+void beginRecord(char* line);
+
+void endRecord(char* line, int status);
+
+int readReplay(Buffer* buffer, InputSource* source);
+
+#endif
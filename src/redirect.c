@@ -0,0 +1,219 @@
+/*
+FileName:    redirect.c
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: It prepare the fds of redirections in the parent process, and redirect them in the child process.
+Remark:      function implemented in this file:
+             1. Here-document ("<<WORD") and here-string ("<<< word"): ALL
+             2. Redirection of files ("< file", "> file" and ">> file") and fds ("<&N" and ">&N", e.g. "2>&1"): ALL
+*/
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "ast.h"
+#include "constant.h"
+#include "expand.h"
+#include "redirect.h"
+
+/*
+Put the data into a fd that could be read by the child process.
+Small data is written into a pipe directly (it fit in the pipe without blocking),
+large data is written into an anonymous memory file (memfd), so there is no temporary file on disk.
+The fd is close-on-exec, it is kept by the child process only after dup2().
+
+@param data The data
+@param size The size of data
+
+@return fd The fd to read the data from (-1 if fail)
+*/
+int openInputData(char* data, long size) {
+	int fd = -1;
+	if (size <= pipe_data_size) {
+		int fds[2];
+		if (pipe2(fds, O_CLOEXEC) == -1) {
+			perror("3230shell: pipe");
+			return -1;
+		}
+		if (size > 0 && write(fds[1], data, size) != size) {
+			perror("3230shell: write");
+		}
+		close(fds[1]);
+		return fds[0];
+	}
+	fd = memfd_create("3230shell-heredoc", MFD_CLOEXEC);
+	if (fd == -1) {
+		perror("3230shell: memfd_create");
+		return -1;
+	}
+	long done = 0;
+	while (done < size) {
+		long count = write(fd, &data[done], size - done);
+		if (count <= 0) {
+			perror("3230shell: write");
+			break;
+		}
+		done += count;
+	}
+	lseek(fd, 0, SEEK_SET);
+	return fd;
+}
+
+/*
+Get the fd that is copied by a redirection "<&N" or ">&N".
+The fd must be open in the shell (e.g. the pipe of a coprocess), or be redirected by an earlier redirection of the command (e.g. "3>log >&3").
+
+@param stage The command
+@param index The index of redirection
+
+@return fd The fd to be copied (it belongs to the shell, it is not closed), -1 if it is invalid (the message is printed)
+*/
+int openDuplicate(Stage* stage, int index) {
+	Redirect* redirect = &stage->redirects[index];
+	char* word = redirect->expand == 1 ? expandText(redirect->word, 1) : strdup(redirect->word);
+	char* end = NULL;
+	long fd = strtol(word, &end, 10);
+	int valid = word[0] >= '0' && word[0] <= '9' && *end == '\0' && fd <= INT_MAX;
+	if (valid == 1 && fcntl((int) fd, F_GETFD) == -1) {
+		valid = 0;
+		for (int i = 0; i < index; i++) {
+			if (stage->redirects[i].fd == fd) {
+				valid = 1;
+			}
+		}
+	}
+	if (valid == 0) {
+		printf("3230shell: '%s': bad file descriptor\n", word);
+		fd = -1;
+	}
+	free(word);
+	return (int) fd;
+}
+
+/*
+Open the fd of every redirection of a command in the parent process.
+The words of redirections are expanded and the files are opened here (i.e. before the command is forked).
+
+@param stage The command
+
+@return fds The fds of redirections (free it by closeRedirects()), NULL if no redirection or fail
+*/
+int* openRedirects(Stage* stage) {
+	if (stage->redirectNum == 0) {
+		return NULL;
+	}
+	int* fds = (int*) malloc(stage->redirectNum * sizeof(int));
+	for (int i = 0; i < stage->redirectNum; i++) {
+		fds[i] = -1;
+	}
+	for (int i = 0; i < stage->redirectNum; i++) {
+		Redirect* redirect = &stage->redirects[i];
+		if (redirect->type == REDIRECT_HEREDOC) {
+			// the body of here-document is expanded without removing the quotes
+			if (redirect->expand == 1) {
+				char* body = expandText(redirect->word, 0);
+				fds[i] = openInputData(body, strlen(body));
+				free(body);
+			}
+			else {
+				fds[i] = openInputData(redirect->word, strlen(redirect->word));
+			}
+		}
+		else if (redirect->type == REDIRECT_HERESTRING) {
+			// the word of here-string is followed by a '\10'
+			char* word = redirect->expand == 1 ? expandText(redirect->word, 1) : strdup(redirect->word);
+			int length = strlen(word);
+			word = (char*) realloc(word, length + 2);
+			word[length] = '\n';
+			word[length + 1] = '\0';
+			fds[i] = openInputData(word, length + 1);
+			free(word);
+		}
+		else if (redirect->type == REDIRECT_DUPLICATE) {
+			fds[i] = openDuplicate(stage, i);
+		}
+		else {
+			// the file is opened by the parent, so an error is reported before the command is forked
+			char* path = redirect->expand == 1 ? expandPath(redirect->word) : strdup(redirect->word);
+			int flags = O_RDONLY;
+			if (redirect->type == REDIRECT_OUTPUT) {
+				flags = O_WRONLY | O_CREAT | O_TRUNC;
+			}
+			else if (redirect->type == REDIRECT_APPEND) {
+				flags = O_WRONLY | O_CREAT | O_APPEND;
+			}
+			fds[i] = open(path, flags | O_CLOEXEC, 0666);
+			if (fds[i] == -1) {
+				char temp[strlen(path) + 16];
+				snprintf(temp, sizeof(temp), "3230shell: '%s'", path);
+				perror(temp);
+			}
+			free(path);
+		}
+		if (fds[i] == -1) {
+			return closeRedirects(stage, fds);
+		}
+	}
+	return fds;
+}
+
+/*
+Redirect the fds of the command in the child process (after the pipes are connected).
+
+@param stage The command
+@param fds The fds returned by openRedirects()
+
+@return void
+*/
+void applyRedirects(Stage* stage, int* fds) {
+	if (fds == NULL) {
+		return;
+	}
+	for (int i = 0; i < stage->redirectNum; i++) {
+		int target = stage->redirects[i].fd;
+		// the copied fd belongs to the shell, it may be copied again (e.g. "2>&1 3>&1")
+		if (stage->redirects[i].type == REDIRECT_DUPLICATE) {
+			if (fds[i] != target) {
+				dup2(fds[i], target);
+			}
+			fcntl(target, F_SETFD, 0);
+		}
+		else if (fds[i] != target) {
+			dup2(fds[i], target);
+			close(fds[i]);
+		}
+		else {
+			fcntl(target, F_SETFD, 0);
+		}
+	}
+}
+
+/*
+Close the fds of redirections in the parent process.
+
+@param stage The command
+@param fds The fds returned by openRedirects()
+
+@return NULL to NULL the fds
+*/
+int* closeRedirects(Stage* stage, int* fds) {
+	if (fds == NULL) {
+		return NULL;
+	}
+	for (int i = 0; i < stage->redirectNum; i++) {
+		if (fds[i] != -1 && stage->redirects[i].type != REDIRECT_DUPLICATE) {
+			close(fds[i]);
+		}
+	}
+	free(fds);
+	return NULL;
+}
@@ -0,0 +1,25 @@
+/*
+FileName:    redirect.h
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: Hold the function header of redirect.c.
+Remark:      None of function is implemented in this file.
+*/
+
+#include "ast.h"
+
+#ifndef REDIRECT_H
+#define REDIRECT_H
+
+int openInputData(char* data, long size);
+
+int openDuplicate(Stage* stage, int index);
+
+int* openRedirects(Stage* stage);
+
+void applyRedirects(Stage* stage, int* fds);
+
+int* closeRedirects(Stage* stage, int* fds);
+
+#endif
@@ -0,0 +1,562 @@
+/*
+FileName:    server.c
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: The server mode "3230shell --listen PATH", one shell process serve many local clients over a unix socket.
+             A client send command lines (one per line), each line is run by a forked shell in its own process group,
+             which parse, launch and reap the commands by startTasks() as usual.
+             The stdout, stderr, exit status and rusage of the jobs are sent back in frames:
+                 "out ID LENGTH\n" followed by LENGTH bytes of stdout
+                 "err ID LENGTH\n" followed by LENGTH bytes of stderr
+                 "exit ID status=N user=SECONDS sys=SECONDS maxrss=KB\n" after the job finish
+             where ID is the number of the command line in its connection (start from 1), so the jobs of a client run concurrently.
+             All sockets, pipes and signals are watched by one epoll loop, no thread is created for the clients.
+Remark:      function implemented in this file:
+             1. Server mode: ALL
+*/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "buffer.h"
+#include "constant.h"
+#include "server.h"
+#include "signals.h"
+#include "task.h"
+
+// the exit status of the last foreground pipeline
+extern int lastStatus;
+
+// the epoll instance of server
+int serverEpoll = -1;
+// the jobs that are not finished
+ServerJob* serverJobs = NULL;
+// the jobs and clients that are freed after the events being handled, since a later event may point to them
+ServerJob* deadJobs = NULL;
+ServerClient* deadClients = NULL;
+// the owners of the events of listening socket and signalfd
+ServerKind listenKind = SERVER_LISTEN;
+ServerKind signalKind = SERVER_SIGNAL;
+
+/*
+Watch an fd by epoll, or change the events that are watched.
+
+@param fd The fd
+@param events The events (e.g. EPOLLIN)
+@param owner The structure that own the fd (it start with ServerKind)
+@param op EPOLL_CTL_ADD or EPOLL_CTL_MOD
+
+@return status 0 if success, -1 otherwise
+*/
+int watchFd(int fd, int events, void* owner, int op) {
+	struct epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.events = events;
+	event.data.ptr = owner;
+	return epoll_ctl(serverEpoll, op, fd, &event);
+}
+
+/*
+Stop watching an fd and close it.
+The fd is removed from epoll explicitly, since a forked shell may still hold a copy of it.
+
+@param fd The fd
+
+@return void
+*/
+void unwatchFd(int fd) {
+	epoll_ctl(serverEpoll, EPOLL_CTL_DEL, fd, NULL);
+	close(fd);
+}
+
+/*
+Write the queued frames of a client as much as possible, EPOLLOUT is watched if the socket is full.
+
+@param client The client
+
+@return status 0 if success, -1 if the connection is broken
+*/
+int flushClient(ServerClient* client) {
+	int written = 0;
+	while (written < client->outputLength) {
+		ssize_t count = send(client->fd, &client->output->string[written], client->outputLength - written, MSG_NOSIGNAL);
+		if (count == -1 && errno == EINTR) {
+			continue;
+		}
+		if (count == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			break;
+		}
+		if (count == -1) {
+			return -1;
+		}
+		written += count;
+	}
+	memmove(client->output->string, &client->output->string[written], client->outputLength - written);
+	client->outputLength -= written;
+	int writable = client->outputLength > 0;
+	if (writable != client->writable) {
+		client->writable = writable;
+		watchFd(client->fd, EPOLLIN | (writable ? EPOLLOUT : 0), client, EPOLL_CTL_MOD);
+	}
+	return 0;
+}
+
+/*
+Queue a frame to a client, the frame is written when the socket is writable.
+
+@param client The client
+@param header The header of frame (e.g. "out 1 12\n")
+@param data The data following the header (NULL if none)
+@param length The length of $(data)
+
+@return void
+*/
+void queueFrame(ServerClient* client, char* header, char* data, int length) {
+	int headerLength = strlen(header);
+	reserveBuffer(client->output, client->outputLength + headerLength + length);
+	memcpy(&client->output->string[client->outputLength], header, headerLength);
+	client->outputLength += headerLength;
+	if (length > 0) {
+		memcpy(&client->output->string[client->outputLength], data, length);
+		client->outputLength += length;
+	}
+}
+
+/*
+Close the connection of a client. The jobs that are still running are killed, since no one could receive their output.
+
+@param client The client
+
+@return void
+*/
+void dropClient(ServerClient* client) {
+	for (ServerJob* job = serverJobs; job != NULL; job = job->next) {
+		if (job->client == client) {
+			job->client = NULL;
+			if (job->reaped == 0) {
+				kill(-job->pid, SIGKILL);
+			}
+		}
+	}
+	unwatchFd(client->fd);
+	client->fd = -1;
+	client->next = deadClients;
+	deadClients = client;
+}
+
+/*
+Close the connection of a client if it has finished sending, all of its jobs are finished and all frames are written.
+
+@param client The client
+
+@return void
+*/
+void closeIdleClient(ServerClient* client) {
+	if (client->closing == 1 && client->jobs == 0 && client->outputLength == 0) {
+		dropClient(client);
+	}
+}
+
+/*
+Send the exit status and usage of a job and free it, if it is reaped and both of its pipes reach EOF.
+
+@param job The job
+
+@return void
+*/
+void finishJob(ServerJob* job) {
+	if (job->reaped == 0 || job->streams[0].fd != -1 || job->streams[1].fd != -1) {
+		return;
+	}
+	ServerClient* client = job->client;
+	if (client != NULL) {
+		char header[max_length_of_command];
+		snprintf(header, sizeof(header), "exit %ld status=%d user=%ld.%06ld sys=%ld.%06ld maxrss=%ld\n", job->id, exitStatusOf(job->status),
+			job->usage.ru_utime.tv_sec, job->usage.ru_utime.tv_usec, job->usage.ru_stime.tv_sec, job->usage.ru_stime.tv_usec, job->usage.ru_maxrss);
+		queueFrame(client, header, NULL, 0);
+		client->jobs -= 1;
+	}
+	// remove the job from the list
+	ServerJob** link = &serverJobs;
+	while (*link != job) {
+		link = &(*link)->next;
+	}
+	*link = job->next;
+	job->next = deadJobs;
+	deadJobs = job;
+	if (client != NULL) {
+		if (flushClient(client) == -1) {
+			dropClient(client);
+		}
+		else {
+			closeIdleClient(client);
+		}
+	}
+}
+
+/*
+Run a command line of a client in a forked shell.
+The forked shell lead a new process group, its stdout and stderr are pipes watched by epoll.
+
+@param client The client
+@param line The command line
+
+@return void
+*/
+void startJob(ServerClient* client, char* line) {
+	client->lastId += 1;
+	int out[2];
+	int err[2];
+	if (pipe2(out, O_CLOEXEC | O_NONBLOCK) == -1) {
+		perror("3230shell: pipe");
+		return;
+	}
+	if (pipe2(err, O_CLOEXEC | O_NONBLOCK) == -1) {
+		perror("3230shell: pipe");
+		close(out[0]);
+		close(out[1]);
+		return;
+	}
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid == -1) {
+		perror("3230shell: fork");
+		close(out[0]);
+		close(out[1]);
+		close(err[0]);
+		close(err[1]);
+		return;
+	}
+	if (pid == 0) {
+		// the forked shell run the command line like "3230shell -c LINE" with its own process group
+		setpgid(0, 0);
+		int null = open("/dev/null", O_RDONLY);
+		dup2(null, STDIN_FILENO);
+		dup2(out[1], STDOUT_FILENO);
+		dup2(err[1], STDERR_FILENO);
+		// the fds of server (e.g. the sockets of other clients) are not passed to the job
+		close_range(3, ~0U, 0);
+		fcntl(STDOUT_FILENO, F_SETFL, 0);
+		fcntl(STDERR_FILENO, F_SETFL, 0);
+		sigset_t empty;
+		sigemptyset(&empty);
+		sigprocmask(SIG_SETMASK, &empty, NULL);
+		signal(SIGPIPE, SIG_DFL);
+		regMainSighandler();
+		startTasks(line);
+		fflush(stdout);
+		_exit(lastStatus);
+	}
+	setpgid(pid, pid);
+	close(out[1]);
+	close(err[1]);
+	ServerJob* job = (ServerJob*) malloc(sizeof(ServerJob));
+	memset(job, 0, sizeof(ServerJob));
+	job->id = client->lastId;
+	job->pid = pid;
+	job->client = client;
+	job->streams[0] = (JobStream) {SERVER_STREAM, job, out[0], "out"};
+	job->streams[1] = (JobStream) {SERVER_STREAM, job, err[0], "err"};
+	watchFd(out[0], EPOLLIN, &job->streams[0], EPOLL_CTL_ADD);
+	watchFd(err[0], EPOLLIN, &job->streams[1], EPOLL_CTL_ADD);
+	job->next = serverJobs;
+	serverJobs = job;
+	client->jobs += 1;
+}
+
+/*
+Read the command lines from a client, each complete line start a job.
+
+@param client The client
+
+@return status 0 if success, -1 if the connection is broken
+*/
+int readClient(ServerClient* client) {
+	while (1) {
+		reserveBuffer(client->input, client->inputLength + pipe_data_size);
+		ssize_t count = recv(client->fd, &client->input->string[client->inputLength], pipe_data_size, 0);
+		if (count == -1 && errno == EINTR) {
+			continue;
+		}
+		if (count == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			return 0;
+		}
+		if (count == -1) {
+			return -1;
+		}
+		// the client has finished sending, an incomplete last line is run too
+		if (count == 0) {
+			if (client->inputLength > 0) {
+				client->input->string[client->inputLength] = '\0';
+				startJob(client, client->input->string);
+				client->inputLength = 0;
+			}
+			client->closing = 1;
+			watchFd(client->fd, client->writable ? EPOLLOUT : 0, client, EPOLL_CTL_MOD);
+			closeIdleClient(client);
+			return 0;
+		}
+		// start a job for each complete line
+		int start = 0;
+		for (int i = client->inputLength; i < client->inputLength + count; i++) {
+			if (client->input->string[i] == '\n') {
+				client->input->string[i] = '\0';
+				if (i > start) {
+					startJob(client, &client->input->string[start]);
+				}
+				start = i + 1;
+			}
+		}
+		client->inputLength += count;
+		memmove(client->input->string, &client->input->string[start], client->inputLength - start);
+		client->inputLength -= start;
+	}
+}
+
+/*
+Read the output of a job and queue it to the client.
+
+@param stream The stdout or stderr of job
+
+@return void
+*/
+void readStream(JobStream* stream) {
+	ServerJob* job = stream->job;
+	char data[pipe_data_size * 4];
+	while (1) {
+		ssize_t count = read(stream->fd, data, sizeof(data));
+		if (count == -1 && errno == EINTR) {
+			continue;
+		}
+		if (count == -1 && errno == EAGAIN) {
+			break;
+		}
+		// EOF (or error), the job (and its background commands) has closed the pipe
+		if (count <= 0) {
+			unwatchFd(stream->fd);
+			stream->fd = -1;
+			finishJob(job);
+			return;
+		}
+		if (job->client != NULL) {
+			char header[64];
+			snprintf(header, sizeof(header), "%s %ld %ld\n", stream->name, job->id, (long) count);
+			queueFrame(job->client, header, data, count);
+		}
+	}
+	if (job->client != NULL && flushClient(job->client) == -1) {
+		dropClient(job->client);
+	}
+}
+
+/*
+Reap the finished jobs.
+
+@param void
+
+@return void
+*/
+void reapJobs(void) {
+	while (1) {
+		int status = 0;
+		struct rusage usage;
+		pid_t pid = wait4(-1, &status, WNOHANG, &usage);
+		if (pid <= 0) {
+			return;
+		}
+		for (ServerJob* job = serverJobs; job != NULL; job = job->next) {
+			if (job->pid == pid) {
+				job->reaped = 1;
+				job->status = status;
+				job->usage = usage;
+				finishJob(job);
+				break;
+			}
+		}
+	}
+}
+
+/*
+Free the jobs and clients that are closed while handling the events.
+
+@param void
+
+@return void
+*/
+void freeDeadOwners(void) {
+	while (deadJobs != NULL) {
+		ServerJob* job = deadJobs;
+		deadJobs = job->next;
+		free(job);
+	}
+	while (deadClients != NULL) {
+		ServerClient* client = deadClients;
+		deadClients = client->next;
+		freeBuffer(client->input);
+		freeBuffer(client->output);
+		free(client);
+	}
+}
+
+/*
+Create the listening unix socket, a stale socket file at the path is replaced.
+
+@param path The path of socket
+
+@return fd The listening socket (-1 if failed, the message is printed)
+*/
+int listenSocket(char* path) {
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(address.sun_path)) {
+		printf("3230shell: --listen: the path is too long\n");
+		return -1;
+	}
+	strcpy(address.sun_path, path);
+	struct stat info;
+	if (lstat(path, &info) == 0 && S_ISSOCK(info.st_mode)) {
+		unlink(path);
+	}
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd == -1 || bind(fd, (struct sockaddr*) &address, sizeof(address)) == -1 || listen(fd, SOMAXCONN) == -1) {
+		char temp[max_length_of_command];
+		snprintf(temp, sizeof(temp), "3230shell: '%s'", path);
+		perror(temp);
+		if (fd != -1) {
+			close(fd);
+		}
+		return -1;
+	}
+	return fd;
+}
+
+/*
+Accept the pending connections.
+
+@param listener The listening socket
+
+@return void
+*/
+void acceptClients(int listener) {
+	while (1) {
+		int fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd == -1) {
+			// EAGAIN, or no more fd (the connection wait in the backlog until a client leave)
+			return;
+		}
+		ServerClient* client = (ServerClient*) malloc(sizeof(ServerClient));
+		memset(client, 0, sizeof(ServerClient));
+		client->kind = SERVER_CLIENT;
+		client->fd = fd;
+		client->input = initBuffer(-1);
+		client->output = initBuffer(-1);
+		watchFd(fd, EPOLLIN, client, EPOLL_CTL_ADD);
+	}
+}
+
+/*
+The main loop of server mode, it serve the clients until SIGINT or SIGTERM is received.
+
+@param path The path of unix socket
+
+@return status 0 if the server is stopped by signal, 1 if it could not start
+*/
+int runServer(char* path) {
+	// a client and each of its running jobs hold fds, so the soft limit of fds is raised to the hard limit
+	struct rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+	int listener = listenSocket(path);
+	if (listener == -1) {
+		return 1;
+	}
+	// the signals are read from a signalfd in the loop
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+	signal(SIGPIPE, SIG_IGN);
+	int signals = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	serverEpoll = epoll_create1(EPOLL_CLOEXEC);
+	watchFd(listener, EPOLLIN, &listenKind, EPOLL_CTL_ADD);
+	watchFd(signals, EPOLLIN, &signalKind, EPOLL_CTL_ADD);
+	printf("3230shell: listening on %s\n", path);
+	fflush(stdout);
+
+	int running = 1;
+	struct epoll_event events[64];
+	while (running == 1) {
+		int count = epoll_wait(serverEpoll, events, 64, -1);
+		for (int i = 0; i < count; i++) {
+			ServerKind* kind = (ServerKind*) events[i].data.ptr;
+			// the owner has been closed by a previous event in this batch
+			if ((*kind == SERVER_STREAM && ((JobStream*) kind)->fd == -1) || (*kind == SERVER_CLIENT && ((ServerClient*) kind)->fd == -1)) {
+				continue;
+			}
+			if (*kind == SERVER_LISTEN) {
+				acceptClients(listener);
+			}
+			else if (*kind == SERVER_SIGNAL) {
+				struct signalfd_siginfo info;
+				while (read(signals, &info, sizeof(info)) == sizeof(info)) {
+					if (info.ssi_signo != SIGCHLD) {
+						running = 0;
+					}
+				}
+				reapJobs();
+			}
+			else if (*kind == SERVER_STREAM) {
+				readStream((JobStream*) kind);
+			}
+			else {
+				ServerClient* client = (ServerClient*) kind;
+				if ((events[i].events & EPOLLOUT) && flushClient(client) == -1) {
+					dropClient(client);
+				}
+				else if ((events[i].events & EPOLLOUT) && client->closing == 1) {
+					closeIdleClient(client);
+				}
+				else if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && client->closing == 0 && readClient(client) == -1) {
+					dropClient(client);
+				}
+				// the client has closed the connection without waiting for the results
+				if ((events[i].events & (EPOLLHUP | EPOLLERR)) && client->fd != -1) {
+					dropClient(client);
+				}
+			}
+		}
+		freeDeadOwners();
+	}
+	// kill the running jobs and remove the socket
+	for (ServerJob* job = serverJobs; job != NULL; job = job->next) {
+		if (job->reaped == 0) {
+			kill(-job->pid, SIGKILL);
+		}
+	}
+	close(listener);
+	close(signals);
+	close(serverEpoll);
+	unlink(path);
+	return 0;
+}
@@ -0,0 +1,66 @@
+/*
+FileName:    server.h
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: Hold the function header of server.c, provide self defined structure.
+Remark:      None of function is implemented in this file.
+*/
+
+#include <sys/resource.h>
+#include <sys/types.h>
+
+#include "buffer.h"
+
+#ifndef SERVER_H
+#define SERVER_H
+
+// the owner of an epoll event, every structure watched by epoll start with it
+typedef enum ServerKind {
+	SERVER_LISTEN,      // the listening socket
+	SERVER_SIGNAL,      // the signalfd of SIGCHLD, SIGINT and SIGTERM
+	SERVER_CLIENT,      // a connection of client
+	SERVER_STREAM       // the stdout or stderr of a job
+} ServerKind;
+
+struct ServerJob;
+struct ServerClient;
+
+// a pipe that carry the stdout or stderr of a job
+typedef struct JobStream {
+	ServerKind kind;            // SERVER_STREAM
+	struct ServerJob* job;
+	int fd;                     // the read end of pipe (-1 after EOF)
+	char* name;                 // the type of frame ("out" or "err")
+} JobStream;
+
+// a command line submitted by a client, it is run by a forked shell that lead its own process group
+typedef struct ServerJob {
+	long id;                    // the number of the command line in its connection (start from 1)
+	pid_t pid;                  // the process (and process group) of job
+	int reaped;                 // 1 if the process is reaped
+	int status;                 // the status returned by wait4()
+	struct rusage usage;        // the usage of job, including the commands it has waited
+	struct ServerClient* client;    // the client of job (NULL if the client has gone)
+	JobStream streams[2];       // stdout and stderr
+	struct ServerJob* next;
+} ServerJob;
+
+// a connection of client
+typedef struct ServerClient {
+	ServerKind kind;            // SERVER_CLIENT
+	int fd;                     // the socket (-1 after the connection is closed)
+	Buffer* input;              // the bytes of the command line that is not complete yet
+	int inputLength;
+	Buffer* output;             // the frames that are not written yet (the socket is full)
+	int outputLength;
+	int writable;               // 1 if EPOLLOUT is watched
+	long lastId;                // the number of command lines received
+	int jobs;                   // the number of jobs not finished
+	int closing;                // 1 if the client has finished sending
+	struct ServerClient* next;  // the next client to be freed (after the events being handled)
+} ServerClient;
+
+int runServer(char* path);
+
+#endif
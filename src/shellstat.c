@@ -0,0 +1,230 @@
+/*
+FileName:    shellstat.c
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: It contains the counters and latency histograms of the shell itself, and the built-in command "shellstat" that report them.
+Remark:      function implemented in this file:
+             1. Built-in command: shellstat: ALL
+*/
+
+#include <malloc.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "buffer.h"
+#include "cache.h"
+#include "constant.h"
+#include "linklist.h"
+#include "shellstat.h"
+#include "signals.h"
+#include "task.h"
+
+// a global variable that store the counters of the shell since startup
+ShellStat shellStat = {0};
+// a global variable that store the PIDs and corresponding CMD.
+extern Node** taskRecords;
+// the completions of background processes that wait to be printed
+extern CompletionRing completions;
+
+/*
+Find the bucket of histogram that a value belongs to.
+Values below 8 have their own bucket, larger values keep 3 significant bits.
+i.e. 8-15 -> 1 ns per bucket, 16-31 -> 2 ns per bucket, 32-63 -> 4 ns per bucket, etc.
+
+@param nanos The value to be recorded
+
+@return index The index of bucket
+*/
+int bucketIndex(unsigned long nanos) {
+	if (nanos < hist_sub_buckets) {
+		return (int) nanos;
+	}
+	// position of the most significant bit
+	int msb = 63 - __builtin_clzl(nanos);
+	int index = (msb - 2) * hist_sub_buckets + (int) ((nanos >> (msb - 3)) & (hist_sub_buckets - 1));
+	// clamp the extremely large value into the last bucket
+	if (index >= hist_magnitudes * hist_sub_buckets) {
+		index = hist_magnitudes * hist_sub_buckets - 1;
+	}
+	return index;
+}
+
+/*
+Get the largest value that is held by a bucket of histogram.
+
+@param index The index of bucket
+
+@return nanos The upper bound of the bucket
+*/
+unsigned long bucketUpperBound(int index) {
+	if (index < hist_sub_buckets) {
+		return (unsigned long) index;
+	}
+	int msb = index / hist_sub_buckets + 2;
+	unsigned long lower = ((unsigned long) (hist_sub_buckets + index % hist_sub_buckets)) << (msb - 3);
+	return lower + (1UL << (msb - 3)) - 1;
+}
+
+/*
+Record a latency into the histogram.
+It only touch integers, so it is safe to be called in signal handler.
+
+@param hist The histogram
+@param nanos The latency in nanosecond
+
+@return void
+*/
+void recordLatency(Histogram* hist, unsigned long nanos) {
+	hist->counts[bucketIndex(nanos)] += 1;
+	if (hist->total == 0 || nanos < hist->min) {
+		hist->min = nanos;
+	}
+	if (nanos > hist->max) {
+		hist->max = nanos;
+	}
+	hist->total += 1;
+	hist->sum += nanos;
+}
+
+/*
+Get the nanoseconds elapsed since $(start) on the monotonic clock.
+
+@param start The start time
+
+@return nanos The nanoseconds elapsed
+*/
+unsigned long elapsedNanos(struct timespec* start) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	long nanos = (now.tv_sec - start->tv_sec) * 1000000000L + (now.tv_nsec - start->tv_nsec);
+	if (nanos < 0) {
+		nanos = 0;
+	}
+	return (unsigned long) nanos;
+}
+
+/*
+Count a new child process and update the peak number of live jobs.
+
+@param void
+
+@return void
+*/
+void jobStarted(void) {
+	shellStat.forks += 1;
+	shellStat.liveJobs += 1;
+	if (shellStat.liveJobs > shellStat.peakLiveJobs) {
+		shellStat.peakLiveJobs = shellStat.liveJobs;
+	}
+}
+
+/*
+Count a reaped child process and record its fork-to-reap latency.
+It is also called by the SIGCHLD handler.
+
+@param start The time that the child process is forked (NULL if unknown)
+
+@return void
+*/
+void jobReaped(struct timespec* start) {
+	shellStat.liveJobs -= 1;
+	if (start != NULL) {
+		recordLatency(&shellStat.forkToReap, elapsedNanos(start));
+	}
+}
+
+/*
+Get the value below which $(percent) of the recorded latency fall.
+
+@param hist The histogram
+@param percent The percentile (e.g. 99.9)
+
+@return nanos The latency at the percentile
+*/
+unsigned long valueAtPercentile(Histogram* hist, double percent) {
+	unsigned long target = (unsigned long) ((percent / 100.0) * hist->total + 0.5);
+	if (target < 1) {
+		target = 1;
+	}
+	unsigned long count = 0;
+	for (int i = 0; i < hist_magnitudes * hist_sub_buckets; i++) {
+		count += hist->counts[i];
+		if (count >= target) {
+			unsigned long nanos = bucketUpperBound(i);
+			return nanos > hist->max ? hist->max : nanos;
+		}
+	}
+	return hist->max;
+}
+
+/*
+Print one histogram as a line of percentiles in microsecond.
+
+@param name The name of histogram
+@param hist The histogram
+
+@return void
+*/
+void printHistogram(char* name, Histogram* hist) {
+	if (hist->total == 0) {
+		printf("  %-18s: (no sample)\n", name);
+		return;
+	}
+	printf("  %-18s: n=%lu min=%.1f p50=%.1f p90=%.1f p99=%.1f p99.9=%.1f max=%.1f mean=%.1f (us)\n",
+		name, hist->total,
+		hist->min / 1000.0,
+		valueAtPercentile(hist, 50.0) / 1000.0,
+		valueAtPercentile(hist, 90.0) / 1000.0,
+		valueAtPercentile(hist, 99.0) / 1000.0,
+		valueAtPercentile(hist, 99.9) / 1000.0,
+		hist->max / 1000.0,
+		(double) hist->sum / hist->total / 1000.0);
+}
+
+/*
+Print the counters and histograms of the shell (i.e. the built-in command "shellstat").
+
+@param void
+
+@return void
+*/
+void printShellStat(void) {
+	// read the resident set size from /proc/self/statm (in pages)
+	long rssPages = 0;
+	FILE* statm = fopen("/proc/self/statm", "r");
+	if (statm != NULL) {
+		if (fscanf(statm, "%*s %ld", &rssPages) != 1) {
+			rssPages = 0;
+		}
+		fclose(statm);
+	}
+	// read the heap usage from the allocator
+	struct mallinfo2 heap = mallinfo2();
+	// size of the task record
+	long records = countList(taskRecords);
+	long recordSize = sizeof(Node) + max_length_of_command * sizeof(char);
+
+	printf("3230shell: statistics since startup\n");
+	printf("  %-18s: %lu\n", "commands run", shellStat.commands);
+	printf("  %-18s: %lu\n", "forks", shellStat.forks);
+	printf("  %-18s: %lu\n", "exec failures", shellStat.execFailures);
+	printf("  %-18s: %lu\n", "SIGCHLD handled", shellStat.sigchlds);
+	printf("  %-18s: %lu recorded, %lu overflowed (ring of %d)\n", "completions", (unsigned long) completions.head, (unsigned long) completions.overflow, completion_ring_size);
+	printf("  %-18s: %d (peak %d)\n", "live jobs", shellStat.liveJobs, shellStat.peakLiveJobs);
+	printf("  %-18s: %lu hits, %lu misses, %d of %d entries\n", "command cache", shellStat.cacheHits, shellStat.cacheMisses, countCommandCache(), command_cache_size);
+	printf("  %-18s: %lu hits, %lu misses\n", "memo cache", shellStat.memoHits, shellStat.memoMisses);
+	printf("  %-18s: %ld KB\n", "RSS", rssPages * sysconf(_SC_PAGESIZE) / 1024);
+	printf("  %-18s: %zu KB in use (arena %zu KB, mmap %zu KB)\n", "heap", heap.uordblks / 1024, heap.arena / 1024, heap.hblkhd / 1024);
+	printf("  %-18s: %ld x %ld B = %ld B\n", "task records", records, recordSize, records * recordSize);
+	printHistogram("parse time", &shellStat.parseTime);
+	printHistogram("fork-to-exec", &shellStat.forkToExec);
+	printHistogram("fork-to-reap", &shellStat.forkToReap);
+}
@@ -0,0 +1,59 @@
+/*
+FileName:    shellstat.h
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: Hold the function header of shellstat.c, provide self defined structure.
+Remark:      None of function is implemented in this file.
+*/
+
+#include <time.h>
+
+#ifndef SHELLSTAT_H
+#define SHELLSTAT_H
+
+// number of sub-buckets in each power of 2 of a histogram (2^3, i.e. 3 significant bits)
+#define hist_sub_buckets 8
+
+// number of power of 2 covered by a histogram (1ns to 2^40ns, i.e. about 18 minutes)
+#define hist_magnitudes 40
+
+// a HDR-style (log-linear) histogram of latency in nanosecond
+typedef struct Histogram {
+	unsigned long counts[hist_magnitudes * hist_sub_buckets];
+	unsigned long total;
+	unsigned long sum;
+	unsigned long min;
+	unsigned long max;
+} Histogram;
+
+// the counters accumulated by the shell since startup
+typedef struct ShellStat {
+	unsigned long commands;
+	unsigned long forks;
+	unsigned long execFailures;
+	unsigned long sigchlds;
+	unsigned long cacheHits;
+	unsigned long cacheMisses;
+	unsigned long memoHits;
+	unsigned long memoMisses;
+	int liveJobs;
+	int peakLiveJobs;
+	Histogram parseTime;
+	Histogram forkToExec;
+	Histogram forkToReap;
+} ShellStat;
+
+void recordLatency(Histogram* hist, unsigned long nanos);
+
+unsigned long elapsedNanos(struct timespec* start);
+
+void jobStarted(void);
+
+void jobReaped(struct timespec* start);
+
+unsigned long valueAtPercentile(Histogram* hist, double percent);
+
+void printShellStat(void);
+
+#endif
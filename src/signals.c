@@ -9,33 +9,42 @@ Remark:      function implemented in this file:
              2. SIGCHLD signals: ALL
 */
 
+#include <errno.h>
 #include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
 #include <sys/resource.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
-#include <pthread.h>
 
 #include "buffer.h"
 #include "constant.h"
 #include "linklist.h"
+#include "shellstat.h"
 #include "signals.h"
 #include "task.h"
+#include "watchdog.h"
 
 // an global variable that indicate whether SIGUSER1 is received(1) or not(0).
-int siguser1Received = 0;
+volatile sig_atomic_t siguser1Received = 0;
 
-// an buffer that store the termination message of background process
-Buffer* sigBuffer = NULL;
+// the completions of background processes that wait to be printed
+CompletionRing completions;
 
-// a lock that prevent 2 chldSighandler editing sigBuffer
-pthread_mutex_t lock;
+// the number of background processes that are not reaped yet
+atomic_long runningBackground = 0;
 
 // a global variable that store the PIDs and corresponding CMD.
 extern Node** taskRecords;
+// a global variable that store the counters of the shell since startup
+extern ShellStat shellStat;
+// a global variable that store the source of command line input
+extern InputSource* inputSource;
 
 /*
 Handler of SIGINT in the Main process.
@@ -45,6 +54,10 @@ Handler of SIGINT in the Main process.
 @return void
 */
 void intSighandlerMain(int signum) {
+	// the prompt is not shown in script mode
+	if (inputSource != NULL && inputSource->interactive == 0) {
+		return;
+	}
 	printf("\n$$ 3230shell ## ");
 }
 
@@ -121,36 +134,131 @@ void user1Sighandler(int signum) {
 	siguser1Received = 1;
 }
 
+/*
+Create the ring of completions and the eventfd that wake up the line editor.
+
+@param void
+
+@return void
+*/
+void initCompletionRing(void) {
+	memset(&completions, 0, sizeof(CompletionRing));
+	completions.notify = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+/*
+Get the fd that become readable when a completion is recorded.
+
+@param void
+
+@return fd The eventfd (-1 if it could not be created)
+*/
+int completionNotifyFd(void) {
+	return completions.notify;
+}
+
+/*
+Record a completion into the ring, it is only called by the handler of SIGCHLD (the only producer).
+The completion is counted as overflow if the ring is full.
+
+@param node The task record of the process
+
+@return void
+*/
+void pushCompletion(Node* node) {
+	unsigned long head = atomic_load_explicit(&completions.head, memory_order_relaxed);
+	unsigned long tail = atomic_load_explicit(&completions.tail, memory_order_acquire);
+	if (head - tail >= completion_ring_size) {
+		atomic_fetch_add_explicit(&completions.overflow, 1, memory_order_relaxed);
+	}
+	else {
+		Completion* record = &completions.records[head % completion_ring_size];
+		record->pid = node->pid;
+		record->cmd = node->cmd;
+		// the record is published after it is written
+		atomic_store_explicit(&completions.head, head + 1, memory_order_release);
+	}
+	if (completions.notify != -1) {
+		uint64_t one = 1;
+		if (write(completions.notify, &one, sizeof(one)) == -1) {
+			// the counter is full, the consumer is woken up already
+		}
+	}
+}
+
+/*
+Print the completions in the ring, it is only called by the main loop and the line editor (the only consumer).
+The number of completions that overflowed since the last call is printed too.
+
+@param void
+
+@return count The number of lines printed
+*/
+int printCompletions(void) {
+	int count = 0;
+	// reset the eventfd before the ring is read, so a later record signal it again
+	if (completions.notify != -1) {
+		uint64_t value = 0;
+		if (read(completions.notify, &value, sizeof(value)) == -1) {
+			// nothing is signalled
+		}
+	}
+	unsigned long tail = atomic_load_explicit(&completions.tail, memory_order_relaxed);
+	unsigned long head = atomic_load_explicit(&completions.head, memory_order_acquire);
+	for (; tail != head; tail++) {
+		Completion* record = &completions.records[tail % completion_ring_size];
+		printf("[%d] %s Done\n", record->pid, record->cmd);
+		count++;
+	}
+	atomic_store_explicit(&completions.tail, tail, memory_order_release);
+	unsigned long overflow = atomic_load_explicit(&completions.overflow, memory_order_relaxed);
+	if (overflow != completions.reported) {
+		printf("3230shell: %lu more background processes are done (not listed, too many at once)\n", overflow - completions.reported);
+		completions.reported = overflow;
+		count++;
+	}
+	if (count > 0) {
+		fflush(stdout);
+	}
+	return count;
+}
+
 /*
 Handler of SIGCHLD in the Main process.
-It terminates the background child process and send termination message to the buffer.
+It reaps the background processes that have finished and record their completions into the ring.
+SIGCHLD is not queued, one signal may stand for several processes, so every running background process is checked
+(the task record is newest first, and the check stop when all running background processes are seen).
+The foreground processes are waited by executePipeline().
 
 @param signum Signal Number
-@param sig Information of signal
+@param sig Information of signal (not used)
 @param context Extra information (not used)
 
 @return void
 */
 void chldSighandler(int signum, siginfo_t* sig, void* context) {
-	pid_t pid = sig->si_pid;
-	// if this is a background process
-	if (pid == getpgid(pid)) {
-		// kill the process
-		waitpid(pid, NULL, WNOHANG);
-		
-		// get the name of command by pid
-		char* cmd = searchName(taskRecords, pid);
-
-		// construct the output
-		char output[max_length_of_command];
-		memset(output, 0, max_length_of_command);
-		snprintf(output, max_length_of_command * sizeof(char), "[%d] %s Done\n", pid, cmd);
-
-		pthread_mutex_lock(&lock);
-		// put the output into the buffer
-		strcat(sigBuffer->string, output);
-		pthread_mutex_unlock(&lock);
+	int savedErrno = errno;
+	shellStat.sigchlds += 1;
+	long remaining = atomic_load(&runningBackground);
+	for (Node* node = *taskRecords; node != NULL && remaining > 0; node = node->next) {
+		// a foreground job may have its own process group too (see "timeout"), so the flag of task record is used
+		if (node->background == 0 || node->done == 1) {
+			continue;
+		}
+		remaining -= 1;
+		if (waitpid(node->pid, NULL, WNOHANG) != node->pid) {
+			continue;
+		}
+		jobReaped(&node->start);
+		node->done = 1;
+		atomic_fetch_sub(&runningBackground, 1);
+		// the deadline of job is cancelled when its process group has gone, i.e. after the last member is reaped (not only the leader)
+		if (node->pgid != 0 && kill(-node->pgid, 0) == -1) {
+			cancelWatchdog(node->pgid);
+		}
+		pushCompletion(node);
 	}
+	errno = savedErrno;
 }
 
 /*
@@ -3,13 +3,41 @@ FileName:    signals.h
 Author:      Hung Ka Hing
 UID:         3035782750
 Platform:    Linux Debian & Linux Ubuntu
-Description: Hold the function header of signals.c.
+Description: Hold the function header of signals.c, provide self defined structure.
 Remark:      None of function is implemented in this file.
 */
 
+#include <stdatomic.h>
+#include <sys/types.h>
+
 #ifndef SIGNALS_H
 #define SIGNALS_H
 
+// the number of records in the ring of completions (a power of 2)
+#define completion_ring_size 1024
+
+// a background process that has finished (e.g. "[1234] sleep Done")
+typedef struct Completion {
+	pid_t pid;
+	char* cmd;          // the command in task record (it is not freed until the shell exit)
+} Completion;
+
+// a lock-free ring of completions, the handler of SIGCHLD is the only producer and the main loop is the only consumer
+typedef struct CompletionRing {
+	Completion records[completion_ring_size];
+	atomic_ulong head;      // number of records written by the handler
+	atomic_ulong tail;      // number of records printed by the main loop
+	atomic_ulong overflow;  // number of completions that are not recorded since the ring is full
+	unsigned long reported; // the overflow that has been reported
+	int notify;             // an eventfd that is signalled when a record is written (it wake up the line editor)
+} CompletionRing;
+
+void initCompletionRing(void);
+
+int completionNotifyFd(void);
+
+int printCompletions(void);
+
 void regMainSighandler(void);
 
 void regChildSighandler(void);
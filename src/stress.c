@@ -0,0 +1,527 @@
+/*
+FileName:    stress.c
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: The SIGCHLD storm stress harness of 3230shell (see the "stress" target in makefile).
+             It feed the shell (through a pipe of stdin) with thousands of short-lived background jobs and pipelines
+             at a controlled rate, and check the "[pid] cmd Done" lines that come back.
+             Each job is this program itself in child mode ("--child FD ID MS"), it sleep a while, then write
+             "ID PID TIME" into the report pipe (fd FD, inherited through the shell) right before it exit,
+             so the harness know the pid of every process and when it exited.
+             It verify that every process is reported exactly once and no zombie is left,
+             and report the throughput of reaping and the latency from exit to the "Done" line.
+Remark:      function implemented in this file:
+             1. Stress harness of the reaping of background processes: ALL
+*/
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// a process launched by the shell
+typedef struct StressProcess {
+	pid_t pid;          // 0 until it is reported
+	long exitTime;      // the time it exited (ns on the monotonic clock)
+	int done;           // number of "Done" lines of it
+} StressProcess;
+
+// the settings and the results of a run
+typedef struct StressRun {
+	char* shell;
+	long jobs;
+	long rate;              // lines per second
+	long duration;          // the longest life of a job (ms), the life is random from 0 to it
+	long pipelineEvery;     // every N-th job is a pipeline (0 for none)
+	int pipelineStages;
+	unsigned int seed;
+	long processes;         // number of processes expected
+	StressProcess* records; // indexed by the id of process
+	int* pidToId;           // the id + 1 of the last process with the pid (0 for unknown)
+	long pidMax;
+	long* latencies;        // the latency of each "Done" line of known process (ns)
+	long latencyCount;
+	long reported;          // number of processes that reported their exit
+	long doneLines;
+	long unknownLines;      // "Done" lines of pid that is not reported
+	long duplicated;        // "Done" lines after the first one of a process
+	long overflowed;        // the completions that are not listed by the shell (its ring was full)
+	long peakRunning;
+	long firstSubmit;
+	long lastSubmit;
+	long lastDone;
+} StressRun;
+
+/*
+Get the time on the monotonic clock.
+
+@param void
+
+@return nanos The time in nanosecond
+*/
+long monotonicNanos(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+/*
+The child mode: sleep, then report the pid and the time of exit.
+
+@param fd The write end of report pipe
+@param id The id of process
+@param ms The life of process in ms
+
+@return status 0 if success
+*/
+int runChild(int fd, long id, long ms) {
+	struct timespec life = {ms / 1000, (ms % 1000) * 1000000L};
+	nanosleep(&life, NULL);
+	char line[64];
+	// a line shorter than PIPE_BUF is written atomically
+	int length = snprintf(line, sizeof(line), "%ld %d %ld\n", id, getpid(), monotonicNanos());
+	if (write(fd, line, length) != length) {
+		return 1;
+	}
+	return 0;
+}
+
+/*
+Handle the reports of exit in $(data).
+
+@param run The run
+@param data The complete lines of report
+
+@return void
+*/
+void handleReports(StressRun* run, char* data) {
+	char* save = NULL;
+	for (char* line = strtok_r(data, "\n", &save); line != NULL; line = strtok_r(NULL, "\n", &save)) {
+		long id = 0, time = 0;
+		int pid = 0;
+		if (sscanf(line, "%ld %d %ld", &id, &pid, &time) != 3 || id < 0 || id >= run->processes || pid <= 0 || pid >= run->pidMax) {
+			continue;
+		}
+		run->records[id].pid = pid;
+		run->records[id].exitTime = time;
+		run->pidToId[pid] = id + 1;
+		run->reported += 1;
+	}
+}
+
+/*
+Handle the output of shell in $(data).
+
+@param run The run
+@param data The complete lines of output
+@param now The time that the lines are read
+
+@return void
+*/
+void handleOutput(StressRun* run, char* data, long now) {
+	char* save = NULL;
+	for (char* line = strtok_r(data, "\n", &save); line != NULL; line = strtok_r(NULL, "\n", &save)) {
+		int pid = 0;
+		long count = 0;
+		int length = strlen(line);
+		if (length > 5 && strcmp(&line[length - 5], " Done") == 0 && sscanf(line, "[%d]", &pid) == 1) {
+			run->doneLines += 1;
+			run->lastDone = now;
+			long id = pid > 0 && pid < run->pidMax ? run->pidToId[pid] - 1 : -1;
+			if (id < 0 || run->records[id].exitTime == 0) {
+				run->unknownLines += 1;
+			}
+			else if (++run->records[id].done > 1) {
+				run->duplicated += 1;
+			}
+			else {
+				run->latencies[run->latencyCount++] = now - run->records[id].exitTime;
+			}
+		}
+		else if (sscanf(line, "3230shell: %ld more background processes are done", &count) == 1) {
+			run->overflowed += count;
+		}
+		else {
+			fprintf(stderr, "3230stress: unexpected output: %s\n", line);
+		}
+	}
+}
+
+/*
+Read the complete lines from a fd into $(pending), and pass them to the handler.
+
+@param fd The fd (non-blocking)
+@param pending The bytes that are not a complete line yet
+@param length The number of pending bytes
+@param run The run
+@param output 1 for the output of shell, 0 for the reports
+
+@return status 0 if there is more to read, -1 for end of file
+*/
+int readLines(int fd, char* pending, int* length, StressRun* run, int output) {
+	while (1) {
+		long count = read(fd, &pending[*length], 65535 - *length);
+		if (count == -1 && errno == EINTR) {
+			continue;
+		}
+		if (count == -1) {
+			return 0;
+		}
+		if (count == 0) {
+			return -1;
+		}
+		*length += count;
+		pending[*length] = '\0';
+		char* end = strrchr(pending, '\n');
+		if (end == NULL) {
+			continue;
+		}
+		*end = '\0';
+		if (output == 1) {
+			handleOutput(run, pending, monotonicNanos());
+		}
+		else {
+			handleReports(run, pending);
+		}
+		int rest = *length - (end + 1 - pending);
+		memmove(pending, end + 1, rest);
+		*length = rest;
+	}
+}
+
+/*
+Count the zombies and the living processes whose parent is $(parent).
+
+@param parent The pid of parent
+@param zombies The space to hold the number of zombies
+
+@return living The number of living children
+*/
+long countChildren(pid_t parent, long* zombies) {
+	long living = 0;
+	*zombies = 0;
+	DIR* proc = opendir("/proc");
+	if (proc == NULL) {
+		return 0;
+	}
+	char path[300];
+	for (struct dirent* entry = readdir(proc); entry != NULL; entry = readdir(proc)) {
+		if (entry->d_name[0] < '0' || entry->d_name[0] > '9') {
+			continue;
+		}
+		snprintf(path, sizeof(path), "/proc/%s/stat", entry->d_name);
+		FILE* stat = fopen(path, "r");
+		if (stat == NULL) {
+			continue;
+		}
+		char data[1024];
+		size_t size = fread(data, 1, sizeof(data) - 1, stat);
+		fclose(stat);
+		data[size] = '\0';
+		// the name of command may contain spaces, the fields after it are read
+		char* end = strrchr(data, ')');
+		char state = 0;
+		int ppid = 0;
+		if (end != NULL && sscanf(end + 1, " %c %d", &state, &ppid) == 2 && ppid == parent) {
+			if (state == 'Z') {
+				*zombies += 1;
+			}
+			else {
+				living += 1;
+			}
+		}
+	}
+	closedir(proc);
+	return living;
+}
+
+/*
+Compare 2 latencies for qsort().
+
+@param a The first latency
+@param b The second latency
+
+@return order Negative, 0 or positive
+*/
+int compareLong(const void* a, const void* b) {
+	long x = *(const long*) a;
+	long y = *(const long*) b;
+	return (x > y) - (x < y);
+}
+
+/*
+Get the latency at a percentile in microsecond.
+
+@param run The run (its latencies are sorted)
+@param percent The percentile
+
+@return micros The latency
+*/
+double latencyAt(StressRun* run, double percent) {
+	if (run->latencyCount == 0) {
+		return 0;
+	}
+	long index = (long) (percent / 100.0 * run->latencyCount + 0.5) - 1;
+	if (index < 0) {
+		index = 0;
+	}
+	if (index >= run->latencyCount) {
+		index = run->latencyCount - 1;
+	}
+	return run->latencies[index] / 1000.0;
+}
+
+/*
+Write the next command line of job into $(line).
+
+@param run The run
+@param job The number of job
+@param self The path of this program
+@param fd The write end of report pipe (in the shell)
+@param nextId The id of the next process (it is advanced)
+@param line The space to hold the line
+@param size The size of $(line)
+
+@return count The number of processes in the line
+*/
+int buildJobLine(StressRun* run, long job, char* self, int fd, long* nextId, char* line, int size) {
+	int stages = run->pipelineEvery > 0 && job % run->pipelineEvery == run->pipelineEvery - 1 ? run->pipelineStages : 1;
+	int length = 0;
+	// blank lines are mixed into the input now and then, the shell should skip them
+	if (job % 100 == 0) {
+		length += snprintf(line, size, "   \n\t\n");
+	}
+	for (int i = 0; i < stages; i++) {
+		long ms = run->duration > 0 ? rand_r(&run->seed) % (run->duration + 1) : 0;
+		length += snprintf(&line[length], size - length, "%s%s --child %d %ld %ld", i > 0 ? " | " : "", self, fd, *nextId, ms);
+		*nextId += 1;
+	}
+	snprintf(&line[length], size - length, " &\n");
+	return stages;
+}
+
+/*
+Drive the shell with the jobs and check the results.
+
+@param run The run
+@param self The path of this program
+
+@return status 0 if every process is reported exactly once and no zombie is left, 1 otherwise
+*/
+int runStress(StressRun* run, char* self) {
+	int input[2], output[2], report[2];
+	if (pipe2(input, O_CLOEXEC) == -1 || pipe2(output, O_CLOEXEC) == -1 || pipe(report) == -1) {
+		perror("3230stress: pipe");
+		return 1;
+	}
+	fcntl(report[0], F_SETFD, FD_CLOEXEC);
+	pid_t shell = fork();
+	if (shell == 0) {
+		dup2(input[0], STDIN_FILENO);
+		dup2(output[1], STDOUT_FILENO);
+		execl(run->shell, run->shell, (char*) NULL);
+		perror("3230stress: exec");
+		_exit(127);
+	}
+	close(input[0]);
+	close(output[1]);
+	close(report[1]);
+	fcntl(output[0], F_SETFL, O_NONBLOCK);
+	fcntl(report[0], F_SETFL, O_NONBLOCK);
+
+	char* outputPending = (char*) malloc(65536);
+	char* reportPending = (char*) malloc(65536);
+	int outputLength = 0, reportLength = 0;
+	char line[4096];
+	int lineLength = 0, lineSent = 0;
+	long job = 0, nextId = 0;
+	long interval = 1000000000L / run->rate;
+	// the jobs are submitted on a fixed schedule, a late line is sent as soon as possible
+	long start = monotonicNanos();
+	// stop waiting if the "Done" lines do not come (the duration of jobs and 30s after the last line)
+	long deadline = -1;
+	int shellOpen = 1;
+	while (shellOpen == 1) {
+		long now = monotonicNanos();
+		if (job == run->jobs && deadline == -1) {
+			deadline = now + (run->duration + 30000) * 1000000L;
+		}
+		if (deadline != -1 && (run->doneLines + run->overflowed >= run->processes || now > deadline)) {
+			break;
+		}
+		// prepare the next line when it is due
+		if (lineSent == lineLength && job < run->jobs && now >= start + job * interval) {
+			buildJobLine(run, job, self, report[1], &nextId, line, sizeof(line));
+			lineLength = strlen(line);
+			lineSent = 0;
+			if (job == 0) {
+				run->firstSubmit = now;
+			}
+			job += 1;
+			run->lastSubmit = now;
+		}
+		struct pollfd fds[3];
+		fds[0].fd = report[0];
+		fds[0].events = POLLIN;
+		fds[1].fd = output[0];
+		fds[1].events = POLLIN;
+		fds[2].fd = input[1];
+		fds[2].events = lineSent < lineLength ? POLLOUT : 0;
+		int timeout = 100;
+		if (lineSent == lineLength && job < run->jobs) {
+			long wait = (start + job * interval - now) / 1000000L;
+			timeout = wait < 0 ? 0 : (wait < 100 ? (int) wait : 100);
+		}
+		if (poll(fds, 3, timeout) == -1 && errno != EINTR) {
+			perror("3230stress: poll");
+			break;
+		}
+		// the report of a process is always in the pipe before its "Done" line is printed, so it is read first
+		readLines(report[0], reportPending, &reportLength, run, 0);
+		if (fds[1].revents != 0 && readLines(output[0], outputPending, &outputLength, run, 1) == -1) {
+			shellOpen = 0;
+		}
+		if ((fds[2].revents & POLLOUT) != 0) {
+			long count = write(input[1], &line[lineSent], lineLength - lineSent);
+			if (count > 0) {
+				lineSent += count;
+			}
+		}
+		long running = nextId - run->reported;
+		if (running > run->peakRunning) {
+			run->peakRunning = running;
+		}
+	}
+	// the zombies are counted after a short while, so a process that has just exited is not counted
+	struct timespec settle = {0, 200000000L};
+	nanosleep(&settle, NULL);
+	readLines(report[0], reportPending, &reportLength, run, 0);
+	readLines(output[0], outputPending, &outputLength, run, 1);
+	long zombies = 0;
+	long living = countChildren(shell, &zombies);
+	// end the input, then the shell exit
+	close(input[1]);
+	int status = 0;
+	waitpid(shell, &status, 0);
+
+	long missing = 0;
+	for (long i = 0; i < nextId; i++) {
+		if (run->records[i].done == 0) {
+			missing += 1;
+		}
+	}
+	qsort(run->latencies, run->latencyCount, sizeof(long), compareLong);
+	double submitSeconds = (run->lastSubmit - run->firstSubmit) / 1e9;
+	double reapSeconds = (run->lastDone - run->firstSubmit) / 1e9;
+	printf("3230stress: %ld jobs (%ld processes) at %ld lines/s, life 0-%ld ms, every %ld-th job is a %d-stage pipeline\n",
+		run->jobs, run->processes, run->rate, run->duration, run->pipelineEvery, run->pipelineStages);
+	printf("  %-22s: %.0f lines/s\n", "submit rate", submitSeconds > 0 ? (job - 1) / submitSeconds : 0);
+	printf("  %-22s: %ld\n", "peak running", run->peakRunning);
+	printf("  %-22s: %ld of %ld\n", "exits reported", run->reported, run->processes);
+	printf("  %-22s: %ld (unknown %ld, duplicated %ld)\n", "Done lines", run->doneLines, run->unknownLines, run->duplicated);
+	printf("  %-22s: %ld (not listed by shell %ld)\n", "missing", missing, run->overflowed);
+	printf("  %-22s: %ld (still running %ld)\n", "zombies", zombies, living);
+	printf("  %-22s: %.0f processes/s\n", "reaping throughput", reapSeconds > 0 ? run->doneLines / reapSeconds : 0);
+	printf("  %-22s: p50=%.1f p90=%.1f p99=%.1f p99.9=%.1f max=%.1f (us)\n", "exit to Done latency",
+		latencyAt(run, 50), latencyAt(run, 90), latencyAt(run, 99), latencyAt(run, 99.9), latencyAt(run, 100));
+	int pass = missing == 0 && run->unknownLines == 0 && run->duplicated == 0 && zombies == 0 && run->reported == run->processes;
+	printf("%s\n", pass == 1 ? "PASS" : "FAIL");
+	free(outputPending);
+	free(reportPending);
+	close(output[0]);
+	close(report[0]);
+	return pass == 1 ? 0 : 1;
+}
+
+/*
+Run the stress harness, or a job of it (child mode).
+Usage: 3230stress [--shell PATH] [--jobs N] [--rate LINES_PER_SEC] [--duration MS] [--pipeline-every N] [--stages N] [--seed N]
+
+@param argc Argument Count
+@param argv Argument Vector
+
+@return status 0 if the run pass, 1 otherwise
+*/
+int main(int argc, char* argv[]) {
+	if (argc == 5 && strcmp(argv[1], "--child") == 0) {
+		return runChild(atoi(argv[2]), atol(argv[3]), atol(argv[4]));
+	}
+	StressRun run;
+	memset(&run, 0, sizeof(StressRun));
+	run.shell = "./3230shell";
+	run.jobs = 5000;
+	run.rate = 2000;
+	run.duration = 1000;
+	run.pipelineEvery = 10;
+	run.pipelineStages = 3;
+	run.seed = 3230;
+	for (int i = 1; i < argc; i++) {
+		char* value = i + 1 < argc ? argv[i + 1] : NULL;
+		if (value != NULL && strcmp(argv[i], "--shell") == 0) {
+			run.shell = value;
+		}
+		else if (value != NULL && strcmp(argv[i], "--jobs") == 0) {
+			run.jobs = atol(value);
+		}
+		else if (value != NULL && strcmp(argv[i], "--rate") == 0) {
+			run.rate = atol(value);
+		}
+		else if (value != NULL && strcmp(argv[i], "--duration") == 0) {
+			run.duration = atol(value);
+		}
+		else if (value != NULL && strcmp(argv[i], "--pipeline-every") == 0) {
+			run.pipelineEvery = atol(value);
+		}
+		else if (value != NULL && strcmp(argv[i], "--stages") == 0) {
+			run.pipelineStages = atoi(value);
+		}
+		else if (value != NULL && strcmp(argv[i], "--seed") == 0) {
+			run.seed = (unsigned int) atol(value);
+		}
+		else {
+			fprintf(stderr, "usage: %s [--shell PATH] [--jobs N] [--rate LINES_PER_SEC] [--duration MS] [--pipeline-every N] [--stages N] [--seed N]\n", argv[0]);
+			return 1;
+		}
+		i++;
+	}
+	if (run.jobs <= 0 || run.rate <= 0 || run.duration < 0 || run.pipelineEvery < 0 || run.pipelineStages < 1) {
+		fprintf(stderr, "3230stress: invalid settings\n");
+		return 1;
+	}
+	run.processes = run.jobs;
+	if (run.pipelineEvery > 0) {
+		run.processes += (run.jobs / run.pipelineEvery) * (run.pipelineStages - 1);
+	}
+	run.pidMax = 4194304;
+	FILE* file = fopen("/proc/sys/kernel/pid_max", "r");
+	if (file != NULL) {
+		if (fscanf(file, "%ld", &run.pidMax) != 1) {
+			run.pidMax = 4194304;
+		}
+		fclose(file);
+	}
+	run.pidMax += 1;
+	run.records = (StressProcess*) calloc(run.processes, sizeof(StressProcess));
+	run.pidToId = (int*) calloc(run.pidMax, sizeof(int));
+	run.latencies = (long*) calloc(run.processes, sizeof(long));
+	// the jobs run this program again, so the path must work after fork() of the shell
+	char* self = realpath("/proc/self/exe", NULL);
+	signal(SIGPIPE, SIG_IGN);
+	int status = runStress(&run, self);
+	free(self);
+	free(run.records);
+	free(run.pidToId);
+	free(run.latencies);
+	return status;
+}
@@ -3,7 +3,7 @@ FileName:    task.c
 Author:      Hung Ka Hing
 UID:         3035782750
 Platform:    Linux Debian & Linux Ubuntu
-Description: This file provides methods of parsing the arguments and execute the arguments(such arguments including build-in exit, timeX, &, |).
+Description: This file provides methods of parsing the arguments and execute the arguments(such arguments including build-in exit, timeX, &, |, ;, &&, ||).
 Remark:      function implemented in this file:
              1. Process creation and execution – foreground: All  
              2. Process creation and execution – use of ‘|’: ALL
@@ -11,72 +11,124 @@ Remark:      function implemented in this file:
              4. Built-in command: exit: ALL
              5. Process creation and execution – background: ALL
              6. SIGCHLD signaL: ALL (Another part is in signals.c)
+             7. Built-in command: shellstat: ALL (Another part is in shellstat.c)
+             8. Built-in command: history: ALL (Another part is in history.c)
+             9. Process creation and execution – use of ‘;’, ‘&&’ and ‘||’: execution (parsing is in ast.c)
+             10. Command substitution: the arguments are expanded before execution (see expand.c)
+             11. Here-document and here-string: the fds are prepared before execution (see redirect.c)
+             12. Built-in command: ulimit and prefix "limit": the settings are applied before exec() (see launch.c)
+             13. Built-in command: cgroup: the processes of a job are placed into its cgroup before exec() (see cgroup.c)
+             14. Built-in command: jobtop: ALL (Another part is in jobtop.c)
+             15. Prefix "timeout": the job run in its own process group, and the deadline is armed after launch (see watchdog.c)
+             16. Prefix "every": the pipeline is launched repeatedly on a timer (see every.c)
+             17. Built-in command: joblog: the output of a background job is connected to its log before exec() (see joblog.c)
+             18. Built-in command: export and unset, and the assignments before command: exported in the child process before exec() (see variable.c)
+             19. Process substitution: the branches are launched with their command and waited as part of the job (see procsub.c)
+             20. Built-in command: coproc: the coprocess is a background job with pipes on both ends (see coproc.c)
+             21. Prefix "memo": the output is replayed from the cache instead of launching, or captured into it (see memo.c)
 */
 
+#define _GNU_SOURCE
+
 #include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <sys/resource.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "ast.h"
 #include "buffer.h"
+#include "cache.h"
+#include "cgroup.h"
 #include "constant.h"
+#include "coproc.h"
+#include "every.h"
+#include "expand.h"
+#include "history.h"
+#include "joblog.h"
+#include "jobtop.h"
+#include "launch.h"
 #include "linklist.h"
+#include "memo.h"
+#include "procsub.h"
+#include "redirect.h"
+#include "shellstat.h"
 #include "signals.h"
 #include "task.h"
+#include "variable.h"
+#include "watchdog.h"
 
 // a global variable that indicate whether SIGUSER1 is received(1) or not(0).
-extern int siguser1Received;
+extern volatile sig_atomic_t siguser1Received;
 // a global variable that store the PIDs and corresponding CMD.
 extern Node** taskRecords;
+// a global variable that store the counters of the shell since startup
+extern ShellStat shellStat;
+// the number of background processes that are not reaped yet
+extern atomic_long runningBackground;
 
-/*
-Initialize the argument vector $(argv), which contains argument string.
-i.e. it is like {"ls", "-l", "-a"}.
-
-@param capacity The capacity of argument vector
-
-@return argv The pointer to the argument vector that finish initialization.
-*/
-char** initArgv(int capacity) {
-	// set minimum capacity for argv
-	if (capacity < max_num_of_arguments) {
-		capacity = max_num_of_arguments;
-	}
-	// declare and initialize an argument vector,  and clear the space for it.
-	char** argv = (char**) malloc(capacity*sizeof(char*));
-	memset(argv, 0, capacity*sizeof(char*));
-	for (int i = 0; i < capacity; i++) {
-		argv[i] = (char*) malloc(max_length_of_command*sizeof(char));
-		memset(argv[i], 0, max_length_of_command*sizeof(char));
-	}
-	return argv;
-}
+// the exit status of the last foreground pipeline
+int lastStatus = 0;
+// 1 in a forked shell of "$(...)", "<(...)" or ">(...)", "exit" only end the forked shell
+int subshell = 0;
+// the built-in commands that are run by runBuiltin()
+char* builtinNames[] = {"shellstat", "history", "ulimit", "cgroup", "jobtop", "joblog", "export", "unset", "coproc", NULL};
+// the pid of the last process of the last background job ($!)
+pid_t lastBackground = 0;
 
 /*
 Split the input string by space and form an argument vector.
 i.e. it split "/bin/ls -l -a | grep .c" into {"/bin/ls", "-l", "-a", "|", "grep", ".c", NULL}
+The spaces inside quoted strings, command substitutions and process substitutions do not split the argument.
+The vector grows when there are more than $(max_num_of_arguments) arguments, the strings are not copied.
 
 @param string The pre-processed command line input(i.e. "|" and "&" are surrounded by space).
 
-@return argv The pointer to the argument vector that contains arguments.
+@return argv The pointer to the argument vector that contains arguments (free it by free()).
 */
 char** constructArgv(char* string) {
 	// initialize a argument vector with default capacity
-	char** argv = initArgv(-1);
+	int capacity = max_num_of_arguments;
+	char** argv = (char**) malloc(capacity*sizeof(char*));
 	// split the input string by " " and transfer it into argv
 	int i = 0;
-	char* token = strtok(string, " ");
-	while (token != NULL) {
-		strcpy(argv[i], token);
-		token = strtok(NULL, " ");
+	int pos = 0;
+	while (string[pos] != '\0') {
+		// skip the spaces between arguments
+		if (string[pos] == ' ') {
+			pos++;
+			continue;
+		}
+		// reserve one space for the NULL at the end
+		if (i + 1 == capacity) {
+			capacity *= 2;
+			argv = (char**) realloc(argv, capacity*sizeof(char*));
+		}
+		argv[i] = &string[pos];
 		i++;
+		// find the end of argument
+		while (string[pos] != '\0' && string[pos] != ' ') {
+			if (string[pos] == '\'' || string[pos] == '"' || ((string[pos] == '$' || string[pos] == '<' || string[pos] == '>') && string[pos+1] == '(')) {
+				pos = skipQuoted(string, pos);
+				if (string[pos] == '\0') {
+					break;
+				}
+			}
+			pos++;
+		}
+		if (string[pos] == ' ') {
+			string[pos] = '\0';
+			pos++;
+		}
 	}
 	// label the end of arguments with NULL pointer
-	free(argv[i]);
 	argv[i] = NULL;
 	return argv;
 }
@@ -120,431 +172,641 @@ void removePath(char* string) {
 }
 
 /*
-Parse the arguments and execute arguments.
-There are 5 stages when start a task:
+Get the exit status from the status returned by wait().
+It is 128+N if the process is terminated by signal N (same as bash).
 
-Stage 0: Declaration of  all necessary variables
-    I guess I don't need to explain?
-Stage 1: Initialization of argument vector
-    convert the command line input $(string) into argument vector.
-    e.g. "ls -l -a |grep c$" -> {"ls", "-l", "-a", "|", "grep", "c$"}
-Stage 2: Paring argument vector and detect input errors.
-    Detect the exit, timeX, & and perform corresponding behavior.
-	e.g. exit the program, set the mode indicator to be 1 and etc.
-	Check the input error of exit, timeX, &, |.
-	s.t. if any error, pop err message and enter next loop.
-Stage 3: Allocation of task
-    split argument vector into sub-vectors, which could be put into exec() directly.
-	e.g. {"timeX", "ls", "-la", "|", "grep", "c$"} -> {("ls", "-la"), ("grep", "c$")}.
-Stage 4: Execution of task
-    Execute tasks one by one, if there is pipe, it will redirect stdout of 
-	previous task to stdin of current task.
-	It also register a different set of signal handler for child process.
-	It will print error message when exec fail.
-	It perform timeX function.
-    It allow child process to execute in background.
-	Its child process will wait for USR1 to activate.
-	It kills the child process after child process enter zombie state.
-If there is any error in any stage, the function will free all memory and quit. (I guess?)
-I tried to do my best on memory management but I am not so familiar with c :(
+@param status The status returned by wait()
 
-@param string The pre-processed command line input(i.e. "|" and "&" are surrounded by space).
+@return code The exit status
+*/
+int exitStatusOf(int status) {
+	if (WIFEXITED(status)) {
+		return WEXITSTATUS(status);
+	}
+	else if (WIFSIGNALED(status)) {
+		return 128 + WTERMSIG(status);
+	}
+	return 1;
+}
+
+/*
+Check whether a command is a built-in command that is run by runBuiltin().
+
+@param name The name of command
+
+@return 1 if it is a built-in command, 0 otherwise
+*/
+int isBuiltin(char* name) {
+	for (int i = 0; builtinNames[i] != NULL; i++) {
+		if (strcmp(builtinNames[i], name) == 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+Run a built-in command except "exit" (the arguments are checked by checkPipeline()).
+It is run by the shell if it is the only command of pipeline, or by the child process if it is piped (e.g. "history | tail").
+
+@param argv The argument vector
+
+@return status The exit status, -1 if it is not a built-in command
+*/
+int runBuiltin(char** argv) {
+	if (strcmp(argv[0], "shellstat") == 0) {
+		printShellStat();
+		return 0;
+	}
+	else if (strcmp(argv[0], "history") == 0) {
+		printHistory(argv);
+		return 0;
+	}
+	else if (strcmp(argv[0], "ulimit") == 0) {
+		runUlimit(argv);
+		return 0;
+	}
+	else if (strcmp(argv[0], "cgroup") == 0) {
+		return runCgroup(argv);
+	}
+	else if (strcmp(argv[0], "jobtop") == 0) {
+		return runJobtop(argv);
+	}
+	else if (strcmp(argv[0], "joblog") == 0) {
+		return runJoblog(argv);
+	}
+	else if (strcmp(argv[0], "export") == 0) {
+		return runExport(argv);
+	}
+	else if (strcmp(argv[0], "unset") == 0) {
+		return runUnset(argv);
+	}
+	else if (strcmp(argv[0], "coproc") == 0) {
+		return runCoproc(argv);
+	}
+	return -1;
+}
+
+/*
+Execute a pipeline (i.e. commands connected by '|').
+It execute the commands one by one, if there is pipe, it will redirect stdout of 
+previous command to stdin of current command.
+It also register a different set of signal handler for child process.
+It will print error message when exec fail, and report the failure to parent by a close-on-exec pipe.
+It perform timeX function.
+It allow child process to execute in background.
+Its child process will wait for USR1 to activate.
+A foreground pipeline is waited after all of its commands are started, so the pipes never fill up.
+
+@param pipeline The pipeline to be executed
+@param status The exit status of the last command in pipeline (0 for background pipeline)
 
 @return output The status code of exit, if 1, then quit main process.
 */
-int startTasks(char* string) {
-	
-	/* Stage 0: Declare variables */
-	
+int executePipeline(Pipeline* pipeline, int* status) {
 	// return value ( 0 -> enter next loop, 1 -> exit the main program)
 	int output = 0;
-	
-	// indicator of background(&) mode
-	int backgroundMode = 0;
-	// indicator of timeX mode
-	int timeXMode = 0;    
-	
-	// state indicators: Initialization of argument vector
-	int iniStage = 0;    
-	// state indicators: Paring argument vector and detect input errors.
-	int parStage = 0;
-	// state indicators: Allocation of task
-	int allStage = 0;
 	// state indicators: Execution of task
 	int exeStage = 0;
+	// the commands in the pipeline
+	Stage* stages = pipeline->stages;
 	
-	// containers
-	char** rawArgs;    // an string array holding all arguments (e.g. ["timeX", "ls", "-l", "-a", "|", "cat", "|", "grep", ".*.c"] )
-	char*** argvs;    // an vector of string array (e.g. [("ls", "-l", "-a"), ("cat"), ("grep", ".*.c")] )
-	
-	// variables
-	int argvsPos = 0;
-	int argPos = 0;
-	
-	/* Stage 1: Initialization of Argument Vector */
-		
-	// split the string into fragments by space, extract all arguments into rawArgs vector
-	if (iniStage == 0) {
-		rawArgs = constructArgv(string);
-		if (rawArgs == NULL) {
-			printf("3230shell: Fail to construct argument vector.\n");
-			iniStage = 1;
-		}
+	// an empty pipeline (e.g. a blank line) does nothing
+	if (pipeline->stageNum == 0) {
+		*status = 0;
+		return 0;
 	}
-	// quit if error occurs in Stage 1.
-	if (iniStage == 1) {
-		return output;
+	// handle every command, the pipeline is run periodically (see every.c)
+	if (pipeline->every > 0) {
+		return runEvery(pipeline, status);
 	}
-	
-	/* Stage 2: Paring argument vector and detect input errors.*/
-	
-	if (parStage == 0) {
-		// handle exit command
-		if (strcmp(rawArgs[0], "exit") == 0 && rawArgs[1] == NULL) {
+	// handle coproc prefix, the pipeline is run in background with pipes on both ends (see coproc.c)
+	if (pipeline->coproc != NULL) {
+		return startCoproc(pipeline, status);
+	}
+	// handle the assignments without command (e.g. "A=1 B=$A"), they set the shell variables
+	if (pipeline->stageNum == 1 && stages[0].argv[0] == NULL) {
+		*status = assignVariables(stages[0].assignments, stages[0].assignmentNum);
+		return 0;
+	}
+	// handle exit command
+	if (pipeline->stageNum == 1 && strcmp(stages[0].argv[0], "exit") == 0) {
+		if (subshell == 0) {
 			printf("3230shell: Terminated\n");
-			parStage = 1;
-			output = 1;
-		}
-		else if (strcmp(rawArgs[0], "exit") == 0 && rawArgs[1] != NULL) {
-			printf("3230shell: \"exit\" with other arguments!!!\n");
-			parStage = 1;
-			output = 0;
-		}
-		// handle pipe command
-		for (int i = 0; rawArgs[i] != NULL && parStage == 0; i++) {
-			if (strcmp(rawArgs[i], "|") == 0 && i == 0) {
-				printf("3230shell: syntax error near unexpected token `|'\n");
-				parStage = 1;
-				output = 0;
-			}
-			else if (strcmp(rawArgs[i], "|") == 0 && strcmp(rawArgs[i-1], "timeX") == 0 && i == 1) {
-				printf("3230shell: syntax error near unexpected token `|'\n");
-				parStage = 1;
-				output = 0;
-			}
-			else if (strcmp(rawArgs[i], "|") == 0 && rawArgs[i+1] == NULL) {
-				printf("3230shell: '|' should not appear in the last of the command line\n");
-				parStage = 1;
-				output = 0;
-			}
-			else if (strcmp(rawArgs[i], "|") == 0 && strcmp(rawArgs[i+1], "&") == 0) {
-				printf("3230shell: syntax error near unexpected token `|'\n");
-				parStage = 1;
-				output = 0;
-			}
-			else if (strcmp(rawArgs[i], "|") == 0 && strcmp(rawArgs[i+1], "|") == 0) {
-				printf("3230shell: should not have two consecutive | without in-between command\n");
-				parStage = 1;
-				output = 0;	
-			}
 		}
-		// handle & command
-		for (int i = 0; rawArgs[i] != NULL && parStage == 0; i++) {
-			if (strcmp(rawArgs[i], "&") == 0 && rawArgs[i+1] == NULL  && i == 0) {
-				printf("3230shell: '&' cannot be a standalone command\n");
-				parStage = 1;
-				output = 0;
-			}
-			else if (strcmp(rawArgs[i], "&") == 0 && rawArgs[i+1] != NULL  && i == 0) {
-				printf("3230shell: '&' should not appear in the begin of the command line\n");
-				parStage = 1;
-				output = 0;
-			}
-			else if (strcmp(rawArgs[i], "&") == 0 && rawArgs[i+1] != NULL) {
-				printf("3230shell: '&' should not appear in the middle of the command line\n");
-				parStage = 1;
-				output = 0;
-			}
-			else if (strcmp(rawArgs[i], "&") == 0 && rawArgs[i+1] == NULL) {
-				backgroundMode = 1;
-			}
+		return 1;
+	}
+	// handle the other built-in commands (e.g. "history", "export"), they run in the child process when they are piped
+	if (pipeline->stageNum == 1 && isBuiltin(stages[0].argv[0]) == 1) {
+		// the arguments are expanded like those of the other commands (e.g. "unset $NAME"), the process substitutions are not used
+		int mark = substitutionMark();
+		char** words = stages[0].expand == 1 ? expandWords(stages[0].argv) : NULL;
+		freeSubstitutions(takeSubstitutions(mark));
+		*status = runBuiltin(words != NULL ? words : stages[0].argv);
+		if (words != NULL) {
+			words = freeWords(words);
+		}
+		return 0;
+	}
+	
+	// Number of Process to be executed
+	int processNum = pipeline->stageNum;
+	// Number of pipe needed
+	int pipeNum = processNum - 1;
+	// container of pipes
+	int pipes[pipeNum > 0 ? pipeNum : 1][2];
+	// container of pids
+	int pids[processNum];
+	// the arguments and command passed to exec() (the arguments with quotes or "$(...)" are expanded first)
+	char** argvs[processNum];
+	char* paths[processNum];
+	char** expanded[processNum];
+	// the assignments before each command with expanded values, they are exported by the child process (NULL if none)
+	char** assigned[processNum];
+	// the process substitutions in the arguments of each command (NULL if none)
+	Substitutions* subs[processNum];
+	// the fds of redirections (e.g. here-documents) of each command
+	int* redirectFds[processNum];
+	for (int i = 0; i < processNum; i++) {
+		argvs[i] = stages[i].argv;
+		paths[i] = stages[i].path;
+		expanded[i] = NULL;
+		assigned[i] = NULL;
+		subs[i] = NULL;
+		redirectFds[i] = NULL;
+		if (exeStage == 1) {
+			continue;
 		}
-		// handle timeX command
-		if (strcmp(rawArgs[0], "timeX") == 0 && rawArgs[1] == NULL) {
-			printf("3230shell: \"timeX\" cannot be a standalone command\n");
-			parStage = 1;
-			output = 0;
+		// the process substitutions in the files of redirections and the arguments are launched with the command
+		int mark = substitutionMark();
+		redirectFds[i] = openRedirects(&stages[i]);
+		if (stages[i].redirectNum > 0 && redirectFds[i] == NULL) {
+			subs[i] = takeSubstitutions(mark);
+			exeStage = 1;
+			continue;
 		}
-		else if (strcmp(rawArgs[0], "timeX") == 0 && backgroundMode == 1) {
-			printf("3230shell: \"timeX\" cannot be run in background mode\n");
-			parStage = 1;
-			output = 0;
+		assigned[i] = expandAssignments(&stages[i]);
+		if (stages[i].expand == 0) {
+			subs[i] = takeSubstitutions(mark);
+			continue;
 		}
-		else if (strcmp(rawArgs[0], "timeX") == 0) {
-			timeXMode = 1;
+		expanded[i] = expandWords(stages[i].argv);
+		subs[i] = takeSubstitutions(mark);
+		// nothing left after expansion (e.g. "$(true)")
+		if (expanded[i][0] == NULL) {
+			if (processNum > 1) {
+				printf("3230shell: empty command in pipeline\n");
+			}
+			exeStage = 1;
+			continue;
 		}
-		else {
-			timeXMode = 0;
+		// the first field is the command with path, the argument vector hold the command without path
+		int count = 0;
+		while (expanded[i][count] != NULL) {
+			count++;
 		}
-	}
-	// quit if error occurs in Stage 2.
-	if (parStage == 1) {
-		// free char** rawArgs
-		for (int i = 0; i < max_num_of_arguments; i++) {
-			free(rawArgs[i]);
+		argvs[i] = (char**) malloc((count + 1) * sizeof(char*));
+		memcpy(argvs[i], expanded[i], (count + 1) * sizeof(char*));
+		paths[i] = expanded[i][0];
+		char* slash = strrchr(paths[i], '/');
+		if (slash != NULL && slash[1] != '\0') {
+			argvs[i][0] = slash + 1;
 		}
-		free(rawArgs);
-		return output;
 	}
-	
-	/* Stage 3: Allocation of task */
-	
-	// further split the arguments into independent command vector, and store in argvs
-	if (allStage == 0) {
-		// declare and initialize an vector that could contains argument vectors
-		argvs = (char***) malloc(max_num_of_arguments*sizeof(char**));
-		memset(argvs, 0, max_num_of_arguments*sizeof(char**));
-		for (int i = 0; i < max_num_of_arguments; i++) {
-			argvs[i] = initArgv(-1);
-		}
-		// variable that indicates the position of argvs and argv
-		argvsPos = 0;
-		argPos = 0;
-		// allocate the arguments in rawArgs into vector of argument vector, the $(argvs).
-		for (int i = 0; rawArgs[i] != NULL; i++) {
-			// ignore the & and timeX at beginning
-			if (strcmp(rawArgs[i], "&") == 0) {
-				continue;
-			}
-			else if (strcmp(rawArgs[i], "timeX") == 0 && i == 0) {
-				continue;
-			}
-			// split the commands by "|"
-			else if (strcmp(rawArgs[i], "|") == 0) {
-				argvs[argvsPos][argPos] = NULL;
-				argvsPos += 1;
-				argPos = 0;
-				continue;
-			}
-			else {
-				strcpy(argvs[argvsPos][argPos], rawArgs[i]);
-				argPos+=1;
-				continue;
-			}
+	// the output of a pipeline with "memo" is replayed from the cache if it has run before, nothing is launched (NULL if not memoized)
+	Memo* memo = exeStage == 0 && pipeline->memo == 1 ? openMemo(stages, processNum, paths, argvs, assigned, redirectFds,
+		pipeline->capture > 0 ? pipeline->capture : STDOUT_FILENO) : NULL;
+	int replayed = memo != NULL && memo->hit == 1;
+	// container of the time of fork
+	struct timespec forkTimes[processNum];
+	// number of process that has been forked
+	int launched = 0;
+	// number of pipes that has been created
+	int pipesCreated = 0;
+	// initialize all pipes
+	for (int i = 0; i < pipeNum && exeStage == 0 && replayed == 0; i++) {
+		if (pipe(pipes[i]) == -1) {
+			printf("3230shell: error with creating pipe\n");
+			exeStage = 1;
 		}
-		// Label the end of the array by NULL
-		free(argvs[argvsPos][argPos]);
-		for (int i = 0; i < max_num_of_arguments; i++) {
-			free(argvs[argvsPos+1][i]);
+		else {
+			pipesCreated += 1;
 		}
-		free(argvs[argvsPos+1]);
-		argvs[argvsPos][argPos] = NULL;
-		argvs[argvsPos+1] = NULL;
 	}
-	// quit if error occurs in Stage 3.
-	if (allStage == 1) {
-		// free char** rawArgs
-		for (int i = 0; i < max_num_of_arguments; i++) {
-			free(rawArgs[i]);
-		}
-		free(rawArgs);
-		// free char*** argvs
-		for (int i = 0; i < max_num_of_arguments; i++) {
-			for (int j = 0; j < max_num_of_arguments; j++) {
-				if (argvs[i] == NULL) {
-					break;
-				}
-				free(argvs[i][j]);
-			}
+	// the cgroup leaf of the job (NULL if the cgroup mode is off or the leaf could not be created)
+	JobCgroup* cgroup = exeStage == 0 && replayed == 0 ? createJobCgroup(argvs[0][0]) : NULL;
+	// the output of a background job is captured into its log if "joblog on" (NULL otherwise)
+	JobLog* log = exeStage == 0 && pipeline->background == 1 && pipeline->capture == 0 ? createJobLog(pipeline) : NULL;
+	int capture = memo != NULL ? memo->fd : log != NULL ? log->writeFd : pipeline->capture;
+	// the process group of job, a background job or a job with timeout run in its own group (0 if not created yet)
+	pid_t pgid = 0;
+	int ownGroup = pipeline->background == 1 || pipeline->timeout > 0;
+	// 1 if the terminal is given to the process group of a foreground job
+	int terminal = 0;
+	// execute the commands in child process one by one
+	for (int i = 0; i < processNum && exeStage == 0 && replayed == 0; i++) {
+		// register the signal handler to child process
+		regChildSighandler();
+		// a close-on-exec pipe that tell the parent whether exec() succeed (EOF) or fail (errno)
+		int execStatus[2];
+		if (pipe2(execStatus, O_CLOEXEC) == -1) {
+			printf("3230shell: error with creating pipe\n");
+			exeStage = 1;
+			continue;
 		}
-		for (int i = 0; i < max_num_of_arguments; i++) {
-			free(argvs[i]);
+		// record the time of fork
+		clock_gettime(CLOCK_MONOTONIC, &forkTimes[i]);
+		// flush the buffered output, so that the child process will not inherit and print it again
+		fflush(stdout);
+		// fork the child process and record its pid
+		pids[i] = fork();
+		/* Situation 1: failed to fork child process */
+		if (pids[i] == -1) {
+			printf("3230shell: error with creating porcess");
+			close(execStatus[0]);
+			close(execStatus[1]);
+			exeStage = 1;
+			continue;
 		}
-		free(argvs);
-		return output;
-	}
-	
-	/* Stage 4: Execution of task */
-	
-	// execute the command vectors (single command, multiple command in pipe, or in background)
-	if (exeStage == 0) {
-		// Number of Process to be executed
-		int processNum = argvsPos + 1;
-		// Number of pipe needed
-		int pipeNum = processNum - 1;
-		// container of pipes
-		int pipes[pipeNum][2];
-		// container of pids
-		int pids[processNum];
-		// container of timeX output
-		char timeXOutput[max_length_of_command];
-		memset(timeXOutput, 0, sizeof(timeXOutput));
-		// initialize all pipes
-		for (int i = 0; i < pipeNum && exeStage == 0; i++) {
-			if (pipe(pipes[i]) == -1) {
-				printf("3230shell: error with creating pipe\n");
-				exeStage = 1;
+		/* Situation 2: in child process */
+		else if (pids[i] == 0) {
+			// put the current child process into the group of job before doing anything (the first process lead the group)
+			if (ownGroup == 1) {
+				setpgid(0, pgid);
 			}
-		}
-		// execute the commands in child process one by one
-		for (int i = 0; i < processNum && exeStage == 0; i++) {
-			// register the signal handler to child process
-			regChildSighandler();
-			// store the full path of current command in $(fullPath)
-			char* fullPath = (char*) malloc(max_length_of_command*sizeof(char));
-			memset(fullPath, 0, max_length_of_command*sizeof(char));
-			strcpy(fullPath, argvs[i][0]);
-			// remove the full path from argv
-			removePath(argvs[i][0]);
-			// fork the child process and record its pid
-			pids[i] = fork();
-			/* Situation 1: failed to fork child process */
-			if (pids[i] == -1) {
-				printf("3230shell: error with creating porcess");
-				exeStage = 1;
+			// wait for SIGUSER1
+			while (siguser1Received != 1) {
 				continue;
 			}
-			/* Situation 2: in child process */
-			else if (pids[i] == 0) {
-				// turn the current child process into background mode before doing anything
-				if (backgroundMode == 1) {
-					setpgid(pids[i], pids[i]);
-				}
-				// wait for SIGUSER1
-				while (siguser1Received != 1) {
-					continue;
-				}
-				// close the unused pipe for current child process
-				for (int j = 0; j < pipeNum; j++) {
-					// First process: close all except the write port of itself
-					if (i == 0) {
-						close(pipes[j][0]);
-						if (j != i) {
-							close(pipes[j][1]);
-						}
-					}
-					// Last process: close all except read port of previous process
-					else if (i == processNum - 1) {
-						if (j != i-1) {
-							close(pipes[j][0]);
-						}
+			// close the unused pipe for current child process
+			for (int j = 0; j < pipeNum; j++) {
+				// First process: close all except the write port of itself
+				if (i == 0) {
+					close(pipes[j][0]);
+					if (j != i) {
 						close(pipes[j][1]);
 					}
-					// Middle process: close all r/w port except write port of itself and read port of previous process
-					else {
-						if (j != i-1) {
-							close(pipes[j][0]);
-						}
-						if (j != i) {
-							close(pipes[j][1]);
-						}
-					}
-				}
-				// redirect the I/O
-				if (processNum == 1) {
-					// if only one process, don't do any redirection of output
-				}
-				else if (i == 0) {
-					// First process: pass std output toward pipe
-					dup2(pipes[i][1], STDOUT_FILENO);
-					close(pipes[i][1]);
 				}
+				// Last process: close all except read port of previous process
 				else if (i == processNum - 1) {
-					// Last process: read std input from pipe
-					dup2(pipes[i-1][0], STDIN_FILENO);
-					close(pipes[i-1][0]);
+					if (j != i-1) {
+						close(pipes[j][0]);
+					}
+					close(pipes[j][1]);
 				}
+				// Middle process: close all r/w port except write port of itself and read port of previous process
 				else {
-					// Middle process: read std input from pipe and pass std output toward pipe
-					dup2(pipes[i][1], STDOUT_FILENO);
-					close(pipes[i][1]);
-					dup2(pipes[i-1][0], STDIN_FILENO);
-					close(pipes[i-1][0]);
+					if (j != i-1) {
+						close(pipes[j][0]);
+					}
+					if (j != i) {
+						close(pipes[j][1]);
+					}
 				}
-				
-				// execute the program	
-				execvp(fullPath, argvs[i]);
-				
-				// if the program fail to execute, print err message
-				char* temp = (char*) malloc(max_length_of_command*sizeof(char));
-				memset(temp, 0, (max_length_of_command*sizeof(char)));
-				strcat(temp, "3230shell: '");
-				strcat(temp, fullPath);
-				strcat(temp, "'");
-				perror(temp);
-				free(temp);
-				
-				// break the loop and terminate the program (because it is in child process).
-				exeStage = 1;
-				output = 1;
 			}
-			/* Situation 3: in parent process */
+			// redirect the I/O
+			if (processNum == 1) {
+				// if only one process, don't do any redirection of output
+			}
+			else if (i == 0) {
+				// First process: pass std output toward pipe
+				dup2(pipes[i][1], STDOUT_FILENO);
+				close(pipes[i][1]);
+			}
+			else if (i == processNum - 1) {
+				// Last process: read std input from pipe
+				dup2(pipes[i-1][0], STDIN_FILENO);
+				close(pipes[i-1][0]);
+			}
 			else {
-				// insert the task into the task record
-				headInsert(taskRecords, pids[i], argvs[i][0]);
-				// close the unused pipe
-				if (processNum == 1) {
-				}
-				else if (i == 0) {
-					close(pipes[i][1]);
-				}
-				else if (i == processNum - 1) {
-					close(pipes[i-1][0]);
+				// Middle process: read std input from pipe and pass std output toward pipe
+				dup2(pipes[i][1], STDOUT_FILENO);
+				close(pipes[i][1]);
+				dup2(pipes[i-1][0], STDIN_FILENO);
+				close(pipes[i-1][0]);
+			}
+			
+			// the input of the first command is given (e.g. by "coproc")
+			if (i == 0 && pipeline->input > 0) {
+				dup2(pipeline->input, STDIN_FILENO);
+			}
+			// the output of the last command is captured (e.g. by "every -c", "joblog on" or "coproc")
+			if (i == processNum - 1 && capture > 0) {
+				dup2(capture, STDOUT_FILENO);
+			}
+			// redirect the I/O of here-documents and here-strings
+			applyRedirects(&stages[i], redirectFds[i]);
+			// apply the resource limits, nice value, I/O priority and CPU affinity
+			applyLimits(stages[i].limits);
+			// put the assignments before command into the environment (only the copy of child process is changed)
+			exportAssignments(assigned[i]);
+			// keep the pipes of process substitutions open across exec() as "/dev/fd/N"
+			inheritSubstitutions(subs[i]);
+			
+			// execute the program	
+			close(execStatus[0]);
+			// a piped built-in command is run by the child process itself
+			if (processNum > 1) {
+				int builtin = runBuiltin(argvs[i]);
+				if (builtin != -1) {
+					fflush(stdout);
+					_exit(builtin);
 				}
-				else {
-					close(pipes[i-1][0]);
-					close(pipes[i][1]);
+			}
+			execvp(paths[i], argvs[i]);
+			
+			// if the program fail to execute, print err message
+			int execErrno = errno;
+			char* temp = (char*) malloc(max_length_of_command*sizeof(char));
+			memset(temp, 0, (max_length_of_command*sizeof(char)));
+			snprintf(temp, max_length_of_command, "3230shell: '%s'", paths[i]);
+			perror(temp);
+			free(temp);
+			
+			// report the failure to parent, and terminate the child process immediately,
+			// so that it will not go back to the main loop of the shell.
+			if (write(execStatus[1], &execErrno, sizeof(execErrno)) == -1) {
+				// nothing more can be done here
+			}
+			_exit(127);
+		}
+		/* Situation 3: in parent process */
+		else {
+			launched += 1;
+			jobStarted();
+			// count the background process before it is recorded, so the handler of SIGCHLD does not stop before it
+			if (pipeline->background == 1) {
+				runningBackground += 1;
+			}
+			// insert the task into the task record (the first process is the leader of its own group)
+			headInsert(taskRecords, pids[i], argvs[i][0], forkTimes[i], pipeline->background, ownGroup == 1 ? (pgid != 0 ? pgid : pids[i]) : 0);
+			// the fds of redirections are only used by child process
+			redirectFds[i] = closeRedirects(&stages[i], redirectFds[i]);
+			// close the unused pipe
+			if (processNum == 1) {
+			}
+			else if (i == 0) {
+				close(pipes[i][1]);
+			}
+			else if (i == processNum - 1) {
+				close(pipes[i-1][0]);
+			}
+			else {
+				close(pipes[i-1][0]);
+				close(pipes[i][1]);
+			}
+			// the group is also set by parent, so it is ready before the terminal is given and the child process exec()
+			if (ownGroup == 1) {
+				if (pgid == 0) {
+					pgid = pids[i];
 				}
-				// signal the child process to start
-				kill(pids[i], SIGUSR1);
-				// not wait for child process
-				if (backgroundMode == 1) {
-					// do nothing in parent process
+				setpgid(pids[i], pgid);
+				// a foreground job take the terminal, so Ctrl-C is sent to it instead of the shell
+				if (pipeline->background == 0 && terminal == 0 && tcgetpgrp(STDIN_FILENO) == getpgrp()) {
+					terminal = tcsetpgrp(STDIN_FILENO, pgid) == 0;
 				}
-				// wait the process to finish
-				else if (timeXMode == 1) {
-					// wait for child process to finish
-					int status;
-					struct rusage usage;
-					wait4(pids[i], &status, 0, &usage);
-					// append the timeX message to the buffer
-					char temp[max_length_of_command];
-					snprintf(temp, sizeof(temp), "(PID)%d  (CMD)%s    (user)%ld.%03ld s  (sys)%ld.%03ld s\n", pids[i], argvs[i][0], usage.ru_utime.tv_sec, usage.ru_utime.tv_usec/1000, usage.ru_stime.tv_sec, usage.ru_stime.tv_usec/1000);
-					strcat(timeXOutput, temp);
-					// kill the child process after everthing has done.
-					kill(pids[i], SIGKILL);
+			}
+			// start the process substitutions of command in the same job
+			launchSubstitutions(subs[i], ownGroup == 1 ? pgid : 0, cgroup, pipeline->background);
+			// move the child process into the cgroup of job before it exec()
+			placeInCgroup(cgroup, pids[i]);
+			// signal the child process to start
+			kill(pids[i], SIGUSR1);
+			// wait until the child process has exec() (EOF) or fail to exec() (errno)
+			close(execStatus[1]);
+			int execErrno = 0;
+			if (read(execStatus[0], &execErrno, sizeof(execErrno)) > 0) {
+				shellStat.execFailures += 1;
+			}
+			else {
+				recordLatency(&shellStat.forkToExec, elapsedNanos(&forkTimes[i]));
+			}
+			close(execStatus[0]);
+		}
+	}
+	// the write end of log is only used by the last command, the shell watch the read end
+	startJobLog(log, pgid);
+	// the job is terminated if it is still running after the timeout
+	if (pgid != 0 && pipeline->timeout > 0) {
+		armWatchdog(pgid, pipeline->timeout, pipeline->killAfter);
+	}
+	// close the pipes that are left open because of error
+	if (exeStage == 1) {
+		for (int j = 0; j < pipesCreated; j++) {
+			if (j >= launched) {
+				close(pipes[j][1]);
+			}
+			if (j >= launched - 1) {
+				close(pipes[j][0]);
+			}
+		}
+		// a single command that expand to nothing is not an error
+		*status = (processNum == 1 && expanded[0] != NULL && expanded[0][0] == NULL) ? 0 : 1;
+	}
+	// not wait for child process in background mode
+	if (pipeline->background == 1) {
+		// do nothing in parent process
+		*status = exeStage;
+		if (launched > 0) {
+			lastBackground = pids[launched-1];
+		}
+	}
+	else {
+		// container of timeX output (one line for each command, and one line for the cgroup of job)
+		char timeXOutput[max_length_of_command * (processNum + 1)];
+		memset(timeXOutput, 0, sizeof(timeXOutput));
+		// 1 if a process is terminated by Ctrl-C
+		int interrupted = 0;
+		// wait the processes to finish
+		for (int i = 0; i < launched; i++) {
+			int childStatus = 0;
+			if (pipeline->timeX == 1) {
+				// wait for child process to finish (the output of background jobs and "memo" is read meanwhile)
+				struct rusage usage;
+				waitMemo(memo, pids[i]);
+				wait4(pids[i], &childStatus, 0, &usage);
+				jobReaped(&forkTimes[i]);
+				Node* node = searchNode(taskRecords, pids[i]);
+				if (node != NULL) {
+					node->done = 1;
 				}
-				else {
-					// wait for child process to finish
-					waitpid(pids[i], NULL, 0);
-					// kill the child process after everthing has done.
-					kill(pids[i], SIGKILL);
+				// append the timeX message to the buffer
+				char temp[max_length_of_command];
+				snprintf(temp, sizeof(temp), "(PID)%d  (CMD)%s    (user)%ld.%03ld s  (sys)%ld.%03ld s\n", pids[i], argvs[i][0], usage.ru_utime.tv_sec, usage.ru_utime.tv_usec/1000, usage.ru_stime.tv_sec, usage.ru_stime.tv_usec/1000);
+				strcat(timeXOutput, temp);
+			}
+			else {
+				// wait for child process to finish (the output of background jobs and "memo" is read meanwhile)
+				waitMemo(memo, pids[i]);
+				waitpid(pids[i], &childStatus, 0);
+				jobReaped(&forkTimes[i]);
+				Node* node = searchNode(taskRecords, pids[i]);
+				if (node != NULL) {
+					node->done = 1;
 				}
-				// restore the full path back to argv
-				strcpy(argvs[i][0], fullPath);
-				// free the temp variable
-				free(fullPath);
+			}
+			if (WIFSIGNALED(childStatus) && WTERMSIG(childStatus) == SIGINT) {
+				interrupted = 1;
+			}
+			// the status of pipeline is the status of its last command
+			if (exeStage == 0 && i == processNum - 1) {
+				*status = exitStatusOf(childStatus);
+			}
+		}
+		// wait for the process substitutions, they are part of the job
+		for (int i = 0; i < processNum; i++) {
+			waitSubstitutions(subs[i]);
+		}
+		// the deadline is cancelled when the job finish, the status is the same as timeout(1) if it has expired
+		if (pgid != 0 && pipeline->timeout > 0 && cancelWatchdog(pgid) == 1) {
+			*status = timeout_status;
+		}
+		// take back the terminal (SIGTTOU is blocked, since the shell is not in the foreground group now)
+		if (terminal == 1) {
+			sigset_t mask;
+			sigset_t saved;
+			sigemptyset(&mask);
+			sigaddset(&mask, SIGTTOU);
+			sigprocmask(SIG_BLOCK, &mask, &saved);
+			tcsetpgrp(STDIN_FILENO, getpgrp());
+			sigprocmask(SIG_SETMASK, &saved, NULL);
+			// the shell does not receive the Ctrl-C that is sent to the job, so the message is printed here
+			if (interrupted == 1) {
+				printf("Interrupt\n");
 			}
 		}
-		// print the timeX message
-		if (timeXMode == 1) {
+		// print the timeX message, the usage of the whole job is added if it is known from the cgroup
+		if (pipeline->timeX == 1) {
+			int length = strlen(timeXOutput);
+			formatCgroupUsage(cgroup, "(JOB)", &timeXOutput[length], sizeof(timeXOutput) - length);
 			printf("%s", timeXOutput);
-			memset(timeXOutput, 0, sizeof(timeXOutput));
 		}
-
+		// replay the output of "memo" on a hit (the output of a miss is copied while waiting), the entry is kept if the pipeline complete normally
+		if (memo != NULL) {
+			int store = exeStage == 0 && interrupted == 0 && *status < 126 && !(pipeline->timeout > 0 && *status == timeout_status);
+			*status = closeMemo(memo, *status, store);
+		}
 	}
-	
-	// free char** rawArgs
-	for (int i = 0; i < max_num_of_arguments; i++) {
-		free(rawArgs[i]);
+	// the usage of a background job is printed when its cgroup become empty
+	releaseJobCgroup(cgroup, pipeline->background);
+	// free the expanded arguments, the assignments, the process substitutions and the fds of redirections
+	for (int i = 0; i < processNum; i++) {
+		redirectFds[i] = closeRedirects(&stages[i], redirectFds[i]);
+		if (assigned[i] != NULL) {
+			assigned[i] = freeWords(assigned[i]);
+		}
+		subs[i] = freeSubstitutions(subs[i]);
+		if (expanded[i] != NULL) {
+			if (argvs[i] != stages[i].argv) {
+				free(argvs[i]);
+			}
+			expanded[i] = freeWords(expanded[i]);
+		}
 	}
-	free(rawArgs);
+	return output;
+}
 
-	// free char*** argvs
-	for (int i = 0; i < max_num_of_arguments; i++) {
-		for (int j = 0; j < max_num_of_arguments; j++) {
-			if (argvs[i] == NULL) {
-				break;
-			}
-			free(argvs[i][j]);
+/*
+Parse the arguments and execute arguments.
+There are 5 stages when start a task:
+
+Stage 0: Declaration of  all necessary variables
+    I guess I don't need to explain?
+    If the command line is in the parsed command cache, go to Stage 3 directly (see cache.c).
+Stage 1: Initialization of argument vector
+    pre-process the command line input $(string) and convert it into argument vector.
+    e.g. "ls -l -a |grep c$ && echo ok" -> {"ls", "-l", "-a", "|", "grep", "c$", "&&", "echo", "ok"}
+Stage 2: Paring argument vector and detect input errors.
+    Parse the argument vector into a command list (see ast.c), and put it into the cache.
+	e.g. -> [([("ls", "-l", "-a"), ("grep", "c$")], &&), ([("echo", "ok")], end)]
+	Check the input error of exit, shellstat, timeX, &, |, ;, &&, ||.
+	s.t. if any error, pop err message and enter next loop.
+Stage 3: Evaluation of command list
+    Decide whether each pipeline is run by the exit status of previous pipeline.
+	i.e. "&&" run the next pipeline if succeed, "||" run the next pipeline if fail, ";" and "&" always run the next pipeline.
+Stage 4: Execution of task
+    Execute the pipeline (see executePipeline()).
+If there is any error in any stage, the function will free all memory and quit.
+
+@param string The command line input (it is not modified).
+
+@return output The status code of exit, if 1, then quit main process.
+*/
+int startTasks(char* string) {
+	
+	/* Stage 0: Declare variables */
+	
+	// return value ( 0 -> enter next loop, 1 -> exit the main program)
+	int output = 0;
+	
+	// containers
+	char** rawArgs;    // an string array holding all arguments (e.g. ["timeX", "ls", "-l", "-a", "|", "cat", "&&", "grep", ".*.c"] )
+	CommandList* list;    // the pipelines connected by operators (e.g. [([("ls", "-l", "-a"), ("cat")], &&), ([("grep", ".*.c")], end)] )
+	
+	// the time that parsing begins
+	struct timespec parseStart;
+	clock_gettime(CLOCK_MONOTONIC, &parseStart);
+	shellStat.commands += 1;
+	
+	// the parsed command list of a repeated command line is in the cache
+	list = lookupCommandCache(string);
+	
+	if (list == NULL) {
+		
+		/* Stage 1: Initialization of Argument Vector */
+		
+		// the lines after the first line are the bodies of here-documents
+		char* bodies = strchr(string, '\n');
+		int length = bodies != NULL ? (int) (bodies - string) : (int) strlen(string);
+		// preprocess the input for ease of parsing.
+		Buffer* buffer = initBuffer(length + 2);
+		memcpy(buffer->string, string, length);
+		buffer->string[length] = '\0';
+		buffer = preprocessBuffer(buffer);
+		// split the string into fragments by space, extract all arguments into rawArgs vector
+		rawArgs = constructArgv(buffer->string);
+		if (rawArgs == NULL) {
+			printf("3230shell: Fail to construct argument vector.\n");
+			buffer = freeBuffer(buffer);
+			return output;
 		}
+		
+		/* Stage 2: Paring argument vector and detect input errors.*/
+		
+		list = parseCommandList(rawArgs, bodies != NULL ? bodies + 1 : NULL);
+		free(rawArgs);
+		buffer = freeBuffer(buffer);
+		// quit if error occurs in Stage 2.
+		if (list == NULL) {
+			return output;
+		}
+		// remember the parsed command list (with the full path of commands) for the same command line
+		insertCommandCache(string, list);
 	}
-	for (int i = 0; i < max_num_of_arguments; i++) {
-		free(argvs[i]);
+	// record the time spent on parsing
+	recordLatency(&shellStat.parseTime, elapsedNanos(&parseStart));
+	// nothing to run for a blank line
+	if (list->pipelineNum == 0) {
+		list = freeCommandList(list);
+		return output;
+	}
+	
+	/* Stage 3 & 4: Evaluation of command list and execution of task */
+	
+	for (int i = 0; i < list->pipelineNum && output == 0; i++) {
+		// short-circuit by the exit status of previous pipeline
+		Connector connector = i > 0 ? list->pipelines[i-1].connector : CONNECT_SEQ;
+		if (connector == CONNECT_AND && lastStatus != 0) {
+			continue;
+		}
+		else if (connector == CONNECT_OR && lastStatus == 0) {
+			continue;
+		}
+		output = executePipeline(&list->pipelines[i], &lastStatus);
 	}
-	free(argvs);
+	
+	// free the command list
+	list = freeCommandList(list);
 	
 	return output;
 }
-
-	
\ No newline at end of file
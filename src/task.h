@@ -7,9 +7,21 @@ Description: Hold the function header of task.c.
 Remark:      None of function is implemented in this file.
 */
 
+#include "ast.h"
+
 #ifndef TASK_H
 #define TASK_H
 
+char** constructArgv(char* string);
+
+int exitStatusOf(int status);
+
+int isBuiltin(char* name);
+
+int runBuiltin(char** argv);
+
+int executePipeline(Pipeline* pipeline, int* status);
+
 int startTasks(char* string);
 
 void removePath(char* string);
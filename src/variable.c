@@ -0,0 +1,412 @@
+/*
+FileName:    variable.c
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: The shell variables ("NAME=VALUE", "export" and "unset"), and the environment passed to the child processes.
+             The variables are kept in a hash table, each one is stored as a "NAME=VALUE" string,
+             and an exported variable put the same string into the environment array at a known index.
+             So the environment is only updated in place when an exported variable change, it is never assembled again before fork(),
+             and "environ" point to the array, so exec() and getenv() (e.g. $PATH of the command cache) use it directly.
+             A command with assignments (e.g. "LANG=C sort") apply them to the copy of the array in the child process,
+             it cost O(number of assignments) however large the environment is.
+Remark:      function implemented in this file:
+             1. Shell variables and the built-in commands export and unset: ALL (the "$NAME" are expanded by expand.c)
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ast.h"
+#include "expand.h"
+#include "variable.h"
+
+// a global variable that store the shell variables and the environment
+VariableTable variables = {0};
+
+/*
+Hash the name of a variable by FNV-1a.
+
+@param name The name (it may be followed by "=VALUE")
+@param length The length of name
+
+@return hash The hash value
+*/
+unsigned long hashName(char* name, int length) {
+	unsigned long hash = 14695981039346656037UL;
+	for (int i = 0; i < length; i++) {
+		hash ^= (unsigned char) name[i];
+		hash *= 1099511628211UL;
+	}
+	return hash;
+}
+
+/*
+Find a variable by its name.
+
+@param name The name (it may be followed by "=VALUE")
+@param length The length of name
+@param hash The hash of name
+
+@return variable The variable (NULL if it is not set)
+*/
+Variable* findVariable(char* name, int length, unsigned long hash) {
+	if (variables.buckets == NULL) {
+		return NULL;
+	}
+	Variable* variable = variables.buckets[hash & (variables.bucketNum - 1)];
+	while (variable != NULL) {
+		if (variable->hash == hash && variable->nameLength == length && strncmp(variable->entry, name, length) == 0) {
+			return variable;
+		}
+		variable = variable->next;
+	}
+	return NULL;
+}
+
+/*
+Double the buckets of the variable table, so the chains stay short.
+
+@param void
+
+@return void
+*/
+void growVariableTable(void) {
+	int bucketNum = variables.bucketNum * 2;
+	Variable** buckets = (Variable**) malloc(bucketNum * sizeof(Variable*));
+	memset(buckets, 0, bucketNum * sizeof(Variable*));
+	for (int i = 0; i < variables.bucketNum; i++) {
+		Variable* variable = variables.buckets[i];
+		while (variable != NULL) {
+			Variable* next = variable->next;
+			variable->next = buckets[variable->hash & (bucketNum - 1)];
+			buckets[variable->hash & (bucketNum - 1)] = variable;
+			variable = next;
+		}
+	}
+	free(variables.buckets);
+	variables.buckets = buckets;
+	variables.bucketNum = bucketNum;
+}
+
+/*
+Import the inherited environment as the exported variables, and point "environ" to the environment of shell.
+It is called once at startup, and by the first use of variables if it is not called.
+
+@param void
+
+@return void
+*/
+void initVariables(void) {
+	if (variables.buckets != NULL) {
+		return;
+	}
+	variables.bucketNum = variable_buckets;
+	variables.buckets = (Variable**) malloc(variables.bucketNum * sizeof(Variable*));
+	memset(variables.buckets, 0, variables.bucketNum * sizeof(Variable*));
+	variables.envCapacity = 64;
+	variables.envp = (char**) malloc(variables.envCapacity * sizeof(char*));
+	variables.envp[0] = NULL;
+	// "environ" is replaced while importing, so the inherited array is taken first
+	char** inherited = environ;
+	environ = variables.envp;
+	for (int i = 0; inherited != NULL && inherited[i] != NULL; i++) {
+		char* equal = strchr(inherited[i], '=');
+		if (equal != NULL && equal != inherited[i]) {
+			setVariable(inherited[i], equal - inherited[i], equal + 1, 1);
+		}
+	}
+}
+
+/*
+Get the length of the variable name at the beginning of a word (letters, digits and '_', not start with digit).
+
+@param word The word
+
+@return length The length of name (0 if it does not start with a name)
+*/
+int nameLengthOf(char* word) {
+	int length = 0;
+	while (word[length] == '_' || (word[length] >= 'A' && word[length] <= 'Z') || (word[length] >= 'a' && word[length] <= 'z')
+		|| (length > 0 && word[length] >= '0' && word[length] <= '9')) {
+		length++;
+	}
+	return length;
+}
+
+/*
+Check whether a word is a variable assignment (i.e. "NAME=VALUE").
+
+@param word The word
+
+@return length The length of NAME, 0 if it is not an assignment
+*/
+int isAssignment(char* word) {
+	int length = nameLengthOf(word);
+	return length > 0 && word[length] == '=' ? length : 0;
+}
+
+/*
+Check whether a word is a valid name of variable.
+
+@param word The word
+
+@return 1 if it is a valid name, 0 otherwise
+*/
+int isVariableName(char* word) {
+	int length = nameLengthOf(word);
+	return length > 0 && word[length] == '\0';
+}
+
+/*
+Get the value of a variable.
+
+@param name The name (it may be followed by other chars, e.g. "HOME/bin")
+@param length The length of name
+
+@return value The value (NULL if it is not set), it is valid until the variable is changed
+*/
+char* getVariable(char* name, int length) {
+	Variable* variable = findVariable(name, length, hashName(name, length));
+	return variable != NULL ? &variable->entry[variable->nameLength + 1] : NULL;
+}
+
+/*
+Set the value of a variable, the environment is updated in place if it is exported.
+
+@param name The name (it may be followed by other chars, e.g. "NAME=VALUE")
+@param length The length of name
+@param value The value (it may point into the old value)
+@param export 1 if the variable is exported, 0 if it keep whether it is exported or not
+
+@return status 0 (the name is checked by the caller)
+*/
+int setVariable(char* name, int length, char* value, int export) {
+	initVariables();
+	unsigned long hash = hashName(name, length);
+	Variable* variable = findVariable(name, length, hash);
+	// an unchanged variable cost nothing
+	if (variable != NULL && strcmp(&variable->entry[length + 1], value) == 0 && (export == 0 || variable->envIndex != -1)) {
+		return 0;
+	}
+	// build the new "NAME=VALUE" before the old one is freed, since $(name) and $(value) may point into it
+	int valueLength = strlen(value);
+	char* entry = (char*) malloc(length + valueLength + 2);
+	memcpy(entry, name, length);
+	entry[length] = '=';
+	memcpy(&entry[length + 1], value, valueLength + 1);
+	if (variable == NULL) {
+		if (variables.count >= variables.bucketNum) {
+			growVariableTable();
+		}
+		variable = (Variable*) malloc(sizeof(Variable));
+		variable->nameLength = length;
+		variable->envIndex = -1;
+		variable->hash = hash;
+		variable->next = variables.buckets[hash & (variables.bucketNum - 1)];
+		variables.buckets[hash & (variables.bucketNum - 1)] = variable;
+		variables.count += 1;
+	}
+	else {
+		free(variable->entry);
+	}
+	variable->entry = entry;
+	// update the environment in place, or append to it if the variable is exported now
+	if (variable->envIndex != -1) {
+		variables.envp[variable->envIndex] = entry;
+	}
+	else if (export == 1) {
+		if (variables.envCount + 1 >= variables.envCapacity) {
+			variables.envCapacity *= 2;
+			variables.envp = (char**) realloc(variables.envp, variables.envCapacity * sizeof(char*));
+			environ = variables.envp;
+		}
+		variable->envIndex = variables.envCount;
+		variables.envp[variables.envCount++] = entry;
+		variables.envp[variables.envCount] = NULL;
+	}
+	return 0;
+}
+
+/*
+Remove a variable, it is also removed from the environment if it is exported.
+The last entry of environment is moved to its place, so the environment stay compact.
+
+@param name The name
+
+@return void
+*/
+void unsetVariable(char* name) {
+	int length = strlen(name);
+	unsigned long hash = hashName(name, length);
+	Variable* variable = findVariable(name, length, hash);
+	if (variable == NULL) {
+		return;
+	}
+	if (variable->envIndex != -1) {
+		char* last = variables.envp[--variables.envCount];
+		variables.envp[variables.envCount] = NULL;
+		if (last != variable->entry) {
+			int lastLength = strchr(last, '=') - last;
+			Variable* moved = findVariable(last, lastLength, hashName(last, lastLength));
+			moved->envIndex = variable->envIndex;
+			variables.envp[variable->envIndex] = last;
+		}
+	}
+	// unlink it from the bucket
+	Variable** link = &variables.buckets[hash & (variables.bucketNum - 1)];
+	while (*link != variable) {
+		link = &(*link)->next;
+	}
+	*link = variable->next;
+	variables.count -= 1;
+	free(variable->entry);
+	free(variable);
+}
+
+/*
+Run the assignments of a command line without command (e.g. "A=1 B=$A"), the values are expanded one by one.
+The variables that are exported stay exported, the new variables are not exported.
+
+@param assignments The assignments ("NAME=VALUE")
+@param count The number of assignments
+
+@return status The exit status (always 0)
+*/
+int assignVariables(char** assignments, int count) {
+	for (int i = 0; i < count; i++) {
+		int length = isAssignment(assignments[i]);
+		char* value = expandText(&assignments[i][length + 1], 1);
+		setVariable(assignments[i], length, value, 0);
+		free(value);
+	}
+	return 0;
+}
+
+/*
+Expand the values of the assignments before a command (e.g. "LANG=C TZ=$ZONE date"),
+so that the child process only need to put them into its environment.
+
+@param stage The command
+
+@return entries The NULL terminated "NAME=VALUE" with expanded values (free it by freeWords()), NULL if there is no assignment
+*/
+char** expandAssignments(Stage* stage) {
+	if (stage->assignmentNum == 0) {
+		return NULL;
+	}
+	char** entries = (char**) malloc((stage->assignmentNum + 1) * sizeof(char*));
+	for (int i = 0; i < stage->assignmentNum; i++) {
+		int length = isAssignment(stage->assignments[i]);
+		char* value = expandText(&stage->assignments[i][length + 1], 1);
+		entries[i] = (char*) malloc(length + strlen(value) + 2);
+		memcpy(entries[i], stage->assignments[i], length + 1);
+		strcpy(&entries[i][length + 1], value);
+		free(value);
+	}
+	entries[stage->assignmentNum] = NULL;
+	return entries;
+}
+
+/*
+Export the assignments before a command into the environment.
+It is called in the child process just before exec(), so only the copy of environment in the child process is changed.
+
+@param entries The NULL terminated "NAME=VALUE" returned by expandAssignments() (NULL if none)
+
+@return void
+*/
+void exportAssignments(char** entries) {
+	for (int i = 0; entries != NULL && entries[i] != NULL; i++) {
+		int length = isAssignment(entries[i]);
+		setVariable(entries[i], length, &entries[i][length + 1], 1);
+	}
+}
+
+/*
+Run the built-in command "export".
+"export" list the environment, "export NAME=VALUE" set and export a variable,
+and "export NAME" export a variable (it is set to empty if it is not set).
+
+@param argv The expanded arguments (e.g. {"export", "PATH=/usr/bin:/opt/bin", NULL})
+
+@return status The exit status (1 if there is an invalid name)
+*/
+int runExport(char** argv) {
+	initVariables();
+	if (argv[1] == NULL) {
+		for (int i = 0; i < variables.envCount; i++) {
+			char* equal = strchr(variables.envp[i], '=');
+			printf("export %.*s=\"%s\"\n", (int) (equal - variables.envp[i]), variables.envp[i], equal + 1);
+		}
+		return 0;
+	}
+	int status = 0;
+	for (int i = 1; argv[i] != NULL; i++) {
+		char* word = argv[i];
+		int length = isAssignment(word);
+		if (length > 0) {
+			setVariable(word, length, &word[length + 1], 1);
+		}
+		else if (isVariableName(word)) {
+			char* value = getVariable(word, strlen(word));
+			setVariable(word, strlen(word), value != NULL ? value : "", 1);
+		}
+		else {
+			printf("3230shell: export: '%s': not a valid identifier\n", word);
+			status = 1;
+		}
+	}
+	return status;
+}
+
+/*
+Run the built-in command "unset", i.e. remove the variables (and from the environment).
+
+@param argv The expanded arguments (e.g. {"unset", "LANG", NULL})
+
+@return status The exit status (1 if there is an invalid name)
+*/
+int runUnset(char** argv) {
+	int status = 0;
+	for (int i = 1; argv[i] != NULL; i++) {
+		if (isVariableName(argv[i])) {
+			unsetVariable(argv[i]);
+		}
+		else {
+			printf("3230shell: unset: '%s': not a valid identifier\n", argv[i]);
+			status = 1;
+		}
+	}
+	return status;
+}
+
+/*
+Free the variables and the environment.
+
+@param void
+
+@return void
+*/
+void freeVariables(void) {
+	if (variables.buckets == NULL) {
+		return;
+	}
+	for (int i = 0; i < variables.bucketNum; i++) {
+		Variable* variable = variables.buckets[i];
+		while (variable != NULL) {
+			Variable* next = variable->next;
+			free(variable->entry);
+			free(variable);
+			variable = next;
+		}
+	}
+	free(variables.buckets);
+	free(variables.envp);
+	environ = NULL;
+	memset(&variables, 0, sizeof(VariableTable));
+}
@@ -0,0 +1,63 @@
+/*
+FileName:    variable.h
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: Hold the function header of variable.c, provide self defined structure.
+Remark:      None of function is implemented in this file.
+*/
+
+#include "ast.h"
+
+#ifndef VARIABLE_H
+#define VARIABLE_H
+
+// the initial number of buckets of the variable table (it is doubled when there are more variables than buckets)
+#define variable_buckets 256
+
+// a shell variable, it is stored as "NAME=VALUE" so an exported variable is put into the environment as it is
+typedef struct Variable {
+	char* entry;            // "NAME=VALUE"
+	int nameLength;         // the length of NAME, the value start at $(entry[nameLength+1])
+	int envIndex;           // the index of $(entry) in the environment (-1 if it is not exported)
+	unsigned long hash;     // the hash of NAME
+	struct Variable* next;  // the next variable in the same bucket
+} Variable;
+
+// the shell variables, and the environment passed to the child processes
+typedef struct VariableTable {
+	Variable** buckets;
+	int bucketNum;
+	int count;              // number of variables
+	char** envp;            // NULL terminated environment of the exported variables ("environ" point to it)
+	int envCount;           // number of exported variables
+	int envCapacity;        // capacity of $(envp)
+} VariableTable;
+
+void initVariables(void);
+
+int nameLengthOf(char* word);
+
+int isAssignment(char* word);
+
+int isVariableName(char* word);
+
+char* getVariable(char* name, int length);
+
+int setVariable(char* name, int length, char* value, int export);
+
+void unsetVariable(char* name);
+
+int assignVariables(char** assignments, int count);
+
+char** expandAssignments(Stage* stage);
+
+void exportAssignments(char** entries);
+
+int runExport(char** argv);
+
+int runUnset(char** argv);
+
+void freeVariables(void);
+
+#endif
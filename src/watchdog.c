@@ -0,0 +1,340 @@
+/*
+FileName:    watchdog.c
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: The watchdog of prefix "timeout" (e.g. "timeout -k 2 10s make | tee log").
+             The deadlines of all jobs are kept in a min-heap, and only one POSIX timer is armed for the earliest one,
+             so the cost does not grow with the number of jobs that carry a deadline (no watchdog process is created).
+             When a deadline expire, SIGTERM is sent to the process group of job, then SIGKILL after the grace period.
+Remark:      function implemented in this file:
+             1. Prefix "timeout" of pipeline: ALL (the process group of job is created in task.c)
+*/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "watchdog.h"
+
+// the min-heap of deadlines ordered by the time
+Deadline* deadlines = NULL;
+int deadlineNum = 0;
+int deadlineCapacity = 0;
+// the timer shared by all deadlines, it deliver SIGALRM
+timer_t watchdogTimer;
+// 1 if the timer and the handler of SIGALRM are set up
+int watchdogReady = 0;
+
+/*
+Parse a duration, the unit is one of "ms", "s" (default), "m", "h" and "d" (e.g. "1.5", "500ms", "2m").
+
+@param text The duration
+@param seconds The space to hold the seconds
+
+@return status 0 if success, 1 if it is invalid or not positive
+*/
+int parseDuration(char* text, double* seconds) {
+	char* end = NULL;
+	errno = 0;
+	double value = strtod(text, &end);
+	if (errno != 0 || end == text || !(value > 0)) {
+		return 1;
+	}
+	if (strcmp(end, "ms") == 0) {
+		value /= 1000;
+	}
+	else if (strcmp(end, "m") == 0) {
+		value *= 60;
+	}
+	else if (strcmp(end, "h") == 0) {
+		value *= 3600;
+	}
+	else if (strcmp(end, "d") == 0) {
+		value *= 86400;
+	}
+	else if (strcmp(end, "s") != 0 && *end != '\0') {
+		return 1;
+	}
+	// the deadline must fit in a timespec
+	if (value > 1e9) {
+		return 1;
+	}
+	*seconds = value;
+	return 0;
+}
+
+/*
+Parse the prefix "timeout [-k DURATION] DURATION" at the beginning of a pipeline.
+
+@param tokens The tokens start with "timeout"
+@param timeout The space to hold the seconds before SIGTERM
+@param killAfter The space to hold the seconds between SIGTERM and SIGKILL (2 seconds by default)
+
+@return consumed The number of tokens after "timeout" that are taken (-1 if they are invalid, the message is printed)
+*/
+int parseTimeout(char** tokens, double* timeout, double* killAfter) {
+	int consumed = 0;
+	*killAfter = 2;
+	if (tokens[1] != NULL && strcmp(tokens[1], "-k") == 0) {
+		if (tokens[2] == NULL || parseDuration(tokens[2], killAfter) != 0) {
+			printf("3230shell: timeout: invalid duration '%s'\n", tokens[2] != NULL ? tokens[2] : "");
+			return -1;
+		}
+		consumed = 2;
+	}
+	char* duration = tokens[consumed + 1];
+	if (duration == NULL) {
+		printf("3230shell: timeout: usage: timeout [-k DURATION] DURATION command\n");
+		return -1;
+	}
+	if (parseDuration(duration, timeout) != 0) {
+		printf("3230shell: timeout: invalid duration '%s'\n", duration);
+		return -1;
+	}
+	return consumed + 1;
+}
+
+/*
+Compare two times.
+
+@param a The first time
+@param b The second time
+
+@return 1 if $(a) is earlier than $(b), 0 otherwise
+*/
+int isEarlier(struct timespec* a, struct timespec* b) {
+	return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+/*
+Move a deadline in the heap until the heap is ordered again.
+
+@param index The index of the deadline
+
+@return void
+*/
+void siftDeadline(int index) {
+	// move up
+	while (index > 0 && isEarlier(&deadlines[index].when, &deadlines[(index - 1) / 2].when)) {
+		Deadline temp = deadlines[index];
+		deadlines[index] = deadlines[(index - 1) / 2];
+		deadlines[(index - 1) / 2] = temp;
+		index = (index - 1) / 2;
+	}
+	// move down
+	while (1) {
+		int earliest = index;
+		for (int child = 2 * index + 1; child <= 2 * index + 2 && child < deadlineNum; child++) {
+			if (isEarlier(&deadlines[child].when, &deadlines[earliest].when)) {
+				earliest = child;
+			}
+		}
+		if (earliest == index) {
+			break;
+		}
+		Deadline temp = deadlines[index];
+		deadlines[index] = deadlines[earliest];
+		deadlines[earliest] = temp;
+		index = earliest;
+	}
+}
+
+/*
+Remove a deadline from the heap.
+
+@param index The index of the deadline
+
+@return void
+*/
+void removeDeadline(int index) {
+	deadlineNum -= 1;
+	if (index < deadlineNum) {
+		deadlines[index] = deadlines[deadlineNum];
+		siftDeadline(index);
+	}
+}
+
+/*
+Arm the shared timer for the earliest deadline, or disarm it if there is no deadline.
+
+@param void
+
+@return void
+*/
+void rearmWatchdog(void) {
+	struct itimerspec spec;
+	memset(&spec, 0, sizeof(spec));
+	if (deadlineNum > 0 && deadlines[0].phase != DEADLINE_FIRED) {
+		spec.it_value = deadlines[0].when;
+	}
+	timer_settime(watchdogTimer, TIMER_ABSTIME, &spec, NULL);
+}
+
+/*
+Add seconds to a time.
+
+@param time The time
+@param seconds The seconds to add
+
+@return void
+*/
+void addSeconds(struct timespec* time, double seconds) {
+	long long nanos = time->tv_nsec + (long long) ((seconds - (long long) seconds) * 1e9);
+	time->tv_sec += (long long) seconds + nanos / 1000000000;
+	time->tv_nsec = nanos % 1000000000;
+}
+
+/*
+Handler of SIGALRM in the Main process.
+It signal the process groups whose deadlines have expired, and arm the timer for the next deadline.
+The SIGTERM of a job is followed by SIGKILL after the grace period, unless the group has gone.
+
+@param signum Signal Number
+
+@return void
+*/
+void watchdogSighandler(int signum) {
+	int savedErrno = errno;
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	while (deadlineNum > 0 && !isEarlier(&now, &deadlines[0].when)) {
+		Deadline* deadline = &deadlines[0];
+		if (deadline->phase == DEADLINE_TERM) {
+			// a stopped process could not handle SIGTERM
+			int sent = kill(-deadline->pgid, SIGTERM) == 0;
+			kill(-deadline->pgid, SIGCONT);
+			if (sent && deadline->killAfter > 0) {
+				deadline->phase = DEADLINE_KILL;
+				addSeconds(&deadline->when, deadline->killAfter);
+				siftDeadline(0);
+				continue;
+			}
+		}
+		else {
+			kill(-deadline->pgid, SIGKILL);
+		}
+		// it is kept at the bottom of heap until the job is reaped
+		deadline->phase = DEADLINE_FIRED;
+		deadline->when.tv_sec = LONG_MAX;
+		deadline->when.tv_nsec = 0;
+		siftDeadline(0);
+	}
+	rearmWatchdog();
+	errno = savedErrno;
+}
+
+/*
+Block or unblock SIGALRM and SIGCHLD, so the heap is not changed by the handlers while it is being changed.
+
+@param how SIG_BLOCK or SIG_SETMASK
+@param saved The space to hold (SIG_BLOCK) or the mask to restore (SIG_SETMASK)
+
+@return void
+*/
+void blockWatchdog(int how, sigset_t* saved) {
+	if (how == SIG_BLOCK) {
+		sigset_t mask;
+		sigemptyset(&mask);
+		sigaddset(&mask, SIGALRM);
+		sigaddset(&mask, SIGCHLD);
+		sigprocmask(SIG_BLOCK, &mask, saved);
+	}
+	else {
+		sigprocmask(SIG_SETMASK, saved, NULL);
+	}
+}
+
+/*
+Set up the shared timer and the handler of SIGALRM (it is done when the first deadline is armed).
+
+@param void
+
+@return status 0 if success, -1 if the timer could not be created
+*/
+int setupWatchdog(void) {
+	if (watchdogReady == 1) {
+		return 0;
+	}
+	// the handler is not interrupted by SIGCHLD, which may cancel a deadline
+	struct sigaction sa_alrm = {0};
+	sa_alrm.sa_flags = SA_RESTART;
+	sa_alrm.sa_handler = &watchdogSighandler;
+	sigemptyset(&sa_alrm.sa_mask);
+	sigaddset(&sa_alrm.sa_mask, SIGCHLD);
+	sigaction(SIGALRM, &sa_alrm, NULL);
+	struct sigevent event;
+	memset(&event, 0, sizeof(event));
+	event.sigev_notify = SIGEV_SIGNAL;
+	event.sigev_signo = SIGALRM;
+	if (timer_create(CLOCK_MONOTONIC, &event, &watchdogTimer) == -1) {
+		perror("3230shell: timeout");
+		return -1;
+	}
+	watchdogReady = 1;
+	return 0;
+}
+
+/*
+Arm the deadline of a job.
+
+@param pgid The process group of job
+@param timeout The seconds before SIGTERM is sent
+@param killAfter The seconds between SIGTERM and SIGKILL (0 means SIGKILL is not sent)
+
+@return void
+*/
+void armWatchdog(pid_t pgid, double timeout, double killAfter) {
+	if (setupWatchdog() != 0) {
+		return;
+	}
+	sigset_t saved;
+	blockWatchdog(SIG_BLOCK, &saved);
+	if (deadlineNum == deadlineCapacity) {
+		deadlineCapacity = deadlineCapacity == 0 ? 16 : deadlineCapacity * 2;
+		deadlines = (Deadline*) realloc(deadlines, deadlineCapacity * sizeof(Deadline));
+	}
+	Deadline* deadline = &deadlines[deadlineNum++];
+	deadline->pgid = pgid;
+	clock_gettime(CLOCK_MONOTONIC, &deadline->when);
+	addSeconds(&deadline->when, timeout);
+	deadline->killAfter = killAfter;
+	deadline->phase = DEADLINE_TERM;
+	siftDeadline(deadlineNum - 1);
+	rearmWatchdog();
+	blockWatchdog(SIG_SETMASK, &saved);
+}
+
+/*
+Cancel the deadline of a job (e.g. the job has finished).
+
+@param pgid The process group of job
+
+@return fired 1 if SIGTERM has been sent to the job, 0 otherwise
+*/
+int cancelWatchdog(pid_t pgid) {
+	if (watchdogReady == 0) {
+		return 0;
+	}
+	sigset_t saved;
+	blockWatchdog(SIG_BLOCK, &saved);
+	// a job that is not armed (or already cancelled) is not timed out
+	int fired = 0;
+	for (int i = 0; i < deadlineNum; i++) {
+		if (deadlines[i].pgid == pgid) {
+			fired = deadlines[i].phase != DEADLINE_TERM;
+			removeDeadline(i);
+			rearmWatchdog();
+			break;
+		}
+	}
+	blockWatchdog(SIG_SETMASK, &saved);
+	return fired;
+}
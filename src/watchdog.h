@@ -0,0 +1,38 @@
+/*
+FileName:    watchdog.h
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: Hold the function header of watchdog.c, provide self defined structure.
+Remark:      None of function is implemented in this file.
+*/
+
+#include <sys/types.h>
+#include <time.h>
+
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+// the exit status of a foreground job that is stopped by its timeout (the same as timeout(1))
+#define timeout_status 124
+
+// the phase of a deadline (a fired deadline stay in the heap until it is cancelled, so the job is known to be timed out)
+enum DeadlinePhase {DEADLINE_TERM, DEADLINE_KILL, DEADLINE_FIRED};
+
+// the deadline of a job, all the deadlines are kept in a min-heap that share one timer
+typedef struct Deadline {
+	pid_t pgid;                 // the process group of job
+	struct timespec when;       // the time to send the signal (CLOCK_MONOTONIC)
+	double killAfter;           // the seconds between SIGTERM and SIGKILL (0 means SIGKILL is not sent)
+	int phase;                  // the signal to be sent (DeadlinePhase)
+} Deadline;
+
+int parseDuration(char* text, double* seconds);
+
+int parseTimeout(char** tokens, double* timeout, double* killAfter);
+
+void armWatchdog(pid_t pgid, double timeout, double killAfter);
+
+int cancelWatchdog(pid_t pgid);
+
+#endif
@@ -0,0 +1,475 @@
+/*
+FileName:    wildcard.c
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: It expand the wildcards ('*', '?', "[...]" and "**") of an argument into the matching paths.
+             The pattern is compiled once before any directory is read, the directories are read in large batches
+             by getdents64(), and the type of file is taken from d_type, so a file is only stat() when it is necessary.
+Remark:      function implemented in this file:
+             1. Wildcard expansion: ALL
+*/
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "constant.h"
+#include "wildcard.h"
+
+// the state of expanding a pattern
+typedef struct WildcardSearch {
+	Pattern* pattern;   // the compiled pattern
+	char** paths;       // NULL terminated vector of matching paths
+	int count;          // number of paths
+	int capacity;       // capacity of $(paths)
+	char* batch;        // the buffer of getdents64()
+} WildcardSearch;
+
+/*
+Parse a bracket expression "[...]" into the bitmap of a token.
+"[!...]" and "[^...]" match the chars not in the bracket, ']' is literal if it is the first char.
+
+@param raw The pattern
+@param pos The position of '['
+@param token The token
+
+@return end The position after ']', -1 if the bracket is not closed (then '[' is a literal char)
+*/
+int parseClass(char* raw, int pos, PatternToken* token) {
+	memset(token->set, 0, sizeof(token->set));
+	token->type = TOKEN_CLASS;
+	int i = pos + 1;
+	int negate = raw[i] == '!' || raw[i] == '^';
+	if (negate) {
+		i++;
+	}
+	int first = 1;
+	while (raw[i] != '\0' && (raw[i] != ']' || first == 1)) {
+		if (raw[i] == '/') {
+			return -1;
+		}
+		unsigned char low = raw[i];
+		if (raw[i] == '\\' && raw[i+1] != '\0') {
+			low = raw[++i];
+		}
+		unsigned char high = low;
+		// a range, e.g. "a-z" (the '-' before ']' is literal)
+		if (raw[i+1] == '-' && raw[i+2] != '\0' && raw[i+2] != ']') {
+			i += 2;
+			if (raw[i] == '\\' && raw[i+1] != '\0') {
+				i++;
+			}
+			high = raw[i];
+		}
+		for (int ch = low; ch <= high; ch++) {
+			token->set[ch >> 3] |= 1 << (ch & 7);
+		}
+		i++;
+		first = 0;
+	}
+	if (raw[i] != ']') {
+		return -1;
+	}
+	if (negate) {
+		for (int j = 0; j < 32; j++) {
+			token->set[j] = ~token->set[j];
+		}
+	}
+	return i + 1;
+}
+
+/*
+Compile a path component of pattern.
+A component without any wildcard is kept as a literal, so its directory need not be read.
+A component with only one '*' (e.g. "*.log") is matched by comparing its prefix and suffix.
+
+@param segment The compiled component
+@param raw The component, the special chars are escaped by '\'
+
+@return void
+*/
+void compileSegment(PatternSegment* segment, char* raw) {
+	memset(segment, 0, sizeof(PatternSegment));
+	if (strcmp(raw, "**") == 0) {
+		segment->type = SEGMENT_RECURSIVE;
+		return;
+	}
+	int length = strlen(raw);
+	segment->tokens = (PatternToken*) malloc((length + 1) * sizeof(PatternToken));
+	segment->dotted = raw[0] == '.' || (raw[0] == '\\' && raw[1] == '.');
+	int wildcards = 0;
+	int stars = 0;
+	for (int i = 0; raw[i] != '\0'; i++) {
+		PatternToken* token = &segment->tokens[segment->tokenNum];
+		token->type = TOKEN_CHAR;
+		token->ch = raw[i];
+		if (raw[i] == '\\' && raw[i+1] != '\0') {
+			token->ch = raw[++i];
+		}
+		else if (raw[i] == '*') {
+			// "**" in a component is the same as '*'
+			if (segment->tokenNum > 0 && segment->tokens[segment->tokenNum-1].type == TOKEN_STAR) {
+				continue;
+			}
+			token->type = TOKEN_STAR;
+			stars++;
+		}
+		else if (raw[i] == '?') {
+			token->type = TOKEN_ANY;
+			wildcards++;
+		}
+		else if (raw[i] == '[') {
+			int end = parseClass(raw, i, token);
+			if (end == -1) {
+				token->type = TOKEN_CHAR;
+				token->ch = '[';
+			}
+			else {
+				wildcards++;
+				i = end - 1;
+			}
+		}
+		segment->tokenNum++;
+	}
+	// a literal component
+	if (wildcards == 0 && stars == 0) {
+		segment->type = SEGMENT_LITERAL;
+		segment->literal = (char*) malloc(segment->tokenNum + 1);
+		for (int i = 0; i < segment->tokenNum; i++) {
+			segment->literal[i] = segment->tokens[i].ch;
+		}
+		segment->literal[segment->tokenNum] = '\0';
+		return;
+	}
+	segment->type = SEGMENT_PATTERN;
+	// a component like "prefix*suffix"
+	if (wildcards == 0 && stars == 1) {
+		int star = 0;
+		while (segment->tokens[star].type != TOKEN_STAR) {
+			star++;
+		}
+		segment->prefix = (char*) malloc(star + 1);
+		segment->suffix = (char*) malloc(segment->tokenNum - star);
+		for (int i = 0; i < segment->tokenNum; i++) {
+			if (i < star) {
+				segment->prefix[i] = segment->tokens[i].ch;
+			}
+			else if (i > star) {
+				segment->suffix[i - star - 1] = segment->tokens[i].ch;
+			}
+		}
+		segment->prefix[star] = '\0';
+		segment->suffix[segment->tokenNum - star - 1] = '\0';
+	}
+}
+
+/*
+Compile a pattern into its path components.
+
+@param raw The pattern, the special chars are escaped by '\' (e.g. "*.c", "'*'.c" -> "\*.c")
+
+@return pattern The compiled pattern (free it by freePattern())
+*/
+Pattern* compilePattern(char* raw) {
+	Pattern* pattern = (Pattern*) malloc(sizeof(Pattern));
+	memset(pattern, 0, sizeof(Pattern));
+	int length = strlen(raw);
+	pattern->absolute = raw[0] == '/';
+	pattern->directory = length > 1 && raw[length-1] == '/';
+	pattern->segments = (PatternSegment*) malloc((length / 2 + 1) * sizeof(PatternSegment));
+	char* copy = strdup(raw);
+	// split by '/', the empty components (e.g. "a//b") are skipped
+	char* saved = NULL;
+	for (char* part = strtok_r(copy, "/", &saved); part != NULL; part = strtok_r(NULL, "/", &saved)) {
+		compileSegment(&pattern->segments[pattern->segmentNum++], part);
+	}
+	free(copy);
+	return pattern;
+}
+
+/*
+Free a compiled pattern.
+
+@param pattern The pattern
+
+@return NULL to NULL the pattern
+*/
+Pattern* freePattern(Pattern* pattern) {
+	for (int i = 0; i < pattern->segmentNum; i++) {
+		free(pattern->segments[i].literal);
+		free(pattern->segments[i].tokens);
+		free(pattern->segments[i].prefix);
+		free(pattern->segments[i].suffix);
+	}
+	free(pattern->segments);
+	free(pattern);
+	return NULL;
+}
+
+/*
+Check whether a file name match a path component.
+A hidden file (".xxx") is only matched if the component start with '.'.
+
+@param segment The component
+@param name The file name
+@param length The length of name
+
+@return 1 if match, 0 otherwise
+*/
+int matchSegment(PatternSegment* segment, char* name, int length) {
+	if (name[0] == '.' && segment->dotted == 0) {
+		return 0;
+	}
+	// "prefix*suffix"
+	if (segment->suffix != NULL) {
+		int prefixLength = strlen(segment->prefix);
+		int suffixLength = strlen(segment->suffix);
+		return length >= prefixLength + suffixLength
+			&& memcmp(name, segment->prefix, prefixLength) == 0
+			&& memcmp(&name[length - suffixLength], segment->suffix, suffixLength) == 0;
+	}
+	// match the tokens, go back to the last '*' if it fail (no more than O(tokens * length))
+	int t = 0;
+	int n = 0;
+	int starToken = -1;
+	int starName = 0;
+	PatternToken* tokens = segment->tokens;
+	while (n < length) {
+		if (t < segment->tokenNum && tokens[t].type == TOKEN_STAR) {
+			starToken = t++;
+			starName = n;
+			continue;
+		}
+		if (t < segment->tokenNum) {
+			unsigned char ch = name[n];
+			int type = tokens[t].type;
+			if ((type == TOKEN_CHAR && tokens[t].ch == ch) || type == TOKEN_ANY
+				|| (type == TOKEN_CLASS && (tokens[t].set[ch >> 3] & (1 << (ch & 7))))) {
+				t++;
+				n++;
+				continue;
+			}
+		}
+		if (starToken == -1) {
+			return 0;
+		}
+		// let the last '*' take one more char
+		t = starToken + 1;
+		n = ++starName;
+	}
+	while (t < segment->tokenNum && tokens[t].type == TOKEN_STAR) {
+		t++;
+	}
+	return t == segment->tokenNum;
+}
+
+/*
+Append a matching path to the result.
+
+@param search The state of expansion
+@param dir The directory (e.g. "src/", "" for the current directory)
+@param name The file name (NULL if $(dir) itself is the path)
+@param slash 1 to append a '/' (the pattern end with '/')
+
+@return void
+*/
+void addMatch(WildcardSearch* search, char* dir, char* name, int slash) {
+	if (search->count + 1 >= search->capacity) {
+		search->capacity *= 2;
+		search->paths = (char**) realloc(search->paths, search->capacity * sizeof(char*));
+	}
+	int length = strlen(dir) + (name != NULL ? strlen(name) : 0);
+	char* path = (char*) malloc(length + 2);
+	sprintf(path, "%s%s%s", dir, name != NULL ? name : "", slash ? "/" : "");
+	search->paths[search->count++] = path;
+	search->paths[search->count] = NULL;
+}
+
+/*
+Check whether a directory entry is a directory, stat() is only called if d_type is not enough.
+
+@param fd The fd of the directory that hold the entry
+@param name The name of entry
+@param type The d_type of entry
+@param follow 1 to follow the symbolic link
+
+@return 1 if it is a directory, 0 otherwise
+*/
+int isDirectory(int fd, char* name, int type, int follow) {
+	if (type == DT_DIR) {
+		return 1;
+	}
+	if (type == DT_UNKNOWN || (type == DT_LNK && follow == 1)) {
+		struct stat info;
+		return fstatat(fd, name, &info, follow == 1 ? 0 : AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(info.st_mode);
+	}
+	return 0;
+}
+
+void expandSegment(WildcardSearch* search, int index, char* dir);
+
+/*
+Expand the remaining components in every collected sub-directory.
+
+@param search The state of expansion
+@param index The index of component to be expanded in the sub-directories
+@param dir The parent directory
+@param subdirs The NULL terminated names of sub-directories, they are freed here
+
+@return void
+*/
+void expandSubdirectories(WildcardSearch* search, int index, char* dir, char** subdirs) {
+	for (int i = 0; subdirs[i] != NULL; i++) {
+		char* path = (char*) malloc(strlen(dir) + strlen(subdirs[i]) + 2);
+		sprintf(path, "%s%s/", dir, subdirs[i]);
+		expandSegment(search, index, path);
+		free(path);
+		free(subdirs[i]);
+	}
+	free(subdirs);
+}
+
+/*
+Expand the component $(index) of the pattern in a directory, and the following components recursively.
+The entries of directory are read by getdents64() in batches of $(directory_batch_size).
+The sub-directories are collected and expanded after the directory is closed, so only one batch buffer is needed.
+
+@param search The state of expansion
+@param index The index of component
+@param dir The directory with a trailing '/' ("" for the current directory)
+
+@return void
+*/
+void expandSegment(WildcardSearch* search, int index, char* dir) {
+	Pattern* pattern = search->pattern;
+	PatternSegment* segment = &pattern->segments[index];
+	int last = index == pattern->segmentNum - 1;
+	// a literal component need not read the directory
+	if (segment->type == SEGMENT_LITERAL) {
+		char* path = (char*) malloc(strlen(dir) + strlen(segment->literal) + 2);
+		sprintf(path, "%s%s", dir, segment->literal);
+		struct stat info;
+		if (last == 0) {
+			strcat(path, "/");
+			expandSegment(search, index + 1, path);
+		}
+		else if (fstatat(AT_FDCWD, path, &info, pattern->directory ? 0 : AT_SYMLINK_NOFOLLOW) == 0
+				&& (pattern->directory == 0 || S_ISDIR(info.st_mode))) {
+			addMatch(search, path, NULL, pattern->directory);
+		}
+		free(path);
+		return;
+	}
+	int recursive = segment->type == SEGMENT_RECURSIVE;
+	// "**" match zero directory
+	if (recursive && last == 0) {
+		expandSegment(search, index + 1, dir);
+	}
+	int fd = open(dir[0] != '\0' ? dir : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd == -1) {
+		return;
+	}
+	int subdirNum = 0;
+	char** subdirs = (char**) malloc(sizeof(char*));
+	long count = 0;
+	while ((count = getdents64(fd, search->batch, directory_batch_size)) > 0) {
+		for (long pos = 0; pos < count; pos += ((struct dirent64*) &search->batch[pos])->d_reclen) {
+			struct dirent64* entry = (struct dirent64*) &search->batch[pos];
+			char* name = entry->d_name;
+			int length = strlen(name);
+			if (name[0] == '.' && (length == 1 || (length == 2 && name[1] == '.'))) {
+				continue;
+			}
+			int descend = 0;
+			if (recursive) {
+				// "**" skip the hidden directories and do not follow the symbolic links
+				if (name[0] == '.') {
+					continue;
+				}
+				int isDir = isDirectory(fd, name, entry->d_type, 0);
+				if (last && (pattern->directory == 0 || isDir)) {
+					addMatch(search, dir, name, pattern->directory);
+				}
+				descend = isDir;
+			}
+			else if (matchSegment(segment, name, length) == 1) {
+				// the type is only checked if the pattern need a directory
+				if (last && pattern->directory == 0) {
+					addMatch(search, dir, name, 0);
+				}
+				else if (isDirectory(fd, name, entry->d_type, 1)) {
+					if (last) {
+						addMatch(search, dir, name, 1);
+					}
+					descend = !last;
+				}
+			}
+			if (descend) {
+				subdirs = (char**) realloc(subdirs, (subdirNum + 2) * sizeof(char*));
+				subdirs[subdirNum++] = strdup(name);
+			}
+		}
+	}
+	close(fd);
+	subdirs[subdirNum] = NULL;
+	// "**" stay at the same component in the sub-directories
+	expandSubdirectories(search, recursive ? index : index + 1, dir, subdirs);
+}
+
+/*
+Compare two paths for qsort().
+
+@param a The pointer to the first path
+@param b The pointer to the second path
+
+@return result <0, 0 or >0 as strcmp()
+*/
+int comparePaths(const void* a, const void* b) {
+	return strcmp(*(char**) a, *(char**) b);
+}
+
+/*
+Expand a pattern into the matching paths, e.g. "*.c" -> {"ast.c", "buffer.c", ...}.
+The paths are sorted only if there are more than one path and they are not in order yet.
+
+@param raw The pattern, the quoted special chars are escaped by '\' (e.g. "'*'.c" -> "\*.c")
+
+@return paths The NULL terminated paths (free each of them and the vector by free()), NULL if nothing match
+*/
+char** expandWildcard(char* raw) {
+	WildcardSearch search;
+	memset(&search, 0, sizeof(WildcardSearch));
+	search.pattern = compilePattern(raw);
+	search.capacity = max_num_of_arguments;
+	search.paths = (char**) malloc(search.capacity * sizeof(char*));
+	search.paths[0] = NULL;
+	if (search.pattern->segmentNum == 0) {
+		// the pattern is "/"
+		addMatch(&search, "/", NULL, 0);
+	}
+	else {
+		search.batch = (char*) malloc(directory_batch_size);
+		expandSegment(&search, 0, search.pattern->absolute ? "/" : "");
+		free(search.batch);
+	}
+	search.pattern = freePattern(search.pattern);
+	if (search.count == 0) {
+		free(search.paths);
+		return NULL;
+	}
+	for (int i = 1; i < search.count; i++) {
+		if (strcmp(search.paths[i-1], search.paths[i]) > 0) {
+			qsort(search.paths, search.count, sizeof(char*), comparePaths);
+			break;
+		}
+	}
+	return search.paths;
+}
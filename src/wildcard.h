@@ -0,0 +1,47 @@
+/*
+FileName:    wildcard.h
+Author:      Hung Ka Hing
+UID:         3035782750
+Platform:    Linux Debian & Linux Ubuntu
+Description: Hold the function header of wildcard.c, provide self defined structure.
+Remark:      None of function is implemented in this file.
+*/
+
+#ifndef WILDCARD_H
+#define WILDCARD_H
+
+// type of the compiled pattern of a path component
+enum SegmentType {SEGMENT_LITERAL, SEGMENT_PATTERN, SEGMENT_RECURSIVE};
+
+// type of a token in the compiled pattern
+enum TokenType {TOKEN_CHAR, TOKEN_ANY, TOKEN_STAR, TOKEN_CLASS};
+
+// a token of pattern, i.e. a char, '?', '*' or "[...]"
+typedef struct PatternToken {
+	int type;                   // the TokenType
+	unsigned char ch;           // the char of TOKEN_CHAR
+	unsigned char set[32];      // the bitmap of chars matched by TOKEN_CLASS
+} PatternToken;
+
+// a path component of pattern, e.g. "*.log" of "var/*.log"
+typedef struct PatternSegment {
+	int type;                   // the SegmentType ("**" is SEGMENT_RECURSIVE)
+	char* literal;              // the component without escape (SEGMENT_LITERAL)
+	PatternToken* tokens;       // the tokens (SEGMENT_PATTERN)
+	int tokenNum;               // number of tokens
+	int dotted;                 // 1 if the pattern start with '.', so it could match the hidden files
+	char* prefix;               // the chars before the first '*' if there is only one '*' and no '?' and "[...]"
+	char* suffix;               // the chars after the only '*' (NULL if the generic matching is needed)
+} PatternSegment;
+
+// a compiled pattern, e.g. "/var/log/**/*.log"
+typedef struct Pattern {
+	int absolute;               // 1 if the pattern start with '/'
+	int directory;              // 1 if the pattern end with '/', only directories are matched
+	PatternSegment* segments;   // the path components
+	int segmentNum;             // number of path components
+} Pattern;
+
+char** expandWildcard(char* pattern);
+
+#endif